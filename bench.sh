@@ -0,0 +1,125 @@
+#!/bin/bash
+# RDP benchmark: sends files of each size through rdpproxy under each
+# impairment profile and appends a CSV row per transfer.
+#
+# usage: bench.sh [-o csv_file] [-s "sizes"] [-p profile_file] [-n runs]
+#                 [-l label] [-- rdps options]
+#
+# A profile file holds one profile per line, a name and rdpproxy options.
+# The environment may set PORT (first of three ports, 9100), TIMEOUT
+# (seconds per transfer, 300) and RDPR_OPTS.
+
+csv=bench.csv
+sizes="1M 16M 64M"
+profiles=
+runs=1
+label=$(git rev-parse --short HEAD 2>/dev/null || echo none)
+port=${PORT:-9100}
+limit=${TIMEOUT:-300}
+
+while getopts "o:s:p:n:l:" opt; do
+    case $opt in
+    o) csv=$OPTARG ;;
+    s) sizes=$OPTARG ;;
+    p) profiles=$OPTARG ;;
+    n) runs=$OPTARG ;;
+    l) label=$OPTARG ;;
+    *) exit 1 ;;
+    esac
+done
+
+shift $((OPTIND - 1))
+
+cd "$(dirname "$0")" || exit 1
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+# delay and jitter in ms each way, chances per datagram.
+default_profiles() {
+    cat <<EOF
+clean
+lan -d 0.1 -j 0.05
+wan -d 20 -j 2 -b 100M
+lossy -d 5 -l 0.01
+reorder -d 5 -j 1 -r 0.05
+duplicate -d 5 -D 0.02
+harsh -d 30 -j 5 -l 0.03 -r 0.02 -D 0.01 -b 50M
+EOF
+}
+
+# prints user + system seconds of a bash time report.
+cpu() {
+    awk '{ printf "%.3f", $1 + $2 }' "$1"
+}
+
+# prints a counter of a Prometheus text export, 0 when it is missing.
+counter() {
+    awk -v name="rdp_$2_total" '$1 ~ "^" name "{" { v = $2 }
+        END { print v + 0 }' "$1" 2>/dev/null
+}
+
+[ -f "$csv" ] || echo "label,profile,size,run,seconds,goodput_mbps,"\
+"retrans_ratio,sender_cpu_s,receiver_cpu_s,status" > "$csv"
+
+TIMEFORMAT='%U %S'
+
+for size in $sizes; do
+    head -c "$size" /dev/urandom > "$dir/data" || exit 1
+    bytes=$(stat -c %s "$dir/data")
+
+    while read -r name opts; do
+        [ -z "$name" ] || [ "${name#\#}" != "$name" ] && continue
+
+        for run in $(seq "$runs"); do
+            rm -f "$dir"/out "$dir"/*.prom
+
+            # shellcheck disable=SC2086
+            ./rdpproxy $opts -s "$run" 127.0.0.1 $((port + 1)) \
+                127.0.0.1 "$port" < /dev/null > "$dir/proxy.log" &
+            proxy=$!
+
+            # shellcheck disable=SC2086
+            { time timeout "$limit" ./rdpr -v error $RDPR_OPTS \
+                -x "$dir/r.prom" 127.0.0.1 "$port" "$dir/out" \
+                < /dev/null > /dev/null 2> "$dir/r.err"; } 2> "$dir/r.cpu" &
+            receiver=$!
+            sleep 0.2
+
+            start=$(date +%s%N)
+            { time timeout "$limit" ./rdps -v error "$@" \
+                -x "$dir/s.prom" 127.0.0.1 $((port + 2)) \
+                127.0.0.1 $((port + 1)) "$dir/data" \
+                < /dev/null > /dev/null 2> "$dir/s.err"; } 2> "$dir/s.cpu"
+            result=$?
+            end=$(date +%s%N)
+
+            wait "$receiver"
+            kill "$proxy"
+            wait "$proxy"
+
+            if [ $result -ne 0 ]; then
+                status=failed
+            elif cmp -s "$dir/data" "$dir/out"; then
+                status=ok
+            else
+                status=corrupt
+            fi
+
+            sent=$(counter "$dir/s.prom" data_packets)
+            unique=$(counter "$dir/s.prom" unique_data_packets)
+
+            awk -v label="$label" -v name="$name" -v size="$size" \
+                -v run="$run" -v ns=$((end - start)) -v bytes="$bytes" \
+                -v sent="$sent" -v unique="$unique" -v status="$status" \
+                -v scpu="$(cpu "$dir/s.cpu")" -v rcpu="$(cpu "$dir/r.cpu")" \
+                'BEGIN {
+                    s = ns / 1e9
+                    printf "%s,%s,%s,%d,%.3f,%.2f,%.4f,%s,%s,%s\n", label,
+                        name, size, run, s, bytes * 8 / s / 1e6,
+                        unique ? (sent - unique) / unique : 0, scpu, rcpu,
+                        status
+                }' | tee -a "$csv"
+        done
+    done < <(if [ -n "$profiles" ]; then cat "$profiles"; else
+        default_profiles; fi)
+done
@@ -1,6 +1,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <netinet/ip.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -9,32 +10,56 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include "rdp.h"
+#include "rdpcc.h"
+#include "rdpclock.h"
+#include "rdpexport.h"
+#include "rdpfec.h"
+#include "rdpio.h"
+#include "rdplog.h"
+#include "rdplz.h"
+#include "rdpmtu.h"
+#include "rdppace.h"
 #include "rdppkt.h"
-
-// RDP header strings.
-#define RDP_ACK_HDR "Magic: cscs361p2\nType: ACK\nAcknowledgement: %u\nWindow: %u\n\n"
-#define RDP_DAT_HDR "Magic: cscs361p2\nType: DAT\nSequence: %u\nPayload %u\n\n"
-#define RDP_FIN_HDR "Magic: cscs361p2\nType: FIN\nSequence: %u\n\n"
-#define RDP_RST_HDR "Magic: cscs361p2\nType: RST\n\n"
-#define RDP_SYN_HDR "Magic: cscs361p2\nType: SYN\nSequence: %u\n\n"
-
-
-// packet size.
-#define RDP_BUF_SIZE 1024
-#define RDP_MAX_PAY 959
+#include "rdpreasm.h"
+#include "rdpring.h"
+#include "rdpscore.h"
+#include "rdptimer.h"
 
 // RDP timing.
-#define RDP_BURST 100
 #define RDP_RETRANS 3
-#define RDP_RE_TIME 1000000
-#define RDP_WAIT_TIME 250000
-
-#define RDP_ADDR_LEN 16
 
-#define RDP_SEND 's'
-#define RDP_RESEND 'S'
-#define RDP_RECEIVE 'r'
-#define RDP_DUPLICATE 'R'
+// timeouts in a row before a transfer is reset.
+#define RDP_RTO_RETRANS 8
+
+// RDP send stream, the state of a transfer kept between the chunks
+// written to it.
+struct rdp_stream {
+    int sock;
+    struct rdp_conn *sender;
+    const char *data;           // the whole transfer, when size is 0
+    char *buffer;               // ring of what is written and unacknowledged
+    size_t size;                // ring size
+    unsigned long long start;   // sequence number of the first byte
+    unsigned long long end;     // and of the byte after the last written
+    unsigned long long nxt;     // next byte sent for the first time
+    unsigned long long recover; // losses before it were reacted to
+    unsigned long long begin;   // rdp_clock() time sending began
+    int closed;                 // nothing is written after end
+    int failed;                 // the connection was reset
+    unsigned int max;           // largest payload of a segment
+    unsigned int room;          // segments of a burst, parity aside
+    unsigned int trys;          // timeouts in a row
+    unsigned int persist;       // a closed window is probed with a byte
+    struct rdp_lz *lz;          // blocks compressed into the ring, or NULL
+    struct rdp_score *score;
+    struct rdp_cc cc;
+    struct rdp_pace pace;
+    struct rdp_batch burst;
+    struct rdp_batch acks;
+    struct rdp_wheel wheel;
+    struct rdp_timer rto;       // retransmission timer
+    struct rdp_timer window;    // persist timer
+};
 
 /*
  * @param conn connection of rdp
@@ -42,6 +67,10 @@
 void rdp_begin(struct rdp_conn *conn)
 {
     gettimeofday(&conn->stats.time, NULL);
+    conn->stats.begin = rdp_clock();
+#ifdef RDP_PROFILE
+    rdp_prof_init(&conn->stats.prof);
+#endif
 }
 
 /*
@@ -50,7 +79,14 @@ void rdp_begin(struct rdp_conn *conn)
 void rdp_end(struct rdp_conn *conn)
 {
     struct timeval now;
+
+    // a connection given up on is ended before rdp_close sees it.
+    if (conn->stats.end) {
+        return;
+    }
+
     gettimeofday(&now, NULL);
+    conn->stats.end = rdp_clock();
 
     // calculate time consuming
     if (conn->stats.time.tv_usec > now.tv_usec) {
@@ -61,58 +97,344 @@ void rdp_end(struct rdp_conn *conn)
 
     conn->stats.time.tv_sec = now.tv_sec - conn->stats.time.tv_sec; 
     conn->stats.time.tv_usec = now.tv_usec - conn->stats.time.tv_usec;
+
+    // a ring still posted would take datagrams meant for the socket.
+    rdp_ring_free(conn->ring, &conn->stats);
+    conn->ring = NULL;
+    rdp_fec_free(conn->fec);
+    conn->fec = NULL;
+
+    free(conn->inbox);
+    conn->inbox = NULL;
+    free(conn->acks);
+    conn->acks = NULL;
+    free(conn->packets);
+    conn->packets = NULL;
+    free(conn->placed);
+    conn->placed = NULL;
 }
 
 /*
- * @param event event associated with packet
- * @parma sender sending address
- * @param receiver receiving address
+ * @param conn rdp connection
+ * @param buffer header output
  * @param type packet type
- * @param number packet number
- * @param info packet information
- */
-void rdp_log(char event, const struct sockaddr_in *sender,
-    const struct sockaddr_in *receiver, int type, unsigned int number,
-    unsigned int info)
-{
-    char sndaddr[RDP_ADDR_LEN];
-    char recvaddr[RDP_ADDR_LEN];
-    unsigned int h, m, s, us;
-    struct timeval tv;
-
-    // Time format
-    gettimeofday(&tv, NULL);
-    h = (tv.tv_sec / 3600 - 8) % 24;
-    m = tv.tv_sec / 60 % 60;
-    s = tv.tv_sec % 60;
-    us = tv.tv_usec;
-
-    // IP addresses.
-    strncpy(sndaddr, inet_ntoa(sender->sin_addr), RDP_ADDR_LEN);
-    strncpy(recvaddr, inet_ntoa(receiver->sin_addr), RDP_ADDR_LEN);
-
-    // packet log
-    switch (type) {
-    case RDP_ACK:
-    case RDP_DAT:
-        printf("%02u:%02u:%02u.%d %c %s:%d %s:%d %s %u %u\n", h, m, s, us,
-            event, sndaddr, ntohs(sender->sin_port), recvaddr,
-            ntohs(receiver->sin_port), rdp_types[type], number, info);
-        break;
-    case RDP_FIN:
-    case RDP_SYN:
-        printf("%02u:%02u:%02u.%d %c %s:%d %s:%d %s %u\n", h, m, s, us,
-            event, sndaddr, ntohs(sender->sin_port), recvaddr,
-            ntohs(receiver->sin_port), rdp_types[type], number);
-        break;
-    case RDP_RST:
-        printf("%02u:%02u:%02u.%d %c %s:%d %s:%d %s\n", h, m, s, us, event,
-            sndaddr, ntohs(sender->sin_port), recvaddr,
-            ntohs(receiver->sin_port), rdp_types[type]);
-        break;
-    default:
-        fprintf(stderr, "invalid packet\n");
+ * @param number sequence or acknowledgement number
+ * @param info window or payload length
+ * @return int header length
+ */
+int rdp_header(const struct rdp_conn *conn, char *buffer, int type,
+    unsigned long long number, unsigned int info)
+{
+    struct rdp_packet packet;
+
+    packet.type = type;
+    packet.number = number;
+    packet.info = info;
+    packet.caps = 0;
+    packet.sacks = 0;
+    packet.tsval = rdp_clock();
+    packet.tsecr = conn->tsecr;
+    memset(&packet.tag, 0, sizeof(packet.tag));
+
+    return rdp_format(buffer, RDP_BUF_SIZE, conn->caps, &packet);
+}
+
+/*
+ * @param receiver rdp connection
+ * @param buffer header output
+ * @return int header length of an ACK reporting segments held
+ */
+int rdp_ack(const struct rdp_conn *receiver, char *buffer)
+{
+    struct rdp_packet packet;
+
+    packet.type = RDP_ACK;
+    packet.number = receiver->number;
+    packet.info = receiver->window;
+    packet.caps = 0;
+    packet.sacks = receiver->reasm ? rdp_reasm_sack(receiver->reasm,
+        packet.sack, RDP_SACK_BLOCKS) : 0;
+    packet.tsval = rdp_clock();
+    packet.tsecr = receiver->tsecr;
+
+    return rdp_format(buffer, RDP_BUF_SIZE, receiver->caps, &packet);
+}
+
+/*
+ * @param conn rdp connection
+ * @return unsigned int largest payload of a data packet
+ */
+unsigned int rdp_payload(const struct rdp_conn *conn)
+{
+    return conn->pmtu.size - rdp_overhead(conn->caps);
+}
+
+/*
+ * @param conf connection settings, filled with the defaults
+ */
+void rdp_conf_init(struct rdp_conf *conf)
+{
+    conf->mss = RDP_BUF_SIZE;
+    conf->probe = 0;
+    conf->id = 0;
+    conf->stripes = 0;
+    conf->offset = 0;
+    conf->size = 0;
+    conf->resume = 0;
+    conf->resumed = 0;
+    conf->zerocopy = 0;
+    conf->offload = 0;
+    conf->uring = 0;
+    conf->ackfreq = 0;
+    conf->fec = 0;
+    conf->compress = 0;
+    conf->parity = 0;
+    conf->rate = 0;
+    conf->pace = 0;
+    conf->txtime = 0;
+    conf->export = NULL;
+}
+
+/*
+ * @param conf connection settings, NULL for the defaults
+ * @return unsigned int largest datagram this end takes
+ */
+unsigned int rdp_conf_mss(const struct rdp_conf *conf)
+{
+    unsigned int mss = conf ? conf->mss : RDP_BUF_SIZE;
+
+    mss = mss > RDP_BUF_SIZE ? mss : RDP_BUF_SIZE;
+    return mss < RDP_DGRAM_MAX ? mss : RDP_DGRAM_MAX;
+}
+
+/*
+ * @param conf connection settings of the receiver, NULL for the defaults
+ * @param asked segments per ACK the sender asked for in its SYN, 0: none
+ * @return unsigned int segments in order per ACK the receiver takes
+ */
+unsigned int rdp_conf_ackfreq(const struct rdp_conf *conf, unsigned int asked)
+{
+    unsigned int ackfreq = asked ? asked : conf && conf->ackfreq ?
+        conf->ackfreq : RDP_ACK_EVERY;
+
+    return ackfreq < RDP_ACK_MAX ? ackfreq : RDP_ACK_MAX;
+}
+
+/*
+ * @param sender rdp connection
+ * @param burst datagram batch to queue on
+ * @param data payload
+ * @param seq sequence number of the payload
+ * @param pay payload length
+ * @param event log event
+ */
+void rdp_queue(struct rdp_conn *sender, struct rdp_batch *burst,
+    const char *data, unsigned long long seq, unsigned int pay, char event)
+{
+    char *buffer = burst->zc ? rdp_zc_next(burst->zc) :
+        rdp_batch_next(burst);
+    struct rdp_packet packet;
+    int fill_len;
+
+    packet.type = RDP_DAT;
+    packet.number = seq;
+    packet.info = pay;
+    packet.caps = 0;
+    packet.sacks = 0;
+    packet.tsval = rdp_clock();
+    packet.tsecr = sender->tsecr;
+    memset(&packet.tag, 0, sizeof(packet.tag));
+
+    // new data joins the open FEC block, probes and resent data do not.
+    if (sender->fec && event == RDP_SEND && pay <= rdp_payload(sender)) {
+        RDP_PROF(&sender->stats.prof, RDP_STAGE_FEC,
+            rdp_fec_add(sender->fec, &packet, data));
+    }
+
+    RDP_PROF(&sender->stats.prof, RDP_STAGE_HEADER,
+        fill_len = rdp_format(buffer, RDP_BUF_SIZE, sender->caps, &packet));
+
+    // the payload goes out from where it is, not copied behind the header.
+    rdp_batch_attach(burst, buffer, fill_len, data, pay);
+
+    RDP_PROF(&sender->stats.prof, RDP_STAGE_LOG,
+        rdp_log(event, &sender->self.addr, &sender->peer.addr, RDP_DAT, seq,
+        pay));
+}
+
+/*
+ * @param sender rdp connection, its open FEC block sealed
+ * @param burst datagram batch the parity segments are queued on, room for
+ * RDP_FEC_PARITY more
+ */
+static void rdp_queue_parity(struct rdp_conn *sender, struct rdp_batch *burst)
+{
+    struct rdp_packet packet;
+    const char *sum;
+    char *buffer;
+    unsigned int j;
+    unsigned int count;
+    int fill_len;
+
+    RDP_PROF(&sender->stats.prof, RDP_STAGE_FEC,
+        count = rdp_fec_seal(sender->fec));
+
+    // the next block follows the loss seen so far.
+    rdp_fec_adapt(sender->fec, sender->stats.tpkts - sender->stats.upkts,
+        sender->stats.upkts);
+
+    // a sum is reused by the next block, so it is copied behind the header.
+    for (j = 0; j < count; j++) {
+        buffer = rdp_batch_next(burst);
+        RDP_PROF(&sender->stats.prof, RDP_STAGE_FEC,
+            sum = rdp_fec_parity(sender->fec, j, &packet));
+        packet.tsval = rdp_clock();
+        packet.tsecr = sender->tsecr;
+        RDP_PROF(&sender->stats.prof, RDP_STAGE_HEADER,
+            fill_len = rdp_format(buffer, RDP_BUF_SIZE, sender->caps,
+            &packet));
+        RDP_PROF(&sender->stats.prof, RDP_STAGE_COPY,
+            memcpy(buffer + fill_len, sum, packet.info));
+        rdp_batch_attach(burst, buffer, fill_len, buffer + fill_len,
+            packet.info);
+
+        sender->stats.fecs++;
+        RDP_PROF(&sender->stats.prof, RDP_STAGE_LOG,
+            rdp_log(RDP_SEND, &sender->self.addr, &sender->peer.addr,
+            RDP_FEC, packet.number, packet.info));
+    }
+}
+
+/*
+ * @param sock socket handler
+ * @param wait microseconds to wait for a packet
+ * @return int select result, 1: packet pending, 0: timeout, -1: failed
+ */
+int rdp_wait(int sock, unsigned long long wait)
+{
+    struct timeval timeout;
+    fd_set readers;
+
+    FD_ZERO(&readers);
+    FD_SET(sock, &readers);
+
+    timeout.tv_sec = wait / RDP_USEC;
+    timeout.tv_usec = wait % RDP_USEC;
+
+    return select(sock + 1, &readers, NULL, NULL, &timeout);
+}
+
+/*
+ * @param conn rdp connection
+ * @param packet packet received
+ * @param now current time
+ * @return unsigned int round trip time from the timestamp echo, 0 for none
+ */
+unsigned int rdp_echo(struct rdp_conn *conn, const struct rdp_packet *packet,
+    unsigned long long now)
+{
+    unsigned int rtt;
+
+    if (!packet->tsecr) {
+        return 0;
+    }
+
+    rtt = (unsigned int) now - packet->tsecr;
+    rtt = rtt ? rtt : 1;
+    rdp_rtt_sample(&conn->rtt, rtt);
+    return rtt;
+}
+
+/*
+ * @param stats connection statistics
+ * @param time milliseconds since the transfer began
+ * @param cwnd congestion window
+ */
+void rdp_trace(struct rdp_stats *stats, unsigned int time, unsigned int cwnd)
+{
+    unsigned int i;
+
+    if (stats->cwnds && stats->cwnd[stats->cwnds - 1].cwnd == cwnd) {
+        return;
+    }
+
+    stats->stride = stats->stride ? stats->stride : 1;
+
+    // a full trajectory keeps every other sample and samples less often.
+    if (stats->cwnds == RDP_CWND_SAMPLES) {
+        for (i = 0; i < RDP_CWND_SAMPLES / 2; i++) {
+            stats->cwnd[i] = stats->cwnd[i * 2];
+        }
+
+        stats->cwnds = RDP_CWND_SAMPLES / 2;
+        stats->stride *= 2;
+    }
+
+    if (stats->changes++ % stats->stride == 0) {
+        stats->cwnd[stats->cwnds].time = time;
+        stats->cwnd[stats->cwnds].cwnd = cwnd;
+        stats->cwnds++;
+    }
+}
+
+/*
+ * @param conn rdp connection
+ * @param sender is a sender or not
+ * @param path statistics file, JSON for a .json name, else Prometheus text
+ * @return int 0: written, -1: failed
+ */
+int rdp_stats_export(const struct rdp_conn *conn, int sender,
+    const char *path)
+{
+    return rdp_export(&conn->stats, sender ? "sender" : "receiver", path);
+}
+
+/*
+ * The receiver's delivered bytes go to the throughput series here, once
+ * per batch; the sender adds acknowledged bytes as the ACKs come.
+ *
+ * @param conn rdp connection, its statistics file rewritten when due
+ * @param sender is a sender or not
+ * @param now current time
+ */
+static void rdp_stats_tick(struct rdp_conn *conn, int sender,
+    unsigned long long now)
+{
+    struct rdp_stats *stats = &conn->stats;
+
+    if (!sender && stats->ubytes != stats->series.total) {
+        rdp_series_add(&stats->series, now - stats->begin,
+            stats->ubytes - stats->series.total);
+    }
+
+    if (!conn->export || now < conn->exported) {
+        return;
+    }
+
+    // a file that cannot be written is given up on, not retried each time.
+    if (rdp_stats_export(conn, sender, conn->export) < 0) {
+        conn->export = NULL;
+    }
+
+    conn->exported = now + RDP_EXPORT_EVERY;
+}
+
+/*
+ * @param conn rdp connection
+ * @param name congestion control algorithm
+ * @return int 0: ok, -1: unknown algorithm
+ */
+int rdp_set_cc(struct rdp_conn *conn, const char *name)
+{
+    const struct rdp_cc_ops *cc = rdp_cc_find(name);
+
+    if (!cc) {
+        fprintf(stderr, "unknown congestion control %s\n", name);
+        return -1;
     }
+
+    conn->cc = cc;
+    return 0;
 }
 
 /*
@@ -123,7 +445,7 @@ void rdp_reset(int sock, struct rdp_conn *sender)
 {
     char buffer[RDP_BUF_SIZE];
 
-    int fill_len = snprintf(buffer, RDP_BUF_SIZE, RDP_RST_HDR);
+    int fill_len = rdp_header(sender, buffer, RDP_RST, 0, 0);
     sendto(sock, buffer, fill_len, 0, (struct sockaddr *)
         &sender->peer.addr, sender->peer.length);
 
@@ -132,18 +454,42 @@ void rdp_reset(int sock, struct rdp_conn *sender)
         RDP_RST, 0, 0);
 }
 
+/*
+ * @param receiver rdp connection
+ * @param buffer packet output
+ * @return int length of the ACK of the SYN, with the capabilities taken
+ */
+static int rdp_syn_ack(const struct rdp_conn *receiver, char *buffer)
+{
+    struct rdp_packet packet;
+
+    memset(&packet, 0, sizeof(packet));
+    packet.type = RDP_ACK;
+    packet.number = receiver->number;
+    packet.info = receiver->window;
+    packet.caps = receiver->caps;
+    packet.mss = receiver->pmtu.ceiling;
+    packet.conn = receiver->id;
+    packet.offset = receiver->resumed;
+
+    return rdp_format(buffer, RDP_BUF_SIZE, 0, &packet);
+}
+
 /*
  * @param sock socket handler
  * @param receiver rdp connection
+ * @param conf connection settings, NULL for the defaults
  * @return 0: packet received, -1: no packet received
  */
-int rdp_accept(int sock, struct rdp_conn *receiver)
+int rdp_accept(int sock, struct rdp_conn *receiver,
+    const struct rdp_conf *conf)
 {
     char buffer[RDP_BUF_SIZE];
     struct rdp_packet packet;
     int fill_len, result;
 
     memset(receiver, 0, sizeof(*receiver));
+    rdp_rtt_init(&receiver->rtt);
     receiver->self.length = sizeof(receiver->self.addr);
     receiver->peer.length = sizeof(receiver->peer.addr);
     result = getsockname(sock, (struct sockaddr *) &receiver->self.addr,
@@ -173,13 +519,80 @@ int rdp_accept(int sock, struct rdp_conn *receiver)
         return -1;
     }
 
+    // only a server writes ranges of one file from several flows.
+    if (packet.stripes > 1) {
+        fprintf(stderr, "striped transfer needs a server\n");
+        rdp_reset(sock, receiver);
+        return -1;
+    }
+
+    // the throughput series starts with the transfer, not the wait for it.
+    receiver->stats.begin = rdp_clock();
+
     // update state
+    receiver->id = packet.conn;
+    receiver->size = packet.size;
+    receiver->ackfreq = rdp_conf_ackfreq(conf, packet.ackfreq);
+
+    // a checkpoint of the same file lets the sender skip what it holds.
+    receiver->token = packet.resume;
+    receiver->resumed = conf && conf->resume && conf->resume == packet.resume
+        && conf->resumed <= packet.size ? conf->resumed : 0;
     receiver->number = packet.number + 1;
-    receiver->window = RDP_BUF_SIZE;
+    receiver->caps = packet.caps & (RDP_CAPS | RDP_CAP_FEC | RDP_CAP_LZ);
+
+    // every other capability is carried by the binary header.
+    if (!(receiver->caps & RDP_CAP_BIN)) {
+        receiver->caps = 0;
+    }
 
-    // ACK packet.
-    fill_len = snprintf(buffer, RDP_BUF_SIZE, RDP_ACK_HDR,
-        receiver->number, receiver->window);
+    // coalesced datagrams are split on fixed binary headers only.
+    receiver->gro = conf && conf->offload && (receiver->caps & RDP_CAP_BIN) &&
+        rdp_offload(sock, 1);
+
+    // a peer naming no size sends what fits RDP_BUF_SIZE.
+    packet.mss = packet.mss > RDP_BUF_SIZE ? packet.mss : RDP_BUF_SIZE;
+    packet.mss = packet.mss < rdp_conf_mss(conf) ? packet.mss :
+        rdp_conf_mss(conf);
+    rdp_pmtu_init(&receiver->pmtu, packet.mss, packet.mss);
+    receiver->window = packet.mss;
+
+    // parity is only asked for by a sender that sends it.
+    if (receiver->caps & RDP_CAP_FEC) {
+        receiver->fec = rdp_fec_new(RDP_FEC_SLOTS, packet.mss, 0, 0);
+
+        if (!receiver->fec) {
+            receiver->caps &= ~RDP_CAP_FEC;
+        }
+    }
+
+    // compressed blocks are decoded before they are delivered.
+    if (receiver->caps & RDP_CAP_LZ) {
+        receiver->unlz = rdp_unlz_new();
+
+        if (!receiver->unlz) {
+            receiver->caps &= ~RDP_CAP_LZ;
+        }
+    }
+
+    // batches are kept until the connection ends, not set up per call.
+    receiver->inbox = malloc(sizeof(*receiver->inbox));
+    receiver->acks = malloc(sizeof(*receiver->acks));
+    receiver->packets = malloc(RDP_BATCH_SEGS * sizeof(*receiver->packets));
+    receiver->placed = malloc(RDP_BATCH_SEGS);
+
+    if (!receiver->inbox || !receiver->acks || !receiver->packets ||
+        !receiver->placed) {
+        perror("malloc");
+        rdp_end(receiver);
+        return -1;
+    }
+
+    rdp_batch_init(receiver->inbox, NULL);
+    rdp_batch_init(receiver->acks, &receiver->peer);
+
+    // ACK packet, confirming the capabilities both ends support.
+    fill_len = rdp_syn_ack(receiver, buffer);
     result = sendto(sock, buffer, fill_len, 0, (struct sockaddr *)
         &receiver->peer.addr, receiver->peer.length);
 
@@ -187,6 +600,13 @@ int rdp_accept(int sock, struct rdp_conn *receiver)
 
     rdp_log(RDP_SEND, &receiver->self.addr, &receiver->peer.addr,
         RDP_ACK, receiver->number, receiver->window);
+
+    receiver->export = conf ? conf->export : NULL;
+
+    // the ring receives from here on, until the connection ends.
+    receiver->uring = conf ? conf->uring : 0;
+    receiver->ring = receiver->uring ? rdp_ring_new(sock, receiver->gro) :
+        NULL;
     return 0;
 }
 
@@ -200,30 +620,25 @@ int rdp_close(int sock, struct rdp_conn *sender)
 {
     char buffer[RDP_BUF_SIZE];
     struct rdp_packet packet;
-    struct timeval timeout;
     int trys, fill_len, result;
-    fd_set readers;
+    unsigned long long now, deadline;
 
     for (trys = 0; trys < RDP_RETRANS; trys++) {
-        fill_len = snprintf(buffer, RDP_BUF_SIZE, RDP_FIN_HDR,
-            sender->number);
+        fill_len = rdp_header(sender, buffer, RDP_FIN, sender->number, 0);
         result = sendto(sock, buffer, fill_len, 0, (struct sockaddr *)
             &sender->peer.addr, sender->peer.length);
 
         sender->stats.fin++;
         rdp_log(trys ? RDP_RESEND : RDP_SEND, &sender->self.addr,
-            &sender->self.addr, RDP_FIN, sender->number, 0);
-
-        do {
-            FD_ZERO(&readers);
-            FD_SET(sock, &readers);
+            &sender->peer.addr, RDP_FIN, sender->number, 0);
 
-            // timeout 
-            timeout.tv_sec = 0;
-            timeout.tv_usec = RDP_RE_TIME;
+        // timeout 
+        now = rdp_clock();
+        deadline = now + rdp_rtt_rto(&sender->rtt);
 
+        do {
             // select with timeout.
-            result = select(sock + 1, &readers, NULL, NULL, &timeout);
+            result = rdp_wait(sock, deadline > now ? deadline - now : 0);
 
             if (result > 0) {
                 result = recvfrom(sock, buffer, RDP_BUF_SIZE, 0,
@@ -241,6 +656,7 @@ int rdp_close(int sock, struct rdp_conn *sender)
 
                     // FIN acknowledgement.
                     if (packet.number == sender->number + 1) {
+                        rdp_echo(sender, &packet, rdp_clock());
                         rdp_end(sender);
                         return 0;
                     }
@@ -252,7 +668,11 @@ int rdp_close(int sock, struct rdp_conn *sender)
                     rdp_reset(sock, sender);
                 }
             }
+
+            now = rdp_clock();
         } while (result);
+
+        rdp_rtt_backoff(&sender->rtt);
     }
 
     rdp_end(sender);
@@ -264,18 +684,23 @@ int rdp_close(int sock, struct rdp_conn *sender)
  *  @param sock socket handler
  *  @param addr client address
  *  @param sender rdp connection
+ *  @param conf connection settings, NULL for the defaults
  *  @return 0: ok, -1: failed
  */
 int rdp_connect(int sock, struct sockaddr_in *addr, struct rdp_conn
-    *sender)
+    *sender, const struct rdp_conf *conf)
 {
     char buffer[RDP_BUF_SIZE];
     struct rdp_packet packet;
-    struct timeval timeout;
+    unsigned long long sent;
+    unsigned int mss = rdp_conf_mss(conf);
+    unsigned int caps = RDP_CAPS | (conf && conf->fec ? RDP_CAP_FEC : 0) |
+        (conf && conf->compress ? RDP_CAP_LZ : 0);
     int fill_len, trys, result;
-    fd_set readers;
+    int discover = IP_PMTUDISC_PROBE;
 
     memset(sender, 0, sizeof(*sender));
+    rdp_rtt_init(&sender->rtt);
     sender->peer.addr = *addr;
     sender->self.length = sizeof(sender->self.addr);
     sender->peer.length = sizeof(*addr);
@@ -283,26 +708,52 @@ int rdp_connect(int sock, struct sockaddr_in *addr, struct rdp_conn
         &sender->self.length);
 
     rdp_begin(sender);
-    fill_len = snprintf(buffer, RDP_BUF_SIZE, RDP_SYN_HDR, sender->number);
+
+    // a server tells a new connection from an old one on the same port,
+    // the flows of a striped transfer share theirs.
+    sender->id = conf && conf->id ? conf->id :
+        (rdp_clock() * 2654435761u) ^ getpid();
+    sender->id = sender->id ? sender->id : 1;
+
+    // offer every capability, a text-only peer ignores the field.
+    packet.type = RDP_SYN;
+    packet.number = sender->number;
+    packet.info = 0;
+    packet.caps = caps;
+    packet.mss = mss;
+    packet.conn = sender->id;
+    packet.stripes = conf ? conf->stripes : 0;
+    packet.offset = conf ? conf->offset : 0;
+    packet.size = conf ? conf->size : 0;
+    packet.resume = conf ? conf->resume : 0;
+    packet.ackfreq = conf ? conf->ackfreq : 0;
+    sender->zerocopy = conf ? conf->zerocopy : 0;
+    sender->gso = conf && conf->offload && rdp_offload(sock, 0);
+    sender->uring = conf ? conf->uring : 0;
+    sender->rate = conf ? conf->rate : 0;
+    sender->pace = conf ? conf->pace : 0;
+    sender->txtime = conf ? conf->txtime : 0;
+    sender->export = conf ? conf->export : NULL;
+    fill_len = rdp_format(buffer, RDP_BUF_SIZE, 0, &packet);
+
+    // probes must not be fragmented, a size the path refuses is lost.
+    if (conf && conf->probe && setsockopt(sock, IPPROTO_IP, IP_MTU_DISCOVER,
+        &discover, sizeof(discover)) < 0) {
+        perror("setsockopt");
+    }
 
     // retransmit until a response is received. 
     for (trys = 0; trys < RDP_RETRANS; trys++) {
-        FD_ZERO(&readers);
-        FD_SET(sock, &readers);
-
-        // timeout
-        timeout.tv_sec = RDP_RE_TIME * (1 << trys) / 1000000;
-        timeout.tv_usec = RDP_RE_TIME * (1 << trys) % 1000000;
-
         result = sendto(sock, buffer, fill_len, 0, (struct sockaddr *)
             &sender->peer.addr, sender->peer.length);
+        sent = rdp_clock();
         
         sender->stats.syn++;
         rdp_log(trys ? RDP_RESEND : RDP_SEND, &sender->self.addr,
             &sender->peer.addr, RDP_SYN, sender->number, 0);
 
         // select with timeout.
-        result = select(sock + 1, &readers, NULL, NULL, &timeout);
+        result = rdp_wait(sock, rdp_rtt_rto(&sender->rtt));
 
         if (result < 0) {
             perror("select");
@@ -310,6 +761,8 @@ int rdp_connect(int sock, struct sockaddr_in *addr, struct rdp_conn
         } else if (result > 0) {
             break;
         }
+
+        rdp_rtt_backoff(&sender->rtt);
     }
 
     if (trys >= RDP_RETRANS) {
@@ -335,8 +788,38 @@ int rdp_connect(int sock, struct sockaddr_in *addr, struct rdp_conn
         sender->stats.ack++;
 
         if (packet.number == sender->number + 1) {
+            // only an answer to the first SYN is a fair sample.
+            if (!trys) {
+                rdp_rtt_sample(&sender->rtt, rdp_clock() - sent);
+            } else {
+                rdp_rtt_init(&sender->rtt);
+            }
+
             sender->number++;
             sender->window = packet.info;
+            sender->caps = packet.caps & caps;
+
+            // only a receiver asked to resume names bytes it holds.
+            sender->resumed = conf && conf->resume &&
+                packet.offset <= conf->size ? packet.offset : 0;
+
+            if (!(sender->caps & RDP_CAP_BIN)) {
+                sender->caps = 0;
+            }
+
+            // a receiver that confirms FEC rebuilds from parity, the
+            // header has room for the tag either way.
+            if (sender->caps & RDP_CAP_FEC) {
+                sender->fec = rdp_fec_new(1, mss, conf->fec, conf->parity);
+            }
+
+            // the peer answers with the size both ends take.
+            if (packet.mss < mss) {
+                mss = packet.mss > RDP_BUF_SIZE ? packet.mss : RDP_BUF_SIZE;
+            }
+
+            rdp_pmtu_init(&sender->pmtu, conf && conf->probe ?
+                RDP_BUF_SIZE : mss, mss);
             return 0;
         }
     default:
@@ -349,229 +832,1391 @@ int rdp_connect(int sock, struct sockaddr_in *addr, struct rdp_conn
 }
 
 /*
- * @param sock socket handler
- * @param rdp_conn rdp connection
- * @param data received data
- * @param length length of received data
- * @return int state of connection, 1: open, 0: closed, -1: reset
+ * @param receiver rdp connection
+ * @param acks batch the ACK is queued to
+ * @param event RDP_SEND or RDP_RESEND, for the log
  */
-int rdp_receive(int sock, struct rdp_conn *receiver, void *data,
-    size_t length, size_t *read)
+static void rdp_ack_queue(struct rdp_conn *receiver, struct rdp_batch *acks,
+    char event)
 {
-    char buffer[RDP_BUF_SIZE];
-    char eventr, events;
-    struct rdp_packet packet;
-    int fill_len, result;
-    *read = 0;
-
-    receiver->window = length;
-
-    // Receive data buffer can accomodate.
-    while (length - *read > RDP_MAX_PAY) {
-        result = recvfrom(sock, buffer, RDP_BUF_SIZE, 0, NULL, NULL);
-
-        rdp_interp(buffer, result, &packet);
-
-        // packet is a duplicate?
-        if (packet.number < receiver->number) {
-            eventr = RDP_DUPLICATE;
-            events = RDP_RESEND;
-        } else {
-            eventr = RDP_RECEIVE;
-            events = RDP_SEND;
-        }
+    unsigned long long held = 0;
+    int fill_len;
 
-        rdp_log(eventr, &receiver->peer.addr, &receiver->self.addr,
-            packet.type, packet.number, packet.info);
-
-        // handle received packet.
-        switch (packet.type) {
-        case RDP_FIN:
-            receiver->stats.fin++;
-            fill_len = snprintf(buffer, RDP_BUF_SIZE, RDP_ACK_HDR,
-                receiver->number + 1, receiver->window);
-            result = sendto(sock, buffer, fill_len, 0, (struct sockaddr *)
-                &receiver->peer.addr, receiver->peer.length);
+    RDP_PROF(&receiver->stats.prof, RDP_STAGE_HEADER,
+        fill_len = rdp_ack(receiver, rdp_batch_next(acks)));
 
+    // an ACK held back waited since the segment that started the delay.
+    if (receiver->delack) {
+        held = rdp_clock() + RDP_ACK_DELAY - receiver->delack;
+    }
 
-            rdp_end(receiver);
-            receiver->stats.ack++;
-            rdp_log(events, &receiver->self.addr, &receiver->peer.addr,
-                RDP_ACK, receiver->number + 1, receiver->window);
-            return 0;
-        case RDP_DAT:
-            // check DAT packet
-            if (packet.number == receiver->number) {
-                fill_len = packet.info < RDP_BUF_SIZE ?
-                    packet.info : RDP_BUF_SIZE;
-                memcpy(data + *read, packet.data, fill_len);
-                *read += fill_len;
-                receiver->number += fill_len;
-                receiver->window -= fill_len;
-                receiver->stats.ubytes += packet.info;
-                receiver->stats.upkts++;
-            }
+    rdp_hist_add(&receiver->stats.ackdelay, held);
+    rdp_batch_push(acks, fill_len);
+    receiver->unacked = 0;
+    receiver->delack = 0;
 
-            receiver->stats.tbytes += packet.info;
-            receiver->stats.tpkts++;
-            break;
-        case RDP_SYN:
-            receiver->stats.syn++;
-            break;
-        case RDP_RST:
-            receiver->stats.rtr++;
-            eventr = RDP_RECEIVE;
-            rdp_end(receiver);
-            return -1;
-        }
+    receiver->stats.ack++;
+    RDP_PROF(&receiver->stats.prof, RDP_STAGE_LOG,
+        rdp_log(event, &receiver->self.addr, &receiver->peer.addr, RDP_ACK,
+        receiver->number, receiver->window));
+}
 
-        // Acknowledge packet.
-        fill_len = snprintf(buffer, RDP_BUF_SIZE, RDP_ACK_HDR,
-            receiver->number, receiver->window);
-        result = sendto(sock, buffer, fill_len, 0, (struct sockaddr *)
-            &receiver->peer.addr, receiver->peer.length);
+/*
+ * A segment in order is acknowledged along with the ackfreq-th one, or
+ * once RDP_ACK_DELAY passed. Anything out of order, a gap held or just
+ * filled, and a window too small for another ackfreq segments are
+ * acknowledged at once, as fast retransmit and the sender's window need.
+ *
+ * @param receiver rdp connection
+ * @param packet packet handled
+ * @param expected next sequence number before the packet was handled
+ * @param held segments were held out of order before it
+ * @return int 1: acknowledge now, 0: the ACK is held back
+ */
+static int rdp_ack_due(struct rdp_conn *receiver,
+    const struct rdp_packet *packet, unsigned long long expected, int held)
+{
+    if (packet->type != RDP_DAT || packet->number != expected || held ||
+        (receiver->reasm && receiver->reasm->count) ||
+        receiver->window < receiver->ackfreq * rdp_payload(receiver) ||
+        ++receiver->unacked >= receiver->ackfreq) {
+        return 1;
+    }
 
-        receiver->stats.ack++;
-        rdp_log(events, &receiver->self.addr, &receiver->peer.addr,
-            RDP_ACK, receiver->number, receiver->window);
+    if (!receiver->delack) {
+        receiver->delack = rdp_clock() + RDP_ACK_DELAY;
     }
 
-    return 1;
+    receiver->stats.acksup++;
+    return 0;
 }
 
 /*
  * @param sock socket handler
- * @param sender rdp connection
- * @param data data to send
- * @param length send data length
- * @return int state of connection, 1: open, 0: closed, -1: reset
+ * @param receiver rdp connection, the ACK held back sent if no data came
+ * before it was due
+ * @param acks batch the ACK goes out in
  */
-int rdp_send(int sock, struct rdp_conn *sender, const void *data,
-    size_t length)
+static void rdp_ack_delayed(int sock, struct rdp_conn *receiver,
+    struct rdp_batch *acks)
 {
-    char buffer[RDP_BUF_SIZE];
-    char event;
-
-    struct rdp_packet packet;
+    unsigned long long now = rdp_clock();
+    unsigned long long wait;
+    int result;
 
-    struct timeval timeout;
+    if (!receiver->delack) {
+        return;
+    }
 
-    size_t sent = 0;
-    int fill_len, i, result;
+    wait = receiver->delack > now ? receiver->delack - now : 0;
 
-    unsigned int rmd, pay, seq;
-    unsigned int trys = 0;
-    unsigned int pre = sender->number - 1;
-    unsigned int wnd = length;
-    unsigned int start = sender->number;
-    unsigned int received;
+    RDP_PROF(&receiver->stats.prof, RDP_STAGE_WAIT,
+        result = receiver->ring ? rdp_ring_wait(receiver->ring, wait) :
+        rdp_wait(sock, wait));
 
-    fd_set readers;
+    if (!result) {
+        rdp_ack_queue(receiver, acks, RDP_SEND);
+        RDP_PROF(&receiver->stats.prof, RDP_STAGE_SEND,
+            rdp_batch_flush(sock, acks, &receiver->stats));
+    }
+}
 
-    // send packets with error resend
-    while (wnd) {
-        // receiver's window
-        rmd = sender->window < wnd ? sender->window : wnd;
-        seq = sender->number;
-
-        for (i = 0; i < RDP_BURST && rmd; i++) {
-            pay = rmd < RDP_MAX_PAY ? rmd : RDP_MAX_PAY;
-
-            rmd -= pay;
-
-            // Send data.
-            fill_len = snprintf(buffer, RDP_BUF_SIZE, RDP_DAT_HDR,
-                seq, pay);
-            memcpy(buffer + fill_len, data + seq - start, pay);
-            result = sendto(sock, buffer, fill_len + pay, 0,
-                (struct sockaddr *) &sender->peer.addr,
-                sender->peer.length);
-
-            // sent already?
-            if (seq > pre) {
-                pre = seq;
-                event = RDP_SEND;
-                sender->stats.tbytes += pay;
-                sender->stats.ubytes += pay;
-                sender->stats.upkts++;
-                sender->stats.tpkts++;
+/*
+ * @param receiver rdp connection
+ * @param packet data packet, its payload trimmed to what is new
+ * @param fill_len payload bytes received
+ * @param data receive buffer
+ * @param length receive buffer size
+ * @param read bytes in order at the start of data
+ * @return int 1: new data taken, 0: duplicate or past the window
+ */
+static int rdp_receive_data(struct rdp_conn *receiver,
+    struct rdp_packet *packet, int fill_len, char *data, size_t length,
+    size_t *read)
+{
+    int inserted = 0;
+
+    // a segment resent in other pieces may start in data delivered
+    // already, only its tail is new.
+    if (packet->number < receiver->number &&
+        packet->number + fill_len > receiver->number) {
+        packet->data += receiver->number - packet->number;
+        fill_len -= receiver->number - packet->number;
+        packet->number = receiver->number;
+    }
+
+    if (packet->number == receiver->number && fill_len <= receiver->window) {
+        RDP_PROF(&receiver->stats.prof, RDP_STAGE_COPY,
+            memcpy(data + *read, packet->data, fill_len));
+        *read += fill_len;
+        receiver->number += fill_len;
+        receiver->stats.ubytes += fill_len;
+        receiver->stats.upkts++;
+
+        // segments held may be contiguous now.
+        if (receiver->reasm) {
+            RDP_PROF(&receiver->stats.prof, RDP_STAGE_COPY,
+                fill_len = rdp_reasm_deliver(receiver->reasm,
+                receiver->number, data + *read, length - *read));
+            *read += fill_len;
+            receiver->number += fill_len;
+        }
+
+        receiver->window = length - *read;
+        return 1;
+    } else if (packet->number > receiver->number &&
+        packet->number - receiver->number + fill_len <= receiver->window) {
+        // hold segment until the gap before it fills.
+        if (!receiver->reasm) {
+            receiver->reasm = rdp_reasm_new(RDP_REASM_SIZE);
+        }
+
+        if (receiver->reasm) {
+            RDP_PROF(&receiver->stats.prof, RDP_STAGE_COPY,
+                inserted = rdp_reasm_insert(receiver->reasm, packet->number,
+                packet->data, fill_len));
+        }
+
+        if (inserted > 0) {
+            receiver->stats.ubytes += fill_len;
+            receiver->stats.upkts++;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * @param sock socket handler
+ * @param rdp_conn rdp connection
+ * @param data received data
+ * @param length length of received data
+ * @return int state of connection, 1: open, 0: closed, -1: reset, -2:
+ * another connection asked for
+ */
+static int rdp_receive_raw(int sock, struct rdp_conn *receiver, void *data,
+    size_t length, size_t *read)
+{
+    struct rdp_batch *inbox = receiver->inbox;
+    struct rdp_batch *acks = receiver->acks;
+    char *buffer;
+    char eventr, events;
+    struct rdp_packet packet;
+    int fill_len, i, result;
+    unsigned int closed = receiver->window < rdp_payload(receiver);
+    unsigned long long expected;
+    struct rdp_packet lost;
+    int held, rebuilt;
+    *read = 0;
+
+    inbox->gro = receiver->gro;
+    inbox->ring = receiver->ring;
+    acks->ring = receiver->ring;
+
+    // the window never outgrows the reassembly buffer.
+    length = length < RDP_REASM_SIZE ? length : RDP_REASM_SIZE;
+
+    // segments the previous call had no room for come first.
+    if (receiver->reasm) {
+        *read = rdp_reasm_deliver(receiver->reasm, receiver->number, data,
+            length);
+        receiver->number += *read;
+    }
+
+    receiver->window = length - *read;
+
+    // a window closed by the previous call is reopened at once.
+    if (closed || *read) {
+        rdp_ack_queue(receiver, acks, RDP_SEND);
+        rdp_batch_flush(sock, acks, &receiver->stats);
+    }
+
+    // Receive data buffer can accomodate.
+    while (length - *read > rdp_payload(receiver)) {
+        rdp_ack_delayed(sock, receiver, acks);
+        RDP_PROF(&receiver->stats.prof, RDP_STAGE_RECV,
+            result = rdp_batch_recv(sock, inbox, MSG_WAITFORONE,
+            &receiver->stats));
+
+        for (i = 0; i < result; i++) {
+            buffer = inbox->datagrams[i];
+            RDP_PROF(&receiver->stats.prof, RDP_STAGE_PARSE,
+                rdp_interp(buffer, inbox->lengths[i], &packet));
+
+            // a GRO batch holds more datagrams than ACKs fit in one.
+            if (!rdp_batch_next(acks)) {
+                rdp_batch_flush(sock, acks, &receiver->stats);
+            }
+
+            // the next ACK echoes the oldest timestamp it covers.
+            if (packet.tsval && !receiver->unacked) {
+                receiver->tsecr = packet.tsval;
+            }
+
+            // packet is a duplicate?
+            if (packet.number < receiver->number) {
+                eventr = RDP_DUPLICATE;
+                events = RDP_RESEND;
             } else {
-                event = RDP_RESEND;
-                sender->stats.tbytes += pay;
-                sender->stats.tpkts++;
+                eventr = RDP_RECEIVE;
+                events = RDP_SEND;
             }
 
-            rdp_log(event, &sender->self.addr, &sender->peer.addr,
-                RDP_DAT, seq, pay);
-            seq += pay;
+            RDP_PROF(&receiver->stats.prof, RDP_STAGE_LOG,
+                rdp_log(eventr, &receiver->peer.addr, &receiver->self.addr,
+                packet.type, packet.number, packet.info));
+
+            expected = receiver->number;
+            held = receiver->reasm && receiver->reasm->count;
+
+            // handle received packet.
+            switch (packet.type) {
+            case RDP_FIN:
+                receiver->stats.fin++;
+                fill_len = rdp_header(receiver, rdp_batch_next(acks),
+                    RDP_ACK, receiver->number + 1, receiver->window);
+                rdp_batch_push(acks, fill_len);
+                rdp_batch_flush(sock, acks, &receiver->stats);
+
+                rdp_reasm_free(receiver->reasm);
+                receiver->reasm = NULL;
+                rdp_end(receiver);
+                receiver->stats.ack++;
+                rdp_log(events, &receiver->self.addr, &receiver->peer.addr,
+                    RDP_ACK, receiver->number + 1, receiver->window);
+                return 0;
+            case RDP_DAT:
+                // check DAT packet, never past the datagram received.
+                fill_len = inbox->lengths[i] - (packet.data - buffer);
+                fill_len = packet.info < fill_len ? packet.info : fill_len;
+
+                // the segment may complete a stripe that lost another.
+                rebuilt = 0;
+
+                if (receiver->fec && packet.tag.block) {
+                    RDP_PROF(&receiver->stats.prof, RDP_STAGE_FEC,
+                        rebuilt = rdp_fec_decode(receiver->fec, &packet,
+                        fill_len, &lost));
+                }
+
+                rdp_receive_data(receiver, &packet, fill_len, data, length,
+                    read);
+
+                if (rebuilt && rdp_receive_data(receiver, &lost, lost.info,
+                    data, length, read)) {
+                    receiver->stats.rebuilt++;
+                }
+
+                receiver->stats.tbytes += packet.info;
+                receiver->stats.tpkts++;
+                break;
+            case RDP_FEC:
+                fill_len = inbox->lengths[i] - (packet.data - buffer);
+                receiver->stats.fecs++;
+
+                RDP_PROF(&receiver->stats.prof, RDP_STAGE_FEC,
+                    rebuilt = receiver->fec && rdp_fec_decode(receiver->fec,
+                    &packet, fill_len, &lost));
+
+                // parity that rebuilt nothing is not acknowledged.
+                if (!rebuilt || !rdp_receive_data(receiver, &lost, lost.info,
+                    data, length, read)) {
+                    continue;
+                }
+
+                receiver->stats.rebuilt++;
+                break;
+            case RDP_SYN:
+                receiver->stats.syn++;
+
+                // the sender started over, this connection is gone.
+                if (packet.conn != receiver->id) {
+                    rdp_batch_flush(sock, acks, &receiver->stats);
+                    rdp_reasm_free(receiver->reasm);
+                    receiver->reasm = NULL;
+                    rdp_end(receiver);
+                    return -2;
+                }
+
+                // the ACK of the SYN was lost, without the capabilities
+                // in it the sender would take none.
+                receiver->stats.ack++;
+                fill_len = rdp_syn_ack(receiver, rdp_batch_next(acks));
+                rdp_batch_push(acks, fill_len);
+                rdp_log(events, &receiver->self.addr, &receiver->peer.addr,
+                    RDP_ACK, receiver->number, receiver->window);
+                continue;
+            case RDP_RST:
+                receiver->stats.rtr++;
+                eventr = RDP_RECEIVE;
+                rdp_batch_flush(sock, acks, &receiver->stats);
+                rdp_reasm_free(receiver->reasm);
+                receiver->reasm = NULL;
+                rdp_end(receiver);
+                return -1;
+            }
+
+            // Acknowledge packet, the whole batch is sent at once.
+            if (rdp_ack_due(receiver, &packet, expected, held)) {
+                rdp_ack_queue(receiver, acks, events);
+            }
         }
 
-        received = 0;
+        RDP_PROF(&receiver->stats.prof, RDP_STAGE_SEND,
+            rdp_batch_flush(sock, acks, &receiver->stats));
+        rdp_stats_tick(receiver, 0, rdp_clock());
+    }
 
-        do {
-            FD_ZERO(&readers);
-            FD_SET(sock, &readers);
+    return 1;
+}
 
-            // timeout
-            timeout.tv_sec = 0;
-            timeout.tv_usec = RDP_WAIT_TIME;
+/*
+ * What arrives is a run of frames, each a block compressed on its own.
+ * Frames are received into a staging buffer as large as the window and
+ * decoded once whole, the part of a block data has no room for waits for
+ * the next call.
+ *
+ * @param sock socket handler
+ * @param receiver rdp connection, compression negotiated
+ * @param data received data
+ * @param length length of received data
+ * @param read bytes decoded into data
+ * @return int state of connection, 1: open, 0: closed, -1: reset or a
+ * malformed block, -2: another connection asked for
+ */
+static int rdp_receive_unlz(int sock, struct rdp_conn *receiver, char *data,
+    size_t length, size_t *read)
+{
+    struct rdp_unlz *unlz = receiver->unlz;
+    size_t count, used;
+    int result;
 
-            result = select(sock + 1, &readers, NULL, NULL, &timeout);
+    *read = 0;
 
-            if (result > 0) {
-                result = recvfrom(sock, buffer, RDP_BUF_SIZE, 0, NULL,
-                    NULL);
+    for (;;) {
+        count = unlz->end - unlz->start;
+        count = count < length - *read ? count : length - *read;
+        memcpy(data + *read, unlz->out + unlz->start, count);
+        unlz->start += count;
+        *read += count;
 
-                received++;
-                rdp_interp(buffer, result, &packet);
+        if (unlz->start < unlz->end) {
+            return 1;
+        }
 
-                if (packet.type == RDP_ACK) {
-                    if (packet.number > sender->number) {
-                        event = RDP_RECEIVE;
-                        sent += packet.number - sender->number;
-                        sender->number = packet.number;
-                        sender->window = packet.info;
-                        wnd = length - sent;
-
-                        if (packet.number == seq) {
-                            result = 0;
-                        }
-                    } else {
-                        event = RDP_DUPLICATE;
-                    }
+        used = unlz->used;
+        RDP_PROF(&receiver->stats.prof, RDP_STAGE_LZ,
+            result = rdp_unlz_next(unlz));
 
-                    sender->stats.ack++;
-                    rdp_log(event, &sender->peer.addr,
-                        &sender->self.addr, packet.type, packet.number,
-                        packet.info);
-                } else if (packet.type == RDP_RST) {
-                    sender->stats.rtr++;
-                    rdp_log(RDP_RECEIVE, &sender->peer.addr,
-                        &sender->self.addr, packet.type, packet.number,
-                        packet.info);
-                    return -1;
-                }
+        if (result > 0) {
+            receiver->stats.packed += unlz->used - used;
+            receiver->stats.unpacked += unlz->end;
+            continue;
+        } else if (result < 0) {
+            fprintf(stderr, "malformed compressed block\n");
+            break;
+        }
+
+        // what was decoded goes out before waiting for more.
+        if (*read && unlz->state > 0) {
+            return 1;
+        }
+
+        // a frame cut short by the end of the transfer is lost.
+        if (unlz->state <= 0) {
+            if (unlz->state == 0 && unlz->used < unlz->have) {
+                fprintf(stderr, "transfer ended inside a block\n");
+                break;
             }
-        } while (result);
 
-        // increment trys count.
-        if (!received) {
-            trys++;
+            result = unlz->state;
+            rdp_unlz_free(unlz);
+            receiver->unlz = NULL;
+            return result;
+        }
+
+        memmove(unlz->in, unlz->in + unlz->used, unlz->have - unlz->used);
+        unlz->have -= unlz->used;
+        unlz->used = 0;
+        unlz->state = rdp_receive_raw(sock, receiver, unlz->in + unlz->have,
+            RDP_LZ_STAGE - unlz->have, &count);
+        unlz->have += count;
+    }
+
+    // the sender is stopped, what follows could not be decoded either.
+    if (unlz->state > 0) {
+        rdp_reset(sock, receiver);
+        rdp_end(receiver);
+    }
+
+    rdp_unlz_free(unlz);
+    receiver->unlz = NULL;
+    return -1;
+}
+
+/*
+ * @param sock socket handler
+ * @param rdp_conn rdp connection
+ * @param data received data
+ * @param length length of received data
+ * @param read bytes received into data
+ * @return int state of connection, 1: open, 0: closed, -1: reset, -2:
+ * another connection asked for
+ */
+int rdp_receive(int sock, struct rdp_conn *receiver, void *data,
+    size_t length, size_t *read)
+{
+    if (receiver->unlz) {
+        return rdp_receive_unlz(sock, receiver, data, length, read);
+    }
+
+    return rdp_receive_raw(sock, receiver, data, length, read);
+}
+
+/*
+ * @param room bytes left in the mapping
+ * @return unsigned int window a mapped receive advertises
+ */
+static unsigned int rdp_map_window(size_t room)
+{
+    return room < RDP_REASM_SIZE ? room : RDP_REASM_SIZE;
+}
+
+/*
+ * @param receiver rdp connection
+ * @param packet data packet
+ * @param data its payload, trimmed to what is new
+ * @param fill_len payload bytes received
+ * @param placed the payload landed in place already
+ * @param map mapping the transfer is received into
+ * @param length mapping size
+ * @param read bytes in order at the start of map
+ * @return int 1: new data taken, 0: duplicate or past the window
+ */
+static int rdp_map_data(struct rdp_conn *receiver, struct rdp_packet *packet,
+    const char *data, int fill_len, int placed, char *map, size_t length,
+    size_t *read)
+{
+    int taken = 0;
+
+    // a segment resent in other pieces may start in data delivered
+    // already, only its tail is new.
+    if (packet->number < receiver->number &&
+        packet->number + fill_len > receiver->number) {
+        data += receiver->number - packet->number;
+        fill_len -= receiver->number - packet->number;
+        packet->number = receiver->number;
+    }
+
+    if (packet->number < receiver->number ||
+        packet->number - receiver->number + fill_len > receiver->window) {
+        return 0;
+    }
+
+    if (!placed) {
+        RDP_PROF(&receiver->stats.prof, RDP_STAGE_COPY,
+            memcpy(map + *read + (packet->number - receiver->number), data,
+            fill_len));
+    }
+
+    if (packet->number == receiver->number) {
+        *read += fill_len;
+        receiver->number += fill_len;
+        receiver->stats.ubytes += fill_len;
+        receiver->stats.upkts++;
+        taken = 1;
+
+        // segments held may be contiguous now.
+        if (receiver->reasm) {
+            fill_len = rdp_reasm_deliver(receiver->reasm, receiver->number,
+                NULL, length - *read);
+            *read += fill_len;
+            receiver->number += fill_len;
+        }
+    } else if (receiver->reasm && rdp_reasm_insert(receiver->reasm,
+        packet->number, NULL, fill_len) > 0) {
+        receiver->stats.ubytes += fill_len;
+        receiver->stats.upkts++;
+        taken = 1;
+    }
+
+    // the next batch expects segments of the largest size.
+    if (packet->info > receiver->span) {
+        receiver->span = packet->info;
+    }
+
+    receiver->window = rdp_map_window(length - *read);
+    return taken;
+}
+
+/*
+ * Like rdp_receive(), but into a mapping of the whole transfer. Full
+ * segments are received straight into place past the furthest byte held,
+ * the rest is copied there once, and segments held out of order stay in
+ * the mapping with only their ranges tracked. Compressed blocks are decoded
+ * into the mapping as they arrive.
+ *
+ * @param sock socket handler
+ * @param receiver rdp connection
+ * @param map mapping the transfer is received into
+ * @param length mapping size
+ * @param read bytes in order at the start of map, kept between calls
+ * @return int state of connection, 1: open, 0: closed, -1: reset, -2:
+ * another connection asked for
+ */
+int rdp_receive_map(int sock, struct rdp_conn *receiver, char *map,
+    size_t length, size_t *read)
+{
+    struct rdp_batch *inbox = receiver->inbox;
+    struct rdp_batch *acks = receiver->acks;
+    struct rdp_packet *packets = receiver->packets;
+    struct rdp_packet *packet;
+    char *placed = receiver->placed;
+    char *buffer, *data;
+    char eventr, events;
+    size_t hlen = 0, high = *read, decoded;
+    unsigned long long expected;
+    unsigned int span = 0;
+    struct rdp_packet lost;
+    int fill_len, i, held, rebuilt, result;
+
+    if (receiver->unlz) {
+        // a block decoding past the mapping sent more than announced.
+        if (*read == length && receiver->unlz->start < receiver->unlz->end) {
+            fprintf(stderr, "transfer larger than announced\n");
+            return -1;
+        }
+
+        result = rdp_receive(sock, receiver, map + *read, length - *read,
+            &decoded);
+        *read += decoded;
+        return result;
+    }
+
+    inbox->gro = receiver->gro;
+    inbox->ring = receiver->ring;
+    acks->ring = receiver->ring;
+
+    // the mapping holds segments out of order, the ring is not needed.
+    if (!receiver->reasm) {
+        receiver->reasm = rdp_reasm_new(0);
+    }
+
+    // past the furthest byte held nothing is overwritten by a landing.
+    if (receiver->reasm && receiver->reasm->count) {
+        high += receiver->reasm->ranges[receiver->reasm->count - 1].end -
+            receiver->number;
+    }
+
+    // payloads land in place only behind a header of known length.
+    if (receiver->caps & RDP_CAP_BIN) {
+        hlen = rdp_overhead(receiver->caps);
+        span = receiver->span;
+    }
+
+    receiver->window = rdp_map_window(length - *read);
+
+    rdp_ack_delayed(sock, receiver, acks);
+
+    // coalesced datagrams share a buffer, as do those the ring received,
+    // their payloads are copied.
+    if (receiver->gro || receiver->ring) {
+        RDP_PROF(&receiver->stats.prof, RDP_STAGE_RECV,
+            result = rdp_batch_recv(sock, inbox, MSG_WAITFORONE,
+            &receiver->stats));
+
+        for (i = 0; i < result; i++) {
+            placed[i] = 0;
+            RDP_PROF(&receiver->stats.prof, RDP_STAGE_PARSE,
+                rdp_interp(inbox->datagrams[i], inbox->lengths[i],
+                &packets[i]));
+        }
+    } else {
+        RDP_PROF(&receiver->stats.prof, RDP_STAGE_RECV,
+            result = rdp_batch_recv_into(sock, inbox, hlen, map + high,
+            span, length - high, MSG_WAITFORONE, &receiver->stats));
+    }
+
+    // a payload out of place is made whole before any is copied, a copy
+    // may cover where another landed.
+    for (i = 0; i < result && !receiver->gro && !receiver->ring; i++) {
+        buffer = inbox->buffers[i];
+        RDP_PROF(&receiver->stats.prof, RDP_STAGE_PARSE,
+            placed[i] = inbox->spans[i][1].iov_len &&
+            inbox->lengths[i] == hlen + span &&
+            (((unsigned char) buffer[0] << 8) | (unsigned char) buffer[1]) ==
+            RDP_BIN_MAGIC &&
+            rdp_interp(buffer, hlen + span, &packets[i]) == RDP_DAT &&
+            packets[i].data == buffer + hlen &&
+            packets[i].number == receiver->number + (high - *read) +
+            span * i);
+
+        if (!placed[i]) {
+            RDP_PROF(&receiver->stats.prof, RDP_STAGE_COPY,
+                buffer = rdp_batch_gather(inbox, i));
+            RDP_PROF(&receiver->stats.prof, RDP_STAGE_PARSE,
+                rdp_interp(buffer, inbox->lengths[i], &packets[i]));
+        }
+    }
+
+    for (i = 0; i < result; i++) {
+        buffer = inbox->datagrams[i];
+        packet = &packets[i];
+
+        // a GRO batch holds more datagrams than ACKs fit in one.
+        if (!rdp_batch_next(acks)) {
+            rdp_batch_flush(sock, acks, &receiver->stats);
+        }
+
+        // the next ACK echoes the oldest timestamp it covers.
+        if (packet->tsval && !receiver->unacked) {
+            receiver->tsecr = packet->tsval;
+        }
+
+        // packet is a duplicate?
+        if (packet->number < receiver->number) {
+            eventr = RDP_DUPLICATE;
+            events = RDP_RESEND;
+        } else {
+            eventr = RDP_RECEIVE;
+            events = RDP_SEND;
+        }
+
+        RDP_PROF(&receiver->stats.prof, RDP_STAGE_LOG,
+            rdp_log(eventr, &receiver->peer.addr, &receiver->self.addr,
+            packet->type, packet->number, packet->info));
+
+        expected = receiver->number;
+        held = receiver->reasm && receiver->reasm->count;
+
+        // handle received packet.
+        switch (packet->type) {
+        case RDP_FIN:
+            receiver->stats.fin++;
+            fill_len = rdp_header(receiver, rdp_batch_next(acks),
+                RDP_ACK, receiver->number + 1, receiver->window);
+            rdp_batch_push(acks, fill_len);
+            rdp_batch_flush(sock, acks, &receiver->stats);
+
+            rdp_reasm_free(receiver->reasm);
+            receiver->reasm = NULL;
+            rdp_end(receiver);
+            receiver->stats.ack++;
+            rdp_log(events, &receiver->self.addr, &receiver->peer.addr,
+                RDP_ACK, receiver->number + 1, receiver->window);
+            return 0;
+        case RDP_DAT:
+            // check DAT packet, never past the datagram received.
+            data = placed[i] ? map + high + span * i : packet->data;
+            fill_len = placed[i] ? span :
+                inbox->lengths[i] - (packet->data - buffer);
+            fill_len = packet->info < fill_len ? packet->info : fill_len;
+
+            // the segment may complete a stripe that lost another.
+            packet->data = data;
+            rebuilt = 0;
+
+            if (receiver->fec && packet->tag.block) {
+                RDP_PROF(&receiver->stats.prof, RDP_STAGE_FEC,
+                    rebuilt = rdp_fec_decode(receiver->fec, packet, fill_len,
+                    &lost));
+            }
+
+            rdp_map_data(receiver, packet, data, fill_len, placed[i], map,
+                length, read);
+
+            if (rebuilt && rdp_map_data(receiver, &lost, lost.data,
+                lost.info, 0, map, length, read)) {
+                receiver->stats.rebuilt++;
+            }
+
+            receiver->stats.tbytes += packet->info;
+            receiver->stats.tpkts++;
+            break;
+        case RDP_FEC:
+            fill_len = inbox->lengths[i] - (packet->data - buffer);
+            receiver->stats.fecs++;
+            RDP_PROF(&receiver->stats.prof, RDP_STAGE_FEC,
+                rebuilt = receiver->fec && rdp_fec_decode(receiver->fec,
+                packet, fill_len, &lost));
+
+            // parity that rebuilt nothing is not acknowledged.
+            if (!rebuilt || !rdp_map_data(receiver, &lost, lost.data,
+                lost.info, 0, map, length, read)) {
+                continue;
+            }
+
+            receiver->stats.rebuilt++;
+            break;
+        case RDP_SYN:
+            receiver->stats.syn++;
+
+            // the sender started over, this connection is gone.
+            if (packet->conn != receiver->id) {
+                rdp_batch_flush(sock, acks, &receiver->stats);
+                rdp_reasm_free(receiver->reasm);
+                receiver->reasm = NULL;
+                rdp_end(receiver);
+                return -2;
+            }
+
+            // the ACK of the SYN was lost, without the capabilities
+            // in it the sender would take none.
+            receiver->stats.ack++;
+            fill_len = rdp_syn_ack(receiver, rdp_batch_next(acks));
+            rdp_batch_push(acks, fill_len);
+            rdp_log(events, &receiver->self.addr, &receiver->peer.addr,
+                RDP_ACK, receiver->number, receiver->window);
+            continue;
+        case RDP_RST:
+            receiver->stats.rtr++;
+            rdp_batch_flush(sock, acks, &receiver->stats);
+            rdp_reasm_free(receiver->reasm);
+            receiver->reasm = NULL;
+            rdp_end(receiver);
+            return -1;
+        }
+
+        // Acknowledge packet, the whole batch is sent at once.
+        if (rdp_ack_due(receiver, packet, expected, held)) {
+            rdp_ack_queue(receiver, acks, events);
+        }
+    }
+
+    RDP_PROF(&receiver->stats.prof, RDP_STAGE_SEND,
+        rdp_batch_flush(sock, acks, &receiver->stats));
+    rdp_stats_tick(receiver, 0, rdp_clock());
+    return 1;
+}
+
+/*
+ * @param stream send stream
+ * @param seq sequence number of a byte written
+ * @return const char * where the byte is kept
+ */
+static const char *rdp_stream_at(const struct rdp_stream *stream,
+    unsigned long long seq)
+{
+    return stream->size ? stream->buffer + seq % stream->size :
+        stream->data + (seq - stream->start);
+}
+
+/*
+ * @param sock socket handler
+ * @param sender rdp connection
+ * @param data payload of the whole transfer, NULL when size is given
+ * @param size ring written into and sent from, 0 to send data
+ * @return struct rdp_stream * send stream, NULL failed
+ */
+static struct rdp_stream *rdp_stream_new(int sock, struct rdp_conn *sender,
+    const char *data, size_t size)
+{
+    struct rdp_stream *stream = malloc(sizeof(*stream));
+    unsigned long long now = rdp_clock();
+
+    if (!stream) {
+        perror("malloc");
+        return NULL;
+    }
+
+    stream->score = malloc(sizeof(*stream->score));
+    stream->buffer = size ? malloc(size) : NULL;
+
+    if (!stream->score || (size && !stream->buffer)) {
+        perror("malloc");
+        free(stream->score);
+        free(stream->buffer);
+        free(stream);
+        return NULL;
+    }
+
+    // a peer that decodes blocks is sent them compressed, from the ring.
+    stream->lz = size && (sender->caps & RDP_CAP_LZ) ? rdp_lz_new() : NULL;
+
+    if (size && (sender->caps & RDP_CAP_LZ) && !stream->lz) {
+        free(stream->score);
+        free(stream->buffer);
+        free(stream);
+        return NULL;
+    }
+
+    stream->sock = sock;
+    stream->sender = sender;
+    stream->data = data;
+    stream->size = size;
+    stream->start = sender->number;
+    stream->end = sender->number;
+    stream->nxt = sender->number;
+    stream->recover = sender->number;
+    stream->begin = now;
+    stream->closed = 0;
+    stream->failed = 0;
+    stream->max = rdp_payload(sender);
+    stream->room = RDP_BURST - (sender->fec ? 2 * RDP_FEC_PARITY : 0);
+    stream->trys = 0;
+    stream->persist = 0;
+
+    rdp_score_init(stream->score);
+    rdp_cc_init(&stream->cc, sender->cc, stream->max, now);
+    rdp_batch_init(&stream->burst, &sender->peer);
+    rdp_batch_init(&stream->acks, NULL);
+    rdp_wheel_init(&stream->wheel, now);
+    rdp_timer_init(&stream->rto, NULL);
+    rdp_timer_init(&stream->window, NULL);
+
+    // without kernel support payloads are still sent without a copy here,
+    // parity is copied into the batch, which zero-copy headers bypass. A
+    // ring is rewritten once acknowledged, while the kernel may still hold
+    // a resent copy of what it held.
+    if (sender->zerocopy && !sender->fec && !size) {
+        stream->burst.zc = rdp_zc_new(sock);
+    }
+
+    // segments of one size go to the kernel as one datagram to split.
+    stream->burst.gso = sender->gso;
+
+    // the pacer spaces datagrams itself, or hands the kernel their times.
+    rdp_pace_init(&stream->pace, sock, sender->txtime && (sender->rate > 0 ||
+        sender->pace), now);
+    stream->burst.txtime = stream->pace.txtime;
+
+    // without io_uring the socket is used as is.
+    sender->ring = sender->uring ? rdp_ring_new(sock, 0) : NULL;
+    stream->burst.ring = sender->ring;
+    stream->acks.ring = sender->ring;
+    return stream;
+}
+
+/*
+ * @param stream send stream, its zero-copy sends completed and freed
+ */
+static void rdp_stream_free(struct rdp_stream *stream)
+{
+    struct rdp_conn *sender = stream->sender;
+
+    rdp_pace_stats(&stream->pace, &sender->stats);
+    rdp_zc_free(stream->burst.zc, &sender->stats);
+    rdp_ring_free(sender->ring, &sender->stats);
+    sender->ring = NULL;
+    rdp_lz_free(stream->lz);
+    free(stream->score);
+    free(stream->buffer);
+    free(stream);
+}
+
+/*
+ * One round of the transfer: lost segments and the new data the windows
+ * take go out as a burst, then the ACKs that came back and the timers
+ * that expired are handled.
+ *
+ * @param stream send stream
+ * @param block wait for an ACK or a timer, else take only what is there
+ * @return int 0: open, -1: reset
+ */
+static int rdp_stream_step(struct rdp_stream *stream, int block)
+{
+    int sock = stream->sock;
+    struct rdp_conn *sender = stream->sender;
+    struct rdp_score *score = stream->score;
+    struct rdp_batch *burst = &stream->burst;
+    struct rdp_batch *acks = &stream->acks;
+    struct rdp_cc *cc = &stream->cc;
+    struct rdp_pace *pace = &stream->pace;
+    struct rdp_wheel *wheel = &stream->wheel;
+    struct rdp_segment *segment;
+    struct rdp_timer *timer;
+    struct rdp_packet packet;
+    char event;
+    int i, result, expired, paced;
+    unsigned int pay, rtt, karn, probe, part;
+    unsigned int received, lost;
+    unsigned long long seq, wait, due;
+    unsigned long long now = rdp_clock();
+
+    // a fixed rate, else the congestion controller's once it has one.
+    if (sender->rate > 0 || sender->pace) {
+        rdp_pace_set(pace, sender->rate > 0 ? sender->rate :
+            rdp_cc_pacing_rate(cc), sender->pmtu.size, now);
+    }
+
+    paced = 0;
+
+    while (burst->segments < stream->room) {
+        // the pacer holds the rest back until their time comes.
+        if (pace->rate > 0) {
+            now = rdp_clock();
+
+            if (rdp_pace_due(pace, now)) {
+                paced = 1;
+                break;
+            }
+        }
+
+        // lost segments go first, then new data the windows allow.
+        segment = rdp_score_lost(score);
+
+        if (segment) {
+            // a lost probe goes again in pieces the path takes.
+            if (rdp_pmtu_probe(&sender->pmtu, segment->seq)) {
+                rdp_pmtu_lost(&sender->pmtu);
+            }
+
+            if (burst->segments + (segment->length + stream->max - 1) /
+                stream->max > stream->room) {
+                break;
+            }
+
+            rdp_score_resend(score, segment);
+
+            for (seq = segment->seq; seq != segment->seq +
+                segment->length; seq += part) {
+                part = segment->seq + segment->length - seq;
+                part = part < stream->max ? part : stream->max;
+                burst->when = rdp_pace_sent(pace,
+                    part + rdp_overhead(sender->caps), now);
+                rdp_queue(sender, burst, rdp_stream_at(stream, seq), seq,
+                    part, RDP_RESEND);
+                sender->stats.tbytes += part;
+                sender->stats.tpkts++;
+            }
         } else {
-            trys = 0;
+            // a probe carries new data at the next size to try, when
+            // the congestion window has room for it.
+            probe = rdp_pmtu_next(&sender->pmtu);
+            probe = probe ? probe - rdp_overhead(sender->caps) : 0;
+            pay = probe && score->pipe + probe <= rdp_cc_cwnd(cc) ?
+                probe : stream->max;
+            pay = stream->end - stream->nxt < pay ?
+                stream->end - stream->nxt : pay;
+
+            // a segment never wraps around the ring, it is sent and
+            // resent from one piece of it.
+            if (stream->size && stream->nxt % stream->size + pay >
+                stream->size) {
+                pay = stream->size - stream->nxt % stream->size;
+            }
+
+            // Shrink the segment to what the receiver window still takes,
+            // a closed one is probed with a byte once the timer fires.
+            if (stream->nxt - sender->number >= sender->window) {
+                pay = stream->persist && pay ? 1 : 0;
+                stream->persist = 0;
+            } else if (stream->nxt + pay - sender->number > sender->window) {
+                pay = sender->number + sender->window - stream->nxt;
+            }
+
+            if (!pay ||
+                score->pipe + pay > rdp_cc_cwnd(cc) ||
+                !rdp_score_add(score, stream->nxt, pay)) {
+                break;
+            }
+
+            if (pay > stream->max) {
+                rdp_pmtu_sent(&sender->pmtu, stream->nxt,
+                    pay + rdp_overhead(sender->caps));
+            } else if (sender->fec && !rdp_fec_fits(sender->fec, pay)) {
+                // an FEC block holds segments of one size.
+                rdp_queue_parity(sender, burst);
+            }
+
+            // Queue data, the burst is sent at once.
+            burst->when = rdp_pace_sent(pace,
+                pay + rdp_overhead(sender->caps), now);
+            rdp_queue(sender, burst, rdp_stream_at(stream, stream->nxt),
+                stream->nxt, pay, RDP_SEND);
+            stream->nxt += pay;
+
+            // parity follows a full block, and the end of the data.
+            if (sender->fec && (rdp_fec_full(sender->fec) ||
+                (stream->closed && stream->nxt == stream->end))) {
+                rdp_queue_parity(sender, burst);
+            }
+            sender->stats.tbytes += pay;
+            sender->stats.ubytes += pay;
+            sender->stats.upkts++;
+            sender->stats.tpkts++;
         }
+    }
+
+    // a block the receiver window keeps from filling goes out as is.
+    if (sender->fec && stream->nxt - sender->number >= sender->window) {
+        rdp_queue_parity(sender, burst);
+    }
+
+    RDP_PROF(&sender->stats.prof, RDP_STAGE_SEND,
+        rdp_batch_flush(sock, burst, &sender->stats));
+    received = 0;
+    now = rdp_clock();
 
-        // if trys limit is reached, stop sending and reset connection.
-        if (trys == RDP_RETRANS) {
-            rdp_reset(sock, sender);
-            rdp_end(sender);
+    // retransmission timer runs while data is outstanding, the
+    // persist timer while a closed window holds the rest back.
+    if (rdp_score_count(score)) {
+        rdp_timer_cancel(wheel, &stream->window);
+
+        if (!rdp_timer_pending(&stream->rto)) {
+            rdp_timer_arm(wheel, &stream->rto,
+                now + rdp_rtt_rto(&sender->rtt));
+        }
+    } else if (stream->nxt != stream->end &&
+        !rdp_timer_pending(&stream->window)) {
+        rdp_timer_arm(wheel, &stream->window,
+            now + rdp_rtt_rto(&sender->rtt));
+    }
+
+    // ACKs clock out the next burst, else the first timer wakes us,
+    // or the pacer when it held datagrams back.
+    wait = rdp_wheel_next(wheel);
+    due = paced ? rdp_pace_due(pace, now) : 0;
+    due = due && (!wait || due < wait) ? due : 0;
+    wait = due ? due : wait;
+    wait = wait > now ? wait - now : 0;
+
+    // a writer with more to write is not held up by them.
+    if (!block) {
+        wait = 0;
+        due = 0;
+    }
+
+    // select sleeps longer than a short wait, that is spun instead.
+    if (due && wait < RDP_PACE_SPIN) {
+        while (rdp_clock() < due) {
+        }
+
+        wait = 0;
+    }
+
+    RDP_PROF(&sender->stats.prof, RDP_STAGE_WAIT,
+        result = sender->ring ? rdp_ring_wait(sender->ring, wait) :
+        rdp_wait(sock, wait));
+
+    if (result > 0) {
+        if (burst->zc) {
+            rdp_zc_reap(burst->zc, 0);
+        }
+
+        // drain every pending ACK with one call.
+        RDP_PROF(&sender->stats.prof, RDP_STAGE_RECV,
+            result = rdp_batch_recv(sock, acks, MSG_DONTWAIT,
+            &sender->stats));
+        now = rdp_clock();
+    }
+
+    // a failed wait counts as a try, zero-copy completions alone do not.
+    expired = result < 0 && errno != EAGAIN;
+
+    for (i = 0; i < result; i++) {
+        received++;
+        RDP_PROF(&sender->stats.prof, RDP_STAGE_PARSE,
+            rdp_interp(acks->datagrams[i], acks->lengths[i], &packet));
+
+        if (packet.type == RDP_ACK) {
+            rdp_score_sack(score, packet.sack, packet.sacks);
+
+            // a probe that arrived raises the size of every segment.
+            if (rdp_pmtu_ack(&sender->pmtu, &packet)) {
+                stream->max = rdp_payload(sender);
+                cc->mss = stream->max;
+            }
+
+            if (packet.number > sender->number &&
+                packet.number <= stream->nxt) {
+                event = RDP_RECEIVE;
+                pay = packet.number - sender->number;
+                sender->number = packet.number;
+                sender->window = packet.info;
+                score->dupacks = 0;
+
+                // timestamps time retransmissions too, else Karn.
+                rdp_score_ack(score, packet.number, &karn);
+                rtt = rdp_echo(sender, &packet, now);
+
+                if (!rtt && karn) {
+                    rdp_rtt_sample(&sender->rtt, karn);
+                    rtt = karn;
+                }
+
+                if (rtt) {
+                    rdp_hist_add(&sender->stats.rtt, rtt);
+                    rdp_cc_rtt(cc, rtt, now);
+                }
+
+                rdp_cc_ack(cc, pay, score->pipe, now);
+                rdp_series_add(&sender->stats.series,
+                    now - sender->stats.begin, pay);
+
+                if (rdp_score_count(score)) {
+                    rdp_timer_arm(wheel, &stream->rto,
+                        now + rdp_rtt_rto(&sender->rtt));
+                } else {
+                    rdp_timer_cancel(wheel, &stream->rto);
+                }
+            } else {
+                event = RDP_DUPLICATE;
+
+                // window update, or a hint of a lost segment.
+                if (packet.number == sender->number) {
+                    sender->window = packet.info;
+
+                    if (rdp_score_count(score) &&
+                        ++score->dupacks == RDP_DUP_THRESH &&
+                        (lost = rdp_score_loss(score)) &&
+                        sender->number >= stream->recover &&
+                        !(lost == 1 && rdp_pmtu_probe(&sender->pmtu,
+                        rdp_score_lost(score)->seq))) {
+                        // one reduction per window of data, a lone
+                        // lost probe says nothing of congestion.
+                        rdp_cc_loss(cc, score->pipe, 0, now);
+                        stream->recover = stream->nxt;
+                    }
+                }
+            }
+
+            sender->stats.ack++;
+            RDP_PROF(&sender->stats.prof, RDP_STAGE_LOG,
+                rdp_log(event, &sender->peer.addr, &sender->self.addr,
+                packet.type, packet.number, packet.info));
+        } else if (packet.type == RDP_RST) {
+            sender->stats.rtr++;
+            rdp_log(RDP_RECEIVE, &sender->peer.addr, &sender->self.addr,
+                packet.type, packet.number, packet.info);
+            stream->failed = 1;
             return -1;
         }
     }
 
+    now = rdp_clock();
+
+    while ((timer = rdp_wheel_expired(wheel, now))) {
+        expired = 1;
+
+        if (timer == &stream->rto) {
+            // nothing acknowledged in time, resend all the peer lacks.
+            rdp_score_timeout(score);
+            rdp_cc_loss(cc, score->pipe, 1, now);
+            rdp_rtt_backoff(&sender->rtt);
+            stream->recover = stream->nxt;
+        } else if (stream->nxt != stream->end) {
+            // the update reopening the window may have been lost.
+            rdp_rtt_backoff(&sender->rtt);
+            stream->persist = 1;
+        }
+    }
+
+    rdp_trace(&sender->stats, (now - stream->begin) / 1000,
+        rdp_cc_cwnd(cc));
+    rdp_stats_tick(sender, 1, now);
+
+    // increment trys count.
+    if (received) {
+        stream->trys = 0;
+    } else if (expired) {
+        stream->trys++;
+    }
+
+    // if trys limit is reached, stop sending and reset connection.
+    if (stream->trys == RDP_RTO_RETRANS) {
+        rdp_reset(sock, sender);
+        rdp_end(sender);
+        stream->failed = 1;
+        return -1;
+    }
+
     return 0;
 }
 
+/*
+ * @param sock socket handler
+ * @param sender rdp connection
+ * @param data data to send
+ * @param length send data length
+ * @return int state of connection, 0: sent, -1: reset
+ */
+int rdp_send(int sock, struct rdp_conn *sender, const void *data,
+    size_t length)
+{
+    struct rdp_stream *stream;
+    int result = 0;
+
+    // what is sent is compressed, not the data itself.
+    if (sender->caps & RDP_CAP_LZ) {
+        stream = rdp_stream_open(sock, sender, 0);
+
+        if (!stream) {
+            return -1;
+        }
+
+        rdp_stream_write(stream, data, length);
+        return rdp_stream_close(stream);
+    }
+
+    stream = rdp_stream_new(sock, sender, data, 0);
+
+    if (!stream) {
+        return -1;
+    }
+
+    // the whole transfer is written at once.
+    stream->end = stream->start + length;
+    stream->closed = 1;
+
+    // send packets with error resend
+    while (!result && sender->number != stream->end) {
+        result = rdp_stream_step(stream, 1);
+    }
+
+    rdp_stream_free(stream);
+    return result;
+}
+
+/*
+ * What is written is copied into a ring and sent from there, the ring
+ * reused as the peer acknowledges it, so a transfer of any length from a
+ * pipe takes no more memory than the ring.
+ *
+ * @param sock socket handler
+ * @param sender rdp connection
+ * @param size ring size, 0 for RDP_STREAM_SIZE
+ * @return struct rdp_stream * send stream, NULL failed
+ */
+struct rdp_stream *rdp_stream_open(int sock, struct rdp_conn *sender,
+    size_t size)
+{
+    return rdp_stream_new(sock, sender, NULL, size ? size : RDP_STREAM_SIZE);
+}
+
+/*
+ * @param stream send stream
+ * @param data bytes to send as they are
+ * @param length bytes in data
+ */
+static void rdp_stream_put(struct rdp_stream *stream, const void *data,
+    size_t length)
+{
+    size_t room, at, first;
+
+    while (length && !stream->failed) {
+        room = stream->size - (stream->end - stream->sender->number);
+        room = room < length ? room : length;
+        at = stream->end % stream->size;
+        first = stream->size - at < room ? stream->size - at : room;
+
+        memcpy(stream->buffer + at, data, first);
+        memcpy(stream->buffer, (const char *) data + first, room - first);
+        stream->end += room;
+        data = (const char *) data + room;
+        length -= room;
+
+        // what was written goes out at once, a full ring waits for ACKs.
+        rdp_stream_step(stream, length > 0);
+    }
+}
+
+/*
+ * @param stream send stream, its block compressed and put in the ring
+ * @param data block, RDP_LZ_BLOCK bytes or the last ones
+ * @param length block length
+ */
+static void rdp_stream_pack(struct rdp_stream *stream, const char *data,
+    unsigned int length)
+{
+    struct rdp_conn *sender = stream->sender;
+    unsigned int packed;
+
+    RDP_PROF(&sender->stats.prof, RDP_STAGE_LZ,
+        packed = rdp_lz_pack(stream->lz, data, length));
+    sender->stats.packed += packed;
+    sender->stats.unpacked += length;
+    rdp_stream_put(stream, stream->lz->frame, packed);
+}
+
+/*
+ * @param stream send stream
+ * @param data bytes to send
+ * @param length bytes in data
+ * @return int 0: taken, -1: the connection was reset
+ */
+int rdp_stream_write(struct rdp_stream *stream, const void *data,
+    size_t length)
+{
+    struct rdp_lz *lz = stream->lz;
+    size_t take;
+
+    if (!lz) {
+        rdp_stream_put(stream, data, length);
+        return stream->failed ? -1 : 0;
+    }
+
+    // whole blocks are compressed where they are, parts gathered first.
+    while (length && !stream->failed) {
+        take = RDP_LZ_BLOCK - lz->fill < length ? RDP_LZ_BLOCK - lz->fill :
+            length;
+
+        if (!lz->fill && take == RDP_LZ_BLOCK) {
+            rdp_stream_pack(stream, data, take);
+        } else {
+            memcpy(lz->block + lz->fill, data, take);
+            lz->fill += take;
+
+            if (lz->fill == RDP_LZ_BLOCK) {
+                rdp_stream_pack(stream, lz->block, lz->fill);
+                lz->fill = 0;
+            }
+        }
+
+        data = (const char *) data + take;
+        length -= take;
+    }
+
+    return stream->failed ? -1 : 0;
+}
+
+/*
+ * @param stream send stream, freed once all written is acknowledged
+ * @return int 0: sent, -1: the connection was reset
+ */
+int rdp_stream_close(struct rdp_stream *stream)
+{
+    struct rdp_conn *sender = stream->sender;
+    int result;
+
+    // the last block is sent however little of it was written.
+    if (stream->lz && stream->lz->fill && !stream->failed) {
+        rdp_stream_pack(stream, stream->lz->block, stream->lz->fill);
+        stream->lz->fill = 0;
+    }
+
+    result = stream->failed ? -1 : 0;
+    stream->closed = 1;
+
+    // the last block may have been sent before the end was known.
+    if (!result && sender->fec && stream->nxt == stream->end &&
+        sender->number != stream->end) {
+        rdp_queue_parity(sender, &stream->burst);
+    }
+
+    while (!result && sender->number != stream->end) {
+        result = rdp_stream_step(stream, 1);
+    }
+
+    rdp_stream_free(stream);
+    return result;
+}
+
+/*
+ * @param name what the histogram measures
+ * @param hist histogram of microseconds
+ */
+static void rdp_stats_hist(const char *name, const struct rdp_hist *hist)
+{
+    printf("%s (ms): min %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f, "
+        "samples %llu\n", name, hist->min / 1000.0,
+        rdp_hist_quantile(hist, 0.5) / 1000.0,
+        rdp_hist_quantile(hist, 0.9) / 1000.0,
+        rdp_hist_quantile(hist, 0.99) / 1000.0, hist->max / 1000.0,
+        hist->count);
+}
+
 /*
  * @param conn rdp connection
  * @param sender is a send or not
@@ -580,6 +2225,7 @@ void rdp_stats(const struct rdp_conn *conn, int sender)
 {
     char *a1, *a2;
     double dur;
+    unsigned int i;
 
     if (sender) {
         a1 = "sent";
@@ -589,19 +2235,176 @@ void rdp_stats(const struct rdp_conn *conn, int sender)
         a2 = "sent";
     }
 
+    if (!rdp_log_enabled(RDP_LOG_SUMMARY)) {
+        return;
+    }
+
     dur = conn->stats.time.tv_sec;
     dur += conn->stats.time.tv_usec / 1000000.0;
 
-    printf("total data bytes %s: %u\n", a1, conn->stats.tbytes);
-    printf("unique data bytes %s: %u\n", a1, conn->stats.ubytes);
-    printf("total data packets %s: %u\n", a1, conn->stats.tpkts);
-    printf("unique data packets %s: %u\n", a1, conn->stats.upkts);
+    printf("total data bytes %s: %llu\n", a1, conn->stats.tbytes);
+    printf("unique data bytes %s: %llu\n", a1, conn->stats.ubytes);
+    printf("total data packets %s: %llu\n", a1, conn->stats.tpkts);
+    printf("unique data packets %s: %llu\n", a1, conn->stats.upkts);
+
+    printf("SYN packets %s: %llu\n", a1, conn->stats.syn);
+    printf("FIN packets %s: %llu\n", a1, conn->stats.fin);
+    printf("RST packets %s: %llu\n", a1, sender ?  conn->stats.rts : conn->stats.rtr);
+    printf("ACK packets %s: %llu\n", a2, conn->stats.ack);
+    printf("RST packets %s: %llu\n", a2, sender ?  conn->stats.rtr : conn->stats.rts);
+
+    printf("%s batches: %llu, %.1f packets per batch\n", a1,
+        conn->stats.sbatch, conn->stats.sbatch ?
+        (double) conn->stats.smsgs / conn->stats.sbatch : 0.0);
+    printf("%s batches: %llu, %.1f packets per batch\n", a2,
+        conn->stats.rbatch, conn->stats.rbatch ?
+        (double) conn->stats.rmsgs / conn->stats.rbatch : 0.0);
+
+    if (sender) {
+        printf("congestion control: %s\n", conn->cc ? conn->cc->name :
+            rdp_ccs[0]->name);
+        printf("cwnd trajectory (ms:bytes):");
+
+        for (i = 0; i < conn->stats.cwnds; i++) {
+            printf(" %u:%u", conn->stats.cwnd[i].time,
+                conn->stats.cwnd[i].cwnd);
+        }
+
+        printf("\n");
+    }
+
+    printf("segment size: %u bytes\n", conn->pmtu.size);
+
+    if (conn->stats.zsends) {
+        printf("zero-copy sends %s: %llu, copied by the kernel: %llu\n", a1,
+            conn->stats.zsends, conn->stats.zcopied);
+    }
+
+    if (conn->stats.enters) {
+        printf("io_uring system calls: %llu\n", conn->stats.enters);
+    }
+
+    if (conn->stats.gsends || conn->stats.grecvs) {
+        printf("offloaded batches sent (GSO): %llu, received (GRO): %llu\n",
+            conn->stats.gsends, conn->stats.grecvs);
+    }
+
+    if (!sender) {
+        printf("ACKs suppressed: %llu, segments per ACK: %u\n",
+            conn->stats.acksup, conn->ackfreq);
+    }
+
+    if (conn->stats.fecs) {
+        printf("FEC parity packets %s: %llu, segments rebuilt: %llu\n", a1,
+            conn->stats.fecs, conn->stats.rebuilt);
+    }
+
+    if (conn->stats.packed) {
+        printf("compressed blocks %s: %llu bytes holding %llu, ratio %.2f\n",
+            a1, conn->stats.packed, conn->stats.unpacked,
+            (double) conn->stats.unpacked / conn->stats.packed);
+    }
+
+    if (conn->stats.pacetime) {
+        printf("paced rate: %.3f Mbit/s, target: %.3f Mbit/s\n",
+            conn->stats.paced * 8.0 / conn->stats.pacetime,
+            conn->stats.planned * 8.0 / conn->stats.pacetime);
+    }
+
+    if (conn->stats.flows > 1) {
+        printf("parallel flows: %u\n", conn->stats.flows);
+    }
+
+    if (conn->resumed) {
+        printf("resumed at byte: %llu\n", conn->resumed);
+    }
+
+    if (conn->rtt.samples) {
+        printf("smoothed RTT: %.3fms, RTO: %.3fms\n",
+            conn->rtt.srtt / 1000.0, rdp_rtt_rto(&conn->rtt) / 1000.0);
+    }
+
+    if (conn->stats.rtt.count) {
+        rdp_stats_hist("RTT", &conn->stats.rtt);
+    }
+
+    if (conn->stats.ackdelay.count) {
+        rdp_stats_hist("ACK delay", &conn->stats.ackdelay);
+    }
+
+    if (conn->stats.series.count) {
+        printf("throughput per %.1fs (Mbit/s):",
+            (double) conn->stats.series.step / RDP_USEC);
+
+        for (i = 0; i < conn->stats.series.count; i++) {
+            printf(" %.1f", conn->stats.series.bytes[i] * 8.0 /
+                conn->stats.series.step);
+        }
 
-    printf("SYN packets %s: %u\n", a1, conn->stats.syn);
-    printf("FIN packets %s: %u\n", a1, conn->stats.fin);
-    printf("RST packets %s: %u\n", a1, sender ?  conn->stats.rts : conn->stats.rtr);
-    printf("ACK packets %s: %u\n", a2, conn->stats.ack);
-    printf("RST packets %s: %u\n", a2, sender ?  conn->stats.rtr : conn->stats.rts);
+        printf("\n");
+    }
+
+#ifdef RDP_PROFILE
+    rdp_prof_print(&conn->stats.prof, conn->stats.tpkts + conn->stats.fecs);
+#endif
 
     printf("total time duration: %.3fs\n", dur);
 }
+
+/*
+ * Counters of a flow are added to the total, the longest flow gives the
+ * duration since the flows ran side by side.
+ *
+ * @param total rdp connection holding the sums
+ * @param flow rdp connection of one flow
+ */
+void rdp_stats_merge(struct rdp_conn *total, const struct rdp_conn *flow)
+{
+    struct rdp_stats *sum = &total->stats;
+    const struct rdp_stats *add = &flow->stats;
+
+    sum->flows = (sum->flows ? sum->flows : 1) + (add->flows ? add->flows : 1);
+    sum->tbytes += add->tbytes;
+    sum->ubytes += add->ubytes;
+    sum->tpkts += add->tpkts;
+    sum->upkts += add->upkts;
+    sum->ack += add->ack;
+    sum->syn += add->syn;
+    sum->fin += add->fin;
+    sum->rtr += add->rtr;
+    sum->rts += add->rts;
+    sum->sbatch += add->sbatch;
+    sum->smsgs += add->smsgs;
+    sum->rbatch += add->rbatch;
+    sum->rmsgs += add->rmsgs;
+    sum->zsends += add->zsends;
+    sum->zcopied += add->zcopied;
+    sum->gsends += add->gsends;
+    sum->grecvs += add->grecvs;
+    sum->enters += add->enters;
+    sum->acksup += add->acksup;
+    sum->fecs += add->fecs;
+    sum->rebuilt += add->rebuilt;
+    sum->paced += add->paced;
+    sum->pacetime = add->pacetime > sum->pacetime ? add->pacetime :
+        sum->pacetime;
+    sum->planned += add->planned;
+    sum->packed += add->packed;
+    sum->unpacked += add->unpacked;
+    rdp_hist_merge(&sum->rtt, &add->rtt);
+    rdp_hist_merge(&sum->ackdelay, &add->ackdelay);
+    rdp_series_merge(&sum->series, &add->series);
+#ifdef RDP_PROFILE
+    rdp_prof_merge(&sum->prof, &add->prof);
+#endif
+
+    if (add->begin && (!sum->begin || add->begin < sum->begin)) {
+        sum->begin = add->begin;
+    }
+
+    sum->end = add->end > sum->end ? add->end : sum->end;
+
+    if (timercmp(&add->time, &sum->time, >)) {
+        sum->time = add->time;
+    }
+}
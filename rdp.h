@@ -2,20 +2,95 @@
 #define RDP_H
 
 #include <netinet/in.h>
+#include "rdphist.h"
+#include "rdpmtu.h"
+#include "rdpprof.h"
+#include "rdprtt.h"
+
+// congestion window samples kept for the trajectory.
+#define RDP_CWND_SAMPLES 32
+
+// segments in order per ACK unless the sender asks for another count.
+#define RDP_ACK_EVERY 2
+#define RDP_ACK_MAX 16
+
+// longest an ACK is held back, microseconds, well under RDP_RTO_MIN.
+#define RDP_ACK_DELAY 2000
+
+// bytes a send stream holds for retransmission unless told otherwise.
+#define RDP_STREAM_SIZE (4 << 20)
+
+struct rdp_cwnd {
+    unsigned int time;
+    unsigned int cwnd;
+};
 
 struct rdp_stats {
-    unsigned int tbytes;
-    unsigned int ubytes;
-    unsigned int tpkts;
-    unsigned int upkts;
-    unsigned int ack;
-    unsigned short syn;
-    unsigned short fin;
-    unsigned short rtr;
-    unsigned short rts;
+    unsigned long long tbytes;
+    unsigned long long ubytes;
+    unsigned long long tpkts;
+    unsigned long long upkts;
+    unsigned long long ack;
+    unsigned long long syn;
+    unsigned long long fin;
+    unsigned long long rtr;
+    unsigned long long rts;
+    unsigned long long sbatch;
+    unsigned long long smsgs;
+    unsigned long long rbatch;
+    unsigned long long rmsgs;
+    unsigned int cwnds;
+    unsigned int changes;
+    unsigned int stride;
+    unsigned int flows;         // flows merged into these, 0 for one
+    unsigned long long zsends;  // sends with MSG_ZEROCOPY
+    unsigned long long zcopied; // of those, copied by the kernel after all
+    unsigned long long gsends;  // sends the kernel split into datagrams
+    unsigned long long grecvs;  // received buffers of coalesced datagrams
+    unsigned long long enters;  // io_uring_enter calls
+    unsigned long long acksup;  // segments acknowledged by a later ACK
+    unsigned long long fecs;    // parity segments
+    unsigned long long rebuilt; // lost segments rebuilt from parity
+    unsigned long long paced;   // bytes sent by the pacer
+    unsigned long long pacetime; // microseconds they took
+    unsigned long long planned; // bytes the target rate allowed in them
+    unsigned long long packed;  // compressed blocks, headers included
+    unsigned long long unpacked; // bytes the blocks hold
+    struct rdp_cwnd cwnd[RDP_CWND_SAMPLES];
+    struct rdp_hist rtt;        // round trip times, microseconds
+    struct rdp_hist ackdelay;   // time ACKs were held back, microseconds
+    struct rdp_series series;   // data bytes acknowledged or delivered
+    unsigned long long begin;   // rdp_clock() time the transfer began
+    unsigned long long end;     // and ended, 0 while it runs
+#ifdef RDP_PROFILE
+    struct rdp_prof prof;       // time spent per stage of the packet path
+#endif
     struct timeval time;
 };
 
+// RDP connection settings, agreed with the peer at SYN time.
+struct rdp_conf {
+    unsigned int mss;           // largest datagram, header included
+    int probe;                  // start at RDP_BUF_SIZE and probe up to mss
+    unsigned int id;            // connection id, 0 picks a random one
+    unsigned int stripes;       // flows of a striped transfer, 0 for none
+    unsigned long long offset;  // file offset of this flow's range
+    unsigned long long size;    // bytes to send, announced in the SYN
+    unsigned long long resume;  // token of the file to resume, 0 for none
+    unsigned long long resumed; // bytes of it the receiver holds already
+    int zerocopy;               // send payloads with MSG_ZEROCOPY
+    int offload;                // UDP GSO on send, GRO on receive
+    int uring;                  // send and receive through io_uring
+    unsigned int ackfreq;       // segments per ACK, asked in the SYN
+    unsigned int fec;           // segments per FEC block, 0 for no parity
+    int compress;               // send blocks compressed, if the peer can
+    unsigned int parity;        // parity segments per block, 0 adapts
+    double rate;                // bytes/s sent at, 0 for unpaced
+    int pace;                   // pace at the congestion controller's rate
+    int txtime;                 // the kernel keeps departures, SO_TXTIME
+    const char *export;         // statistics file kept current, NULL none
+};
+
 struct socket_info {
     struct sockaddr_in addr;
     socklen_t length;
@@ -25,15 +100,64 @@ struct rdp_conn {
     struct socket_info self;
     struct socket_info peer;
     struct rdp_stats stats;
-    unsigned int number;
+    unsigned int id;
+    unsigned long long number;
     unsigned int window;
+    unsigned int caps;
+    unsigned int tsecr;
+    unsigned int span;          // largest payload received so far
+    unsigned long long size;    // bytes the sender announced, 0 unknown
+    unsigned long long token;   // resume token the sender offered, 0 none
+    unsigned long long resumed; // bytes of the file the transfer skips
+    unsigned int ackfreq;       // segments in order per ACK
+    unsigned int unacked;       // segments in order since the last ACK
+    unsigned long long delack;  // time the held ACK is due, 0 for none
+    int zerocopy;
+    double rate;                // fixed pacing rate, bytes/s
+    int pace;                   // pace at the congestion controller's rate
+    int txtime;
+    int gso;                    // sends segmented by the kernel
+    int gro;                    // socket coalesces received datagrams
+    int uring;                  // transfers go through io_uring
+    struct rdp_ring *ring;      // NULL while no transfer is in progress
+    struct rdp_pmtu pmtu;
+    struct rdp_rtt rtt;
+    struct rdp_batch *inbox;    // receiver's datagrams, NULL once closed
+    struct rdp_batch *acks;
+    struct rdp_packet *packets; // the inbox parsed, mapped receive only
+    char *placed;               // of them, payloads landed in the file
+    struct rdp_reasm *reasm;
+    struct rdp_fec *fec;        // NULL unless FEC was negotiated
+    struct rdp_unlz *unlz;      // NULL unless compression was negotiated
+    const char *export;         // statistics file, rewritten periodically
+    unsigned long long exported; // time it is due again
+    const struct rdp_cc_ops *cc;
 };
 
+struct rdp_stream;
+
 int rdp_send(int sock, struct rdp_conn *sender, const void *data, size_t length);
+struct rdp_stream *rdp_stream_open(int sock, struct rdp_conn *sender,
+    size_t size);
+int rdp_stream_write(struct rdp_stream *stream, const void *data,
+    size_t length);
+int rdp_stream_close(struct rdp_stream *stream);
 int rdp_receive(int sock, struct rdp_conn *receiver, void *data, size_t length, size_t *read);
-int rdp_accept(int sock, struct rdp_conn *receiver);
-int rdp_connect(int sock, struct sockaddr_in *addr, struct rdp_conn *sender);
+int rdp_receive_map(int sock, struct rdp_conn *receiver, char *map,
+    size_t length, size_t *read);
+int rdp_accept(int sock, struct rdp_conn *receiver,
+    const struct rdp_conf *conf);
+int rdp_connect(int sock, struct sockaddr_in *addr, struct rdp_conn *sender,
+    const struct rdp_conf *conf);
+void rdp_conf_init(struct rdp_conf *conf);
+unsigned int rdp_conf_mss(const struct rdp_conf *conf);
+unsigned int rdp_conf_ackfreq(const struct rdp_conf *conf, unsigned int asked);
 void rdp_stats(const struct rdp_conn *context, int sender);
+void rdp_stats_merge(struct rdp_conn *total, const struct rdp_conn *flow);
+int rdp_stats_export(const struct rdp_conn *conn, int sender,
+    const char *path);
+int rdp_set_cc(struct rdp_conn *conn, const char *name);
 int rdp_close(int sock, struct rdp_conn *sender);
+void rdp_reset(int sock, struct rdp_conn *sender);
 
 #endif // RDP_H
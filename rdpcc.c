@@ -0,0 +1,432 @@
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include "rdpcc.h"
+#include "rdpclock.h"
+
+// CUBIC constants.
+#define RDP_CUBIC_C 0.4
+#define RDP_CUBIC_BETA 0.7
+
+// BBR modes.
+#define RDP_BBR_STARTUP 0
+#define RDP_BBR_DRAIN 1
+#define RDP_BBR_PROBE_BW 2
+#define RDP_BBR_PROBE_RTT 3
+
+// BBR constants.
+#define RDP_BBR_HIGH_GAIN 2.885
+#define RDP_BBR_CWND_GAIN 2.0
+#define RDP_BBR_CYCLE 8
+#define RDP_BBR_RTPROP_TIME (10 * RDP_USEC)
+#define RDP_BBR_PROBE_TIME 200000
+#define RDP_BBR_PROBE_CWND 4
+#define RDP_BBR_MIN_ROUND 1000
+
+static const double rdp_bbr_gains[RDP_BBR_CYCLE] = {
+    1.25, 0.75, 1, 1, 1, 1, 1, 1
+};
+
+/*
+ * @param cc congestion controller
+ * @param now current time
+ */
+static void rdp_reno_init(struct rdp_cc *cc, unsigned long long now)
+{
+    cc->u.reno.acked = 0;
+}
+
+/*
+ * @param cc congestion controller
+ * @param acked bytes newly acknowledged
+ * @param inflight bytes in flight
+ * @param now current time
+ */
+static void rdp_reno_ack(struct rdp_cc *cc, unsigned int acked,
+    unsigned int inflight, unsigned long long now)
+{
+    // slow start
+    if (cc->cwnd < cc->ssthresh) {
+        cc->cwnd += acked;
+        return;
+    }
+
+    // congestion avoidance, one segment per window acknowledged.
+    cc->u.reno.acked += acked;
+
+    if (cc->u.reno.acked >= cc->cwnd) {
+        cc->u.reno.acked -= cc->cwnd;
+        cc->cwnd += cc->mss;
+    }
+}
+
+/*
+ * @param cc congestion controller
+ * @param inflight bytes in flight
+ * @param timeout loss detected by timeout
+ * @param now current time
+ */
+static void rdp_reno_loss(struct rdp_cc *cc, unsigned int inflight,
+    int timeout, unsigned long long now)
+{
+    cc->ssthresh = cc->cwnd / 2 > RDP_CC_MIN * cc->mss ?
+        cc->cwnd / 2 : RDP_CC_MIN * cc->mss;
+    cc->cwnd = timeout ? cc->mss : cc->ssthresh;
+    cc->u.reno.acked = 0;
+}
+
+/*
+ * @param cc congestion controller
+ * @param rtt round trip time sample
+ * @param now current time
+ */
+static void rdp_reno_rtt(struct rdp_cc *cc, unsigned int rtt,
+    unsigned long long now)
+{
+}
+
+/*
+ * @param cc congestion controller
+ * @param now current time
+ */
+static void rdp_cubic_init(struct rdp_cc *cc, unsigned long long now)
+{
+    memset(&cc->u.cubic, 0, sizeof(cc->u.cubic));
+}
+
+/*
+ * @param cc congestion controller
+ * @param acked bytes newly acknowledged
+ * @param inflight bytes in flight
+ * @param now current time
+ */
+static void rdp_cubic_ack(struct rdp_cc *cc, unsigned int acked,
+    unsigned int inflight, unsigned long long now)
+{
+    struct rdp_cubic *cubic = &cc->u.cubic;
+    double w = (double) cc->cwnd / cc->mss;
+    double rtt = cc->min_rtt ? (double) cc->min_rtt / RDP_USEC : 0.1;
+    double t, target, west;
+
+    if (cc->cwnd < cc->ssthresh) {
+        cc->cwnd += acked;
+        return;
+    }
+
+    // a congestion avoidance epoch starts after each reduction.
+    if (!cubic->epoch) {
+        cubic->epoch = now;
+
+        if (w < cubic->wmax) {
+            cubic->k = cbrt((cubic->wmax - w) / RDP_CUBIC_C);
+            cubic->origin = cubic->wmax;
+        } else {
+            cubic->k = 0;
+            cubic->origin = w;
+        }
+    }
+
+    t = (double) (now - cubic->epoch) / RDP_USEC + rtt;
+    target = cubic->origin + RDP_CUBIC_C * pow(t - cubic->k, 3);
+
+    // never slower than Reno would be.
+    west = cubic->wmax * RDP_CUBIC_BETA + 3 * (1 - RDP_CUBIC_BETA) /
+        (1 + RDP_CUBIC_BETA) * t / rtt;
+    target = target > west ? target : west;
+
+    // at most one segment per segment acknowledged.
+    if (target > w) {
+        cubic->credit += (double) acked * (target - w < w ?
+            target - w : w) / w;
+    }
+
+    if (cubic->credit >= cc->mss) {
+        cc->cwnd += (unsigned int) (cubic->credit / cc->mss) * cc->mss;
+        cubic->credit -= (unsigned int) (cubic->credit / cc->mss) * cc->mss;
+    }
+}
+
+/*
+ * @param cc congestion controller
+ * @param inflight bytes in flight
+ * @param timeout loss detected by timeout
+ * @param now current time
+ */
+static void rdp_cubic_loss(struct rdp_cc *cc, unsigned int inflight,
+    int timeout, unsigned long long now)
+{
+    struct rdp_cubic *cubic = &cc->u.cubic;
+    double w = (double) cc->cwnd / cc->mss;
+
+    // fast convergence releases bandwidth to newer flows.
+    cubic->wmax = w < cubic->wmax ? w * (1 + RDP_CUBIC_BETA) / 2 : w;
+    cubic->epoch = 0;
+    cubic->credit = 0;
+
+    cc->cwnd = cc->cwnd * RDP_CUBIC_BETA;
+    cc->cwnd = cc->cwnd > RDP_CC_MIN * cc->mss ?
+        cc->cwnd : RDP_CC_MIN * cc->mss;
+    cc->ssthresh = cc->cwnd;
+
+    if (timeout) {
+        cc->cwnd = cc->mss;
+    }
+}
+
+/*
+ * @param cc congestion controller
+ * @param now current time
+ */
+static void rdp_bbr_init(struct rdp_cc *cc, unsigned long long now)
+{
+    struct rdp_bbr *bbr = &cc->u.bbr;
+
+    memset(bbr, 0, sizeof(*bbr));
+    bbr->mode = RDP_BBR_STARTUP;
+    bbr->gain = RDP_BBR_HIGH_GAIN;
+    bbr->round = now;
+    bbr->stamp = now;
+}
+
+/*
+ * @param cc congestion controller
+ * @param acked bytes newly acknowledged
+ * @param inflight bytes in flight
+ * @param now current time
+ */
+static void rdp_bbr_ack(struct rdp_cc *cc, unsigned int acked,
+    unsigned int inflight, unsigned long long now)
+{
+    struct rdp_bbr *bbr = &cc->u.bbr;
+    unsigned int round = bbr->rtprop > RDP_BBR_MIN_ROUND ?
+        bbr->rtprop : RDP_BBR_MIN_ROUND;
+    double bdp, cwnd_gain = RDP_BBR_CWND_GAIN;
+    int i;
+
+    bbr->delivered += acked;
+
+    // a delivery rate sample per round trip, max filtered over rounds.
+    if (now - bbr->round >= round) {
+        bbr->bws[bbr->rounds++ % RDP_BBR_ROUNDS] = (double) bbr->delivered *
+            RDP_USEC / (now - bbr->round);
+        bbr->delivered = 0;
+        bbr->round = now;
+
+        for (bbr->bw = 0, i = 0; i < RDP_BBR_ROUNDS; i++) {
+            bbr->bw = bbr->bws[i] > bbr->bw ? bbr->bws[i] : bbr->bw;
+        }
+
+        // the pipe is full once bandwidth stops growing by a quarter.
+        if (bbr->mode == RDP_BBR_STARTUP) {
+            if (bbr->bw >= bbr->full_bw * 1.25) {
+                bbr->full_bw = bbr->bw;
+                bbr->full = 0;
+            } else if (++bbr->full >= 3) {
+                bbr->mode = RDP_BBR_DRAIN;
+            }
+        }
+    }
+
+    bdp = bbr->bw * bbr->rtprop / RDP_USEC;
+
+    switch (bbr->mode) {
+    case RDP_BBR_STARTUP:
+        bbr->gain = RDP_BBR_HIGH_GAIN;
+        cwnd_gain = RDP_BBR_HIGH_GAIN;
+        break;
+    case RDP_BBR_DRAIN:
+        bbr->gain = 1 / RDP_BBR_HIGH_GAIN;
+
+        if (inflight <= bdp) {
+            bbr->mode = RDP_BBR_PROBE_BW;
+            bbr->cycle = 0;
+            bbr->phase = now;
+        }
+        break;
+    case RDP_BBR_PROBE_BW:
+        if (now - bbr->phase >= round) {
+            bbr->cycle = (bbr->cycle + 1) % RDP_BBR_CYCLE;
+            bbr->phase = now;
+        }
+
+        bbr->gain = rdp_bbr_gains[bbr->cycle];
+        break;
+    case RDP_BBR_PROBE_RTT:
+        bbr->gain = 1;
+
+        if (now >= bbr->probe) {
+            bbr->stamp = now;
+            bbr->mode = bbr->full >= 3 ? RDP_BBR_PROBE_BW : RDP_BBR_STARTUP;
+            bbr->phase = now;
+        }
+        break;
+    }
+
+    // an old minimum RTT is measured again with an almost empty pipe.
+    if (bbr->mode != RDP_BBR_PROBE_RTT &&
+        now - bbr->stamp > RDP_BBR_RTPROP_TIME) {
+        bbr->mode = RDP_BBR_PROBE_RTT;
+        bbr->probe = now + RDP_BBR_PROBE_TIME;
+    }
+
+    // no model yet, grow like slow start.
+    if (!bbr->bw || !bbr->rtprop) {
+        cc->cwnd += acked;
+        return;
+    }
+
+    cc->pacing_rate = bbr->gain * bbr->bw;
+    cc->cwnd = cwnd_gain * bdp;
+
+    if (bbr->mode == RDP_BBR_PROBE_RTT ||
+        cc->cwnd < RDP_BBR_PROBE_CWND * cc->mss) {
+        cc->cwnd = RDP_BBR_PROBE_CWND * cc->mss;
+    }
+}
+
+/*
+ * @param cc congestion controller
+ * @param inflight bytes in flight
+ * @param timeout loss detected by timeout
+ * @param now current time
+ */
+static void rdp_bbr_loss(struct rdp_cc *cc, unsigned int inflight,
+    int timeout, unsigned long long now)
+{
+    // the model ignores random loss, a timeout restarts the pipe.
+    if (timeout) {
+        cc->cwnd = RDP_BBR_PROBE_CWND * cc->mss;
+    }
+}
+
+/*
+ * @param cc congestion controller
+ * @param rtt round trip time sample
+ * @param now current time
+ */
+static void rdp_bbr_rtt(struct rdp_cc *cc, unsigned int rtt,
+    unsigned long long now)
+{
+    struct rdp_bbr *bbr = &cc->u.bbr;
+
+    if (!bbr->rtprop || rtt <= bbr->rtprop ||
+        now - bbr->stamp > RDP_BBR_RTPROP_TIME) {
+        bbr->rtprop = rtt;
+        bbr->stamp = now;
+    }
+}
+
+static const struct rdp_cc_ops rdp_reno = {
+    "newreno", rdp_reno_init, rdp_reno_ack, rdp_reno_loss, rdp_reno_rtt
+};
+
+static const struct rdp_cc_ops rdp_cubic = {
+    "cubic", rdp_cubic_init, rdp_cubic_ack, rdp_cubic_loss, rdp_reno_rtt
+};
+
+static const struct rdp_cc_ops rdp_bbr = {
+    "bbr", rdp_bbr_init, rdp_bbr_ack, rdp_bbr_loss, rdp_bbr_rtt
+};
+
+const struct rdp_cc_ops *rdp_ccs[RDP_CC_COUNT] = {
+    &rdp_reno,
+    &rdp_cubic,
+    &rdp_bbr
+};
+
+/*
+ * @param name algorithm name
+ * @return const struct rdp_cc_ops * algorithm, NULL for unknown
+ */
+const struct rdp_cc_ops *rdp_cc_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < RDP_CC_COUNT; i++) {
+        if (!strcasecmp(name, rdp_ccs[i]->name)) {
+            return rdp_ccs[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * @param cc congestion controller
+ * @param ops algorithm, NULL for NewReno
+ * @param mss largest payload
+ * @param now current time
+ */
+void rdp_cc_init(struct rdp_cc *cc, const struct rdp_cc_ops *ops,
+    unsigned int mss, unsigned long long now)
+{
+    cc->ops = ops ? ops : &rdp_reno;
+    cc->mss = mss;
+    cc->cwnd = RDP_CC_INIT * mss;
+    cc->ssthresh = UINT_MAX;
+    cc->min_rtt = 0;
+    cc->rtt = 0;
+    cc->pacing_rate = 0;
+    cc->ops->init(cc, now);
+}
+
+/*
+ * @param cc congestion controller
+ * @param acked bytes newly acknowledged
+ * @param inflight bytes in flight
+ * @param now current time
+ */
+void rdp_cc_ack(struct rdp_cc *cc, unsigned int acked, unsigned int inflight,
+    unsigned long long now)
+{
+    cc->ops->on_ack(cc, acked, inflight, now);
+    cc->cwnd = cc->cwnd < RDP_CC_MAX ? cc->cwnd : RDP_CC_MAX;
+}
+
+/*
+ * @param cc congestion controller
+ * @param inflight bytes in flight
+ * @param timeout loss detected by timeout
+ * @param now current time
+ */
+void rdp_cc_loss(struct rdp_cc *cc, unsigned int inflight, int timeout,
+    unsigned long long now)
+{
+    cc->ops->on_loss(cc, inflight, timeout, now);
+}
+
+/*
+ * @param cc congestion controller
+ * @param rtt round trip time sample
+ * @param now current time
+ */
+void rdp_cc_rtt(struct rdp_cc *cc, unsigned int rtt, unsigned long long now)
+{
+    cc->rtt = rtt;
+    cc->min_rtt = !cc->min_rtt || rtt < cc->min_rtt ? rtt : cc->min_rtt;
+    cc->ops->on_rtt_sample(cc, rtt, now);
+}
+
+/*
+ * @param cc congestion controller
+ * @return unsigned int congestion window in bytes
+ */
+unsigned int rdp_cc_cwnd(const struct rdp_cc *cc)
+{
+    return cc->cwnd;
+}
+
+/*
+ * @param cc congestion controller
+ * @return double pacing rate in bytes/s, 0 before the first RTT sample
+ */
+double rdp_cc_pacing_rate(const struct rdp_cc *cc)
+{
+    // a model based algorithm sets its own, a window spreads over an RTT.
+    if (cc->pacing_rate > 0 || !cc->rtt) {
+        return cc->pacing_rate;
+    }
+
+    return (cc->cwnd < cc->ssthresh ? RDP_CC_PACE_SS : RDP_CC_PACE_CA) *
+        cc->cwnd * 1e6 / cc->rtt;
+}
@@ -0,0 +1,96 @@
+#ifndef RDP_CC_H
+#define RDP_CC_H
+
+// segments in the initial congestion window.
+#define RDP_CC_INIT 10
+#define RDP_CC_MIN 2
+
+// largest congestion window in bytes.
+#define RDP_CC_MAX (1 << 26)
+
+#define RDP_CC_COUNT 3
+
+// window algorithms pace at cwnd per RTT times these, in slow start and
+// after it.
+#define RDP_CC_PACE_SS 2.0
+#define RDP_CC_PACE_CA 1.25
+
+// rounds in the BBR bandwidth filter.
+#define RDP_BBR_ROUNDS 10
+
+struct rdp_cc;
+
+// RDP congestion control algorithm
+struct rdp_cc_ops {
+    const char *name;
+    void (*init)(struct rdp_cc *cc, unsigned long long now);
+    void (*on_ack)(struct rdp_cc *cc, unsigned int acked,
+        unsigned int inflight, unsigned long long now);
+    void (*on_loss)(struct rdp_cc *cc, unsigned int inflight, int timeout,
+        unsigned long long now);
+    void (*on_rtt_sample)(struct rdp_cc *cc, unsigned int rtt,
+        unsigned long long now);
+};
+
+// NewReno state
+struct rdp_reno {
+    unsigned int acked;
+};
+
+// CUBIC state, windows in segments.
+struct rdp_cubic {
+    double wmax;
+    double k;
+    double origin;
+    double credit;
+    unsigned long long epoch;
+};
+
+// BBR state, bandwidth in bytes/s.
+struct rdp_bbr {
+    int mode;
+    int cycle;
+    int full;
+    double gain;
+    double bw;
+    double full_bw;
+    double bws[RDP_BBR_ROUNDS];
+    unsigned int rounds;
+    unsigned int delivered;
+    unsigned int rtprop;
+    unsigned long long round;
+    unsigned long long phase;
+    unsigned long long stamp;
+    unsigned long long probe;
+};
+
+// RDP congestion controller, windows in bytes, rates in bytes/s.
+struct rdp_cc {
+    const struct rdp_cc_ops *ops;
+    unsigned int mss;
+    unsigned int cwnd;
+    unsigned int ssthresh;
+    unsigned int min_rtt;
+    unsigned int rtt;
+    double pacing_rate;
+    union {
+        struct rdp_reno reno;
+        struct rdp_cubic cubic;
+        struct rdp_bbr bbr;
+    } u;
+};
+
+extern const struct rdp_cc_ops *rdp_ccs[RDP_CC_COUNT];
+
+const struct rdp_cc_ops *rdp_cc_find(const char *name);
+void rdp_cc_init(struct rdp_cc *cc, const struct rdp_cc_ops *ops,
+    unsigned int mss, unsigned long long now);
+void rdp_cc_ack(struct rdp_cc *cc, unsigned int acked, unsigned int inflight,
+    unsigned long long now);
+void rdp_cc_loss(struct rdp_cc *cc, unsigned int inflight, int timeout,
+    unsigned long long now);
+void rdp_cc_rtt(struct rdp_cc *cc, unsigned int rtt, unsigned long long now);
+unsigned int rdp_cc_cwnd(const struct rdp_cc *cc);
+double rdp_cc_pacing_rate(const struct rdp_cc *cc);
+
+#endif // RDP_CC_H
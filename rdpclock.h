@@ -0,0 +1,19 @@
+#ifndef RDP_CLOCK_H
+#define RDP_CLOCK_H
+
+#include <time.h>
+
+#define RDP_USEC 1000000ULL
+
+/*
+ * @return unsigned long long monotonic time in microseconds
+ */
+static inline unsigned long long rdp_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * RDP_USEC + ts.tv_nsec / 1000;
+}
+
+#endif // RDP_CLOCK_H
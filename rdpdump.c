@@ -0,0 +1,97 @@
+/**
+ * RDP binary packet log decoder
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rdpclock.h"
+#include "rdplog.h"
+#include "rdppkt.h"
+
+#define RDP_ADDR_LEN 16
+
+/*
+ * Print a record the way the text packet log always has.
+ *
+ * @param event packet event record
+ * @param epoch wall clock minus record clock
+ */
+void rdp_dump(const struct rdp_event *event, unsigned long long epoch)
+{
+    char sndaddr[RDP_ADDR_LEN];
+    char recvaddr[RDP_ADDR_LEN];
+    unsigned long long time = event->time + epoch;
+    unsigned long long sec = time / RDP_USEC;
+    unsigned int h, m, s, us;
+
+    // Time format
+    h = (sec / 3600 - 8) % 24;
+    m = sec / 60 % 60;
+    s = sec % 60;
+    us = time % RDP_USEC;
+
+    // IP addresses.
+    inet_ntop(AF_INET, &event->saddr, sndaddr, sizeof(sndaddr));
+    inet_ntop(AF_INET, &event->daddr, recvaddr, sizeof(recvaddr));
+
+    // packet log
+    switch (event->type) {
+    case RDP_ACK:
+    case RDP_DAT:
+    case RDP_FEC:
+        printf("%02u:%02u:%02u.%d %c %s:%d %s:%d %s %llu %u\n", h, m, s, us,
+            event->event, sndaddr, ntohs(event->sport), recvaddr,
+            ntohs(event->dport), rdp_types[event->type], event->number,
+            event->info);
+        break;
+    case RDP_FIN:
+    case RDP_SYN:
+        printf("%02u:%02u:%02u.%d %c %s:%d %s:%d %s %llu\n", h, m, s, us,
+            event->event, sndaddr, ntohs(event->sport), recvaddr,
+            ntohs(event->dport), rdp_types[event->type], event->number);
+        break;
+    case RDP_RST:
+        printf("%02u:%02u:%02u.%d %c %s:%d %s:%d %s\n", h, m, s, us,
+            event->event, sndaddr, ntohs(event->sport), recvaddr,
+            ntohs(event->dport), rdp_types[event->type]);
+        break;
+    default:
+        fprintf(stderr, "invalid packet\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct rdp_log_header header;
+    struct rdp_event event;
+    FILE *file;
+
+    if (argc < 2) {
+        printf("usage: %s log_file_name\n", *argv);
+        exit(EXIT_FAILURE);
+    }
+
+    file = fopen(argv[1], "rb");
+
+    if (!file) {
+        perror(argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, RDP_LOG_MAGIC, sizeof(RDP_LOG_MAGIC)) ||
+        header.size != sizeof(event)) {
+        fprintf(stderr, "%s: not an rdp packet log\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    while (fread(&event, sizeof(event), 1, file) == 1) {
+        rdp_dump(&event, header.epoch);
+    }
+
+    fclose(file);
+
+    return 0;
+}
@@ -0,0 +1,321 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "rdpclock.h"
+#include "rdpexport.h"
+
+// RDP counter, exported as rdp_<name>_total or under its name in JSON.
+struct rdp_counter {
+    const char *name;
+    const char *help;
+    size_t offset;
+};
+
+// statistics file contents, what rdp_export_write() gets from rdp_replace().
+struct rdp_export_file {
+    const struct rdp_stats *stats;
+    const char *role;
+    int json;                   // JSON, else the Prometheus text format
+};
+
+static const struct rdp_counter rdp_counters[] = {
+    {"data_bytes", "data bytes, retransmissions included",
+        offsetof(struct rdp_stats, tbytes)},
+    {"unique_data_bytes", "data bytes new to the receiver",
+        offsetof(struct rdp_stats, ubytes)},
+    {"data_packets", "data packets, retransmissions included",
+        offsetof(struct rdp_stats, tpkts)},
+    {"unique_data_packets", "data packets new to the receiver",
+        offsetof(struct rdp_stats, upkts)},
+    {"ack_packets", "ACK packets", offsetof(struct rdp_stats, ack)},
+    {"syn_packets", "SYN packets", offsetof(struct rdp_stats, syn)},
+    {"fin_packets", "FIN packets", offsetof(struct rdp_stats, fin)},
+    {"rst_sent_packets", "RST packets sent", offsetof(struct rdp_stats, rts)},
+    {"rst_received_packets", "RST packets received",
+        offsetof(struct rdp_stats, rtr)},
+    {"sent_batches", "sendmmsg batches", offsetof(struct rdp_stats, sbatch)},
+    {"sent_datagrams", "datagrams sent", offsetof(struct rdp_stats, smsgs)},
+    {"received_batches", "recvmmsg batches",
+        offsetof(struct rdp_stats, rbatch)},
+    {"received_datagrams", "datagrams received",
+        offsetof(struct rdp_stats, rmsgs)},
+    {"zerocopy_sends", "sends with MSG_ZEROCOPY",
+        offsetof(struct rdp_stats, zsends)},
+    {"zerocopy_copied", "zero-copy sends the kernel copied",
+        offsetof(struct rdp_stats, zcopied)},
+    {"gso_sends", "sends split by the kernel",
+        offsetof(struct rdp_stats, gsends)},
+    {"gro_receives", "buffers of coalesced datagrams",
+        offsetof(struct rdp_stats, grecvs)},
+    {"uring_enters", "io_uring_enter calls",
+        offsetof(struct rdp_stats, enters)},
+    {"acks_suppressed", "segments acknowledged by a later ACK",
+        offsetof(struct rdp_stats, acksup)},
+    {"fec_packets", "FEC parity packets", offsetof(struct rdp_stats, fecs)},
+    {"fec_rebuilt", "segments rebuilt from parity",
+        offsetof(struct rdp_stats, rebuilt)},
+    {"compressed_bytes", "compressed blocks, headers included",
+        offsetof(struct rdp_stats, packed)},
+    {"uncompressed_bytes", "bytes the compressed blocks hold",
+        offsetof(struct rdp_stats, unpacked)},
+    {"paced_bytes", "bytes sent by the pacer",
+        offsetof(struct rdp_stats, paced)},
+    {"paced_microseconds", "time the paced bytes took",
+        offsetof(struct rdp_stats, pacetime)},
+    {"planned_bytes", "bytes the pacing rate allowed",
+        offsetof(struct rdp_stats, planned)},
+};
+
+#define RDP_COUNTERS (sizeof(rdp_counters) / sizeof(rdp_counters[0]))
+
+// quantiles exported for each histogram.
+static const double rdp_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+#define RDP_QUANTILES (sizeof(rdp_quantiles) / sizeof(rdp_quantiles[0]))
+
+/*
+ * @param stats statistics
+ * @param counter counter of the table
+ * @return unsigned long long its value
+ */
+static unsigned long long rdp_counter_value(const struct rdp_stats *stats,
+    const struct rdp_counter *counter)
+{
+    return *(const unsigned long long *) ((const char *) stats +
+        counter->offset);
+}
+
+/*
+ * @param stats statistics
+ * @return double bytes/s of the latest interval of the series that ended
+ */
+static double rdp_export_rate(const struct rdp_stats *stats)
+{
+    const struct rdp_series *series = &stats->series;
+    unsigned int i;
+
+    if (!series->count) {
+        return 0.0;
+    }
+
+    // the newest interval of a transfer still running is partial.
+    i = series->count - (!stats->end && series->count > 1 ? 2 : 1);
+    return (double) series->bytes[i] * RDP_USEC / series->step;
+}
+
+/*
+ * @param file output
+ * @param name key of the histogram
+ * @param hist histogram
+ * @param last 1: no member follows
+ */
+static void rdp_export_hist_json(FILE *file, const char *name,
+    const struct rdp_hist *hist, int last)
+{
+    unsigned int i, first = 1;
+
+    fprintf(file, "  \"%s\": {\"count\": %llu, \"sum\": %llu, "
+        "\"min\": %u, \"max\": %u", name, hist->count, hist->sum,
+        hist->min, hist->max);
+
+    for (i = 0; i < RDP_QUANTILES; i++) {
+        fprintf(file, ", \"p%g\": %u", rdp_quantiles[i] * 100,
+            rdp_hist_quantile(hist, rdp_quantiles[i]));
+    }
+
+    // buckets as [largest value, count], the empty ones left out.
+    fprintf(file, ", \"buckets\": [");
+
+    for (i = 0; i < RDP_HIST_BUCKETS; i++) {
+        if (hist->buckets[i]) {
+            fprintf(file, "%s[%u, %llu]", first ? "" : ", ",
+                rdp_hist_upper(i), hist->buckets[i]);
+            first = 0;
+        }
+    }
+
+    fprintf(file, "]}%s\n", last ? "" : ",");
+}
+
+/*
+ * @param file output
+ * @param stats statistics
+ * @param role sender, receiver or server
+ */
+static void rdp_export_json(FILE *file, const struct rdp_stats *stats,
+    const char *role)
+{
+    unsigned long long now = stats->end ? stats->end : rdp_clock();
+    unsigned int i;
+
+    fprintf(file, "{\n  \"role\": \"%s\",\n", role);
+    fprintf(file, "  \"running\": %s,\n", stats->end ? "false" : "true");
+    fprintf(file, "  \"elapsed_us\": %llu,\n", stats->begin ?
+        now - stats->begin : 0);
+    fprintf(file, "  \"flows\": %u,\n", stats->flows ? stats->flows : 1);
+
+    for (i = 0; i < RDP_COUNTERS; i++) {
+        fprintf(file, "  \"%s\": %llu,\n", rdp_counters[i].name,
+            rdp_counter_value(stats, &rdp_counters[i]));
+    }
+
+    fprintf(file, "  \"throughput_bytes_per_second\": %.0f,\n",
+        rdp_export_rate(stats));
+    rdp_export_hist_json(file, "rtt_us", &stats->rtt, 0);
+    rdp_export_hist_json(file, "ack_delay_us", &stats->ackdelay, 0);
+    fprintf(file, "  \"series\": {\"step_us\": %llu, \"bytes\": [",
+        stats->series.step);
+
+    for (i = 0; i < stats->series.count; i++) {
+        fprintf(file, "%s%llu", i ? ", " : "", stats->series.bytes[i]);
+    }
+
+    fprintf(file, "]}\n}\n");
+}
+
+/*
+ * Buckets are cumulative at each power of two, a set of bounds that stays
+ * the same from one scrape to the next.
+ *
+ * @param file output
+ * @param name metric name
+ * @param help metric description
+ * @param hist histogram
+ * @param role sender, receiver or server
+ */
+static void rdp_export_hist_prom(FILE *file, const char *name,
+    const char *help, const struct rdp_hist *hist, const char *role)
+{
+    unsigned long long seen = 0;
+    unsigned int i;
+
+    fprintf(file, "# HELP rdp_%s %s\n", name, help);
+    fprintf(file, "# TYPE rdp_%s histogram\n", name);
+
+    for (i = 0; i < RDP_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+
+        if ((i + 1) % RDP_HIST_SUB == 0) {
+            fprintf(file, "rdp_%s_bucket{role=\"%s\",le=\"%u\"} %llu\n",
+                name, role, rdp_hist_upper(i), seen);
+        }
+    }
+
+    fprintf(file, "rdp_%s_bucket{role=\"%s\",le=\"+Inf\"} %llu\n", name,
+        role, hist->count);
+    fprintf(file, "rdp_%s_sum{role=\"%s\"} %llu\n", name, role, hist->sum);
+    fprintf(file, "rdp_%s_count{role=\"%s\"} %llu\n", name, role,
+        hist->count);
+}
+
+/*
+ * @param file output
+ * @param stats statistics
+ * @param role sender, receiver or server
+ */
+static void rdp_export_prom(FILE *file, const struct rdp_stats *stats,
+    const char *role)
+{
+    unsigned long long now = stats->end ? stats->end : rdp_clock();
+    unsigned int i;
+
+    for (i = 0; i < RDP_COUNTERS; i++) {
+        fprintf(file, "# HELP rdp_%s_total %s\n", rdp_counters[i].name,
+            rdp_counters[i].help);
+        fprintf(file, "# TYPE rdp_%s_total counter\n", rdp_counters[i].name);
+        fprintf(file, "rdp_%s_total{role=\"%s\"} %llu\n",
+            rdp_counters[i].name, role,
+            rdp_counter_value(stats, &rdp_counters[i]));
+    }
+
+    fprintf(file, "# HELP rdp_elapsed_seconds time since the transfer "
+        "began\n# TYPE rdp_elapsed_seconds gauge\n");
+    fprintf(file, "rdp_elapsed_seconds{role=\"%s\"} %.6f\n", role,
+        stats->begin ? (double) (now - stats->begin) / RDP_USEC : 0.0);
+    fprintf(file, "# HELP rdp_throughput_bytes_per_second data rate of "
+        "the latest interval\n# TYPE rdp_throughput_bytes_per_second "
+        "gauge\n");
+    fprintf(file, "rdp_throughput_bytes_per_second{role=\"%s\"} %.0f\n",
+        role, rdp_export_rate(stats));
+    rdp_export_hist_prom(file, "rtt_microseconds", "round trip times",
+        &stats->rtt, role);
+    rdp_export_hist_prom(file, "ack_delay_microseconds",
+        "time ACKs were held back", &stats->ackdelay, role);
+}
+
+/*
+ * The file is written beside its name and renamed over it, a reader never
+ * sees half of it and an interrupted write leaves the previous one.
+ *
+ * @param path file to replace
+ * @param writer writes the contents
+ * @param arg passed on to writer
+ * @return int 0: written, -1: failed
+ */
+int rdp_replace(const char *path, void (*writer)(FILE *, const void *),
+    const void *arg)
+{
+    char tmp[RDP_EXPORT_PATH];
+    FILE *file;
+    int failed;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp)) {
+        fprintf(stderr, "%s: name too long\n", path);
+        return -1;
+    }
+
+    file = fopen(tmp, "w");
+
+    if (!file) {
+        perror(tmp);
+        return -1;
+    }
+
+    writer(file, arg);
+    failed = ferror(file);
+
+    if (fclose(file) || failed || rename(tmp, path)) {
+        perror(path);
+        remove(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * @param file statistics file
+ * @param arg struct rdp_export_file to write
+ */
+static void rdp_export_write(FILE *file, const void *arg)
+{
+    const struct rdp_export_file *out = arg;
+
+    if (out->json) {
+        rdp_export_json(file, out->stats, out->role);
+    } else {
+        rdp_export_prom(file, out->stats, out->role);
+    }
+}
+
+/*
+ * A name ending in .json gets JSON, anything else the Prometheus text
+ * format.
+ *
+ * @param stats statistics
+ * @param role sender, receiver or server
+ * @param path statistics file
+ * @return int 0: written, -1: failed
+ */
+int rdp_export(const struct rdp_stats *stats, const char *role,
+    const char *path)
+{
+    size_t length = strlen(path);
+    struct rdp_export_file out;
+
+    out.stats = stats;
+    out.role = role;
+    out.json = length > 5 && !strcmp(path + length - 5, ".json");
+
+    return rdp_replace(path, rdp_export_write, &out);
+}
@@ -0,0 +1,18 @@
+#ifndef RDP_EXPORT_H
+#define RDP_EXPORT_H
+
+#include <stdio.h>
+#include "rdp.h"
+
+// time between rewrites of a statistics file, microseconds.
+#define RDP_EXPORT_EVERY 1000000
+
+// longest name of a file rdp_replace() writes, the temporary one included.
+#define RDP_EXPORT_PATH 4096
+
+int rdp_replace(const char *path, void (*writer)(FILE *, const void *),
+    const void *arg);
+int rdp_export(const struct rdp_stats *stats, const char *role,
+    const char *path);
+
+#endif // RDP_EXPORT_H
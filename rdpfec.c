@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rdpfec.h"
+
+/*
+ * @param slots blocks summed at once, 1 for a sender
+ * @param size largest payload of a segment
+ * @param length data segments per block, sender only
+ * @param parity parity segments per block, 0 adapts to loss, sender only
+ * @return struct rdp_fec * encoder or decoder, NULL failed
+ */
+struct rdp_fec *rdp_fec_new(unsigned int slots, unsigned int size,
+    unsigned int length, unsigned int parity)
+{
+    struct rdp_fec *fec = calloc(1, sizeof(*fec));
+    unsigned int i;
+
+    if (!fec) {
+        perror("calloc");
+        return NULL;
+    }
+
+    fec->length = length < RDP_FEC_LENGTH ? length : RDP_FEC_LENGTH;
+    fec->parity = parity < RDP_FEC_PARITY ? parity : RDP_FEC_PARITY;
+    fec->stripes = fec->parity ? fec->parity : 1;
+    fec->size = size;
+    fec->slots = slots;
+    fec->blocks = calloc(slots, sizeof(*fec->blocks));
+
+    for (i = 0; fec->blocks && i < slots; i++) {
+        fec->blocks[i].sums = malloc(RDP_FEC_PARITY * size);
+
+        if (!fec->blocks[i].sums) {
+            break;
+        }
+    }
+
+    if (!fec->blocks || i < slots) {
+        perror("malloc");
+        rdp_fec_free(fec);
+        return NULL;
+    }
+
+    return fec;
+}
+
+/*
+ * @param fec encoder or decoder, may be NULL
+ */
+void rdp_fec_free(struct rdp_fec *fec)
+{
+    unsigned int i;
+
+    if (!fec) {
+        return;
+    }
+
+    for (i = 0; fec->blocks && i < fec->slots; i++) {
+        free(fec->blocks[i].sums);
+    }
+
+    free(fec->blocks);
+    free(fec);
+}
+
+/*
+ * @param sum running XOR
+ * @param data payload added to it
+ * @param length payload length
+ */
+static void rdp_fec_xor(char *sum, const char *data, unsigned int length)
+{
+    unsigned long long word, add;
+    unsigned int i;
+
+    // whole words, the compiler widens the loop to vector registers.
+    for (i = 0; i + sizeof(word) <= length; i += sizeof(word)) {
+        memcpy(&word, sum + i, sizeof(word));
+        memcpy(&add, data + i, sizeof(add));
+        word ^= add;
+        memcpy(sum + i, &word, sizeof(word));
+    }
+
+    for (; i < length; i++) {
+        sum[i] ^= data[i];
+    }
+}
+
+/*
+ * @param block block, its sums cleared
+ * @param id block number
+ * @param size payload of every segment
+ * @param parity stripes
+ */
+static void rdp_fec_open(struct rdp_fec_block *block, unsigned int id,
+    unsigned int size, unsigned int parity)
+{
+    block->id = id;
+    block->size = size;
+    block->parity = parity;
+    block->count = 0;
+    block->parities = 0;
+    block->done = 0;
+    block->have = 0;
+    memset(block->sums, 0, parity * size);
+}
+
+/*
+ * @param fec encoder
+ * @param length payload of the next new segment
+ * @return int 1: the open block, if any, takes it, 0: seal the block first
+ */
+int rdp_fec_fits(const struct rdp_fec *fec, unsigned int length)
+{
+    return !fec->open || (length == fec->blocks->size &&
+        fec->blocks->count < fec->length);
+}
+
+/*
+ * @param fec encoder, a block opened unless one takes the segment
+ * @param packet data packet, tagged with its place in the block
+ * @param data payload, summed into its stripe
+ */
+void rdp_fec_add(struct rdp_fec *fec, struct rdp_packet *packet,
+    const char *data)
+{
+    struct rdp_fec_block *block = fec->blocks;
+
+    if (!fec->open) {
+        rdp_fec_open(block, ++fec->serial ? fec->serial : ++fec->serial,
+            packet->info, fec->stripes < fec->length ? fec->stripes :
+            fec->length);
+        block->base = packet->number;
+        fec->open = 1;
+    }
+
+    packet->tag.block = block->id;
+    packet->tag.index = block->count;
+    packet->tag.count = 0;
+    packet->tag.parity = block->parity;
+
+    rdp_fec_xor(block->sums + block->count % block->parity * block->size,
+        data, packet->info);
+    block->count++;
+}
+
+/*
+ * @param fec encoder
+ * @return int 1: the open block is full
+ */
+int rdp_fec_full(const struct rdp_fec *fec)
+{
+    return fec->open && fec->blocks->count == fec->length;
+}
+
+/*
+ * @param fec encoder, its open block closed
+ * @return unsigned int parity segments to send, 0 when none was open
+ */
+unsigned int rdp_fec_seal(struct rdp_fec *fec)
+{
+    if (!fec->open) {
+        return 0;
+    }
+
+    fec->open = 0;
+    return fec->blocks->parity;
+}
+
+/*
+ * @param fec encoder, its block sealed
+ * @param stripe parity segment, below what rdp_fec_seal returned
+ * @param packet filled as the parity packet
+ * @return const char * its payload, valid until the next block opens
+ */
+const char *rdp_fec_parity(struct rdp_fec *fec, unsigned int stripe,
+    struct rdp_packet *packet)
+{
+    struct rdp_fec_block *block = fec->blocks;
+
+    packet->type = RDP_FEC;
+    packet->number = block->base;
+    packet->info = block->size;
+    packet->caps = 0;
+    packet->sacks = 0;
+    packet->tag.block = block->id;
+    packet->tag.index = stripe;
+    packet->tag.count = block->count;
+    packet->tag.parity = block->parity;
+
+    return block->sums + stripe * block->size;
+}
+
+/*
+ * Loss rebuilt by parity is never resent, so the share resent is a floor
+ * of the loss; twice the segments expected lost per block are sent.
+ *
+ * @param fec encoder, parity of the blocks it opens from now on adapted
+ * @param resent segments sent again
+ * @param sent segments sent once
+ */
+void rdp_fec_adapt(struct rdp_fec *fec, unsigned long long resent,
+    unsigned long long sent)
+{
+    unsigned long long stripes;
+
+    if (fec->parity || !sent) {
+        return;
+    }
+
+    stripes = 1 + 2ULL * resent * fec->length / sent;
+    fec->stripes = stripes < RDP_FEC_PARITY ? stripes : RDP_FEC_PARITY;
+}
+
+/*
+ * @param fec decoder
+ * @param packet data or parity packet of a block
+ * @param length payload bytes received
+ * @param rebuilt filled as the data packet of a segment rebuilt
+ * @return int 1: a lost segment was rebuilt, 0: none
+ */
+int rdp_fec_decode(struct rdp_fec *fec, const struct rdp_packet *packet,
+    unsigned int length, struct rdp_packet *rebuilt)
+{
+    const struct rdp_tag *tag = &packet->tag;
+    struct rdp_fec_block *block = &fec->blocks[tag->block % fec->slots];
+    unsigned int stripe, missing = 0, absent = 0, i;
+
+    if (!tag->block || !tag->parity || tag->parity > RDP_FEC_PARITY ||
+        tag->index >= RDP_FEC_LENGTH || tag->count > RDP_FEC_LENGTH ||
+        length != packet->info || !length || length > fec->size) {
+        return 0;
+    }
+
+    // a block late enough to share its slot with a newer one is dropped.
+    if (block->id && (int) (tag->block - block->id) < 0) {
+        return 0;
+    }
+
+    // any packet of a block tells its size and where it starts.
+    if (block->id != tag->block) {
+        rdp_fec_open(block, tag->block, length, tag->parity);
+        block->base = packet->number - (packet->type == RDP_DAT ?
+            tag->index * length : 0);
+    }
+
+    if (length != block->size || tag->parity != block->parity) {
+        return 0;
+    }
+
+    if (packet->type == RDP_DAT) {
+        stripe = tag->index % block->parity;
+
+        if (block->have & 1ULL << tag->index) {
+            return 0;
+        }
+
+        block->have |= 1ULL << tag->index;
+    } else {
+        stripe = tag->index;
+
+        if (stripe >= block->parity || block->parities & 1u << stripe) {
+            return 0;
+        }
+
+        block->parities |= 1u << stripe;
+        block->count = tag->count;
+    }
+
+    if (block->done & 1u << stripe) {
+        return 0;
+    }
+
+    rdp_fec_xor(block->sums + stripe * block->size, packet->data, length);
+
+    if (!block->count || !(block->parities & 1u << stripe)) {
+        return 0;
+    }
+
+    // with one segment of the stripe missing its sum is that segment.
+    for (i = stripe; i < block->count; i += block->parity) {
+        if (!(block->have & 1ULL << i)) {
+            missing = i;
+            absent++;
+        }
+    }
+
+    if (absent != 1) {
+        return 0;
+    }
+
+    block->done |= 1u << stripe;
+    block->have |= 1ULL << missing;
+
+    memset(rebuilt, 0, sizeof(*rebuilt));
+    rebuilt->type = RDP_DAT;
+    rebuilt->number = block->base + missing * block->size;
+    rebuilt->info = block->size;
+    rebuilt->data = block->sums + stripe * block->size;
+    return 1;
+}
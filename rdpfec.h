@@ -0,0 +1,59 @@
+#ifndef RDP_FEC_H
+#define RDP_FEC_H
+
+#include "rdppkt.h"
+
+// data segments of a block at most, one bit each.
+#define RDP_FEC_LENGTH 64
+
+// parity segments of a block at most, each the sum of one stripe.
+#define RDP_FEC_PARITY 4
+
+// blocks a receiver sums at once, by block number.
+#define RDP_FEC_SLOTS 64
+
+// RDP FEC block. Segment i of a block belongs to stripe i % parity, and
+// parity segment j is the XOR of the segments of stripe j, so one loss
+// per stripe is rebuilt without a round trip. The segments of a block
+// are consecutive and of one size, which tells where a lost one goes.
+struct rdp_fec_block {
+    unsigned int id;            // block number, 0 for none
+    unsigned long long base;    // sequence number of segment 0
+    unsigned int size;          // payload of every segment
+    unsigned int count;         // data segments, 0 until a parity tells
+    unsigned int parity;        // stripes
+    unsigned int parities;      // parity segments received, by stripe
+    unsigned int done;          // stripes rebuilt
+    unsigned long long have;    // data segments summed, by index
+    char *sums;                 // parity * size bytes
+};
+
+// RDP forward error correction, the encoder of a sender or the decoder
+// of a receiver.
+struct rdp_fec {
+    unsigned int length;        // data segments per block, sender
+    unsigned int parity;        // parity segments per block, 0 adapts
+    unsigned int stripes;       // parity of the next block opened
+    unsigned int size;          // largest payload summed
+    unsigned int serial;        // number of the last block opened
+    unsigned int slots;
+    int open;                   // the sender's block takes segments
+    struct rdp_fec_block *blocks;
+};
+
+struct rdp_fec *rdp_fec_new(unsigned int slots, unsigned int size,
+    unsigned int length, unsigned int parity);
+void rdp_fec_free(struct rdp_fec *fec);
+int rdp_fec_fits(const struct rdp_fec *fec, unsigned int length);
+void rdp_fec_add(struct rdp_fec *fec, struct rdp_packet *packet,
+    const char *data);
+int rdp_fec_full(const struct rdp_fec *fec);
+unsigned int rdp_fec_seal(struct rdp_fec *fec);
+const char *rdp_fec_parity(struct rdp_fec *fec, unsigned int stripe,
+    struct rdp_packet *packet);
+void rdp_fec_adapt(struct rdp_fec *fec, unsigned long long resent,
+    unsigned long long sent);
+int rdp_fec_decode(struct rdp_fec *fec, const struct rdp_packet *packet,
+    unsigned int length, struct rdp_packet *rebuilt);
+
+#endif // RDP_FEC_H
@@ -0,0 +1,183 @@
+#include <string.h>
+#include "rdphist.h"
+
+/*
+ * @param value value to file
+ * @return unsigned int bucket holding it
+ */
+static unsigned int rdp_hist_bucket(unsigned int value)
+{
+    unsigned int top;
+
+    if (value < RDP_HIST_SUB) {
+        return value;
+    }
+
+    // the highest bit picks the power of two, the next ones the sub-bucket.
+    top = 31 - __builtin_clz(value);
+    return (top - RDP_HIST_BITS + 1) * RDP_HIST_SUB +
+        (value >> (top - RDP_HIST_BITS)) - RDP_HIST_SUB;
+}
+
+/*
+ * @param bucket bucket of a histogram
+ * @return unsigned int largest value the bucket holds
+ */
+unsigned int rdp_hist_upper(unsigned int bucket)
+{
+    unsigned int top, lead;
+
+    if (bucket < RDP_HIST_SUB) {
+        return bucket;
+    }
+
+    top = bucket / RDP_HIST_SUB + RDP_HIST_BITS - 1;
+    lead = bucket % RDP_HIST_SUB + RDP_HIST_SUB;
+    return (((unsigned long long) lead + 1) << (top - RDP_HIST_BITS)) - 1;
+}
+
+/*
+ * @param hist histogram
+ * @param value sample, microseconds for the latencies
+ */
+void rdp_hist_add(struct rdp_hist *hist, unsigned int value)
+{
+    if (!hist->count || value < hist->min) {
+        hist->min = value;
+    }
+
+    if (value > hist->max) {
+        hist->max = value;
+    }
+
+    hist->count++;
+    hist->sum += value;
+    hist->buckets[rdp_hist_bucket(value)]++;
+}
+
+/*
+ * @param hist histogram
+ * @param q quantile, 0.5 for the median
+ * @return unsigned int upper bound of the bucket the quantile falls in,
+ * 0 for an empty histogram
+ */
+unsigned int rdp_hist_quantile(const struct rdp_hist *hist, double q)
+{
+    unsigned long long rank = q * hist->count + 0.5;
+    unsigned long long seen = 0;
+    unsigned int i, upper;
+
+    rank = rank ? rank : 1;
+
+    for (i = 0; i < RDP_HIST_BUCKETS && hist->count; i++) {
+        seen += hist->buckets[i];
+
+        if (seen >= rank) {
+            upper = rdp_hist_upper(i);
+            return upper < hist->max ? upper : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+/*
+ * @param sum histogram holding the sums
+ * @param add histogram added to it
+ */
+void rdp_hist_merge(struct rdp_hist *sum, const struct rdp_hist *add)
+{
+    unsigned int i;
+
+    if (!add->count) {
+        return;
+    }
+
+    if (!sum->count || add->min < sum->min) {
+        sum->min = add->min;
+    }
+
+    if (add->max > sum->max) {
+        sum->max = add->max;
+    }
+
+    sum->count += add->count;
+    sum->sum += add->sum;
+
+    for (i = 0; i < RDP_HIST_BUCKETS; i++) {
+        sum->buckets[i] += add->buckets[i];
+    }
+}
+
+/*
+ * @param series throughput series, its intervals joined in pairs
+ */
+static void rdp_series_fold(struct rdp_series *series)
+{
+    unsigned int i;
+
+    for (i = 0; i < RDP_SERIES_SAMPLES / 2; i++) {
+        series->bytes[i] = series->bytes[2 * i] + series->bytes[2 * i + 1];
+    }
+
+    memset(series->bytes + i, 0, (RDP_SERIES_SAMPLES - i) *
+        sizeof(*series->bytes));
+    series->count = (series->count + 1) / 2;
+    series->step *= 2;
+}
+
+/*
+ * Like the cwnd trajectory, a full series keeps every other interval,
+ * here by joining neighbours so no bytes are lost.
+ *
+ * @param series throughput series
+ * @param elapsed microseconds since the transfer began
+ * @param bytes bytes moved at that time
+ */
+void rdp_series_add(struct rdp_series *series, unsigned long long elapsed,
+    unsigned long long bytes)
+{
+    unsigned long long i;
+
+    series->step = series->step ? series->step : RDP_SERIES_STEP;
+
+    while ((i = elapsed / series->step) >= RDP_SERIES_SAMPLES) {
+        rdp_series_fold(series);
+    }
+
+    series->bytes[i] += bytes;
+    series->total += bytes;
+    series->count = i + 1 > series->count ? i + 1 : series->count;
+}
+
+/*
+ * Flows ran side by side, their intervals are added up from the start.
+ *
+ * @param sum throughput series holding the sums
+ * @param add throughput series added to it
+ */
+void rdp_series_merge(struct rdp_series *sum, const struct rdp_series *add)
+{
+    unsigned int i, j;
+
+    if (!add->step) {
+        return;
+    }
+
+    if (!sum->step) {
+        *sum = *add;
+        return;
+    }
+
+    sum->total += add->total;
+
+    while (sum->step < add->step) {
+        rdp_series_fold(sum);
+    }
+
+    for (i = 0; i < add->count; i++) {
+        j = i * add->step / sum->step;
+        sum->bytes[j] += add->bytes[i];
+        sum->count = j + 1 > sum->count ? j + 1 : sum->count;
+    }
+}
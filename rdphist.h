@@ -0,0 +1,42 @@
+#ifndef RDP_HIST_H
+#define RDP_HIST_H
+
+// sub-buckets per power of two, values are kept to within 1/8.
+#define RDP_HIST_BITS 3
+#define RDP_HIST_SUB (1 << RDP_HIST_BITS)
+
+// buckets covering every unsigned int value.
+#define RDP_HIST_BUCKETS ((32 - RDP_HIST_BITS + 1) * RDP_HIST_SUB)
+
+// intervals of the throughput series, and the first interval length in
+// microseconds, doubled whenever the series fills up.
+#define RDP_SERIES_SAMPLES 64
+#define RDP_SERIES_STEP 100000
+
+// RDP histogram, HDR-style: values below RDP_HIST_SUB have a bucket each,
+// every power of two above is split in RDP_HIST_SUB buckets.
+struct rdp_hist {
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned int min;
+    unsigned int max;
+    unsigned long long buckets[RDP_HIST_BUCKETS];
+};
+
+// RDP throughput series, bytes per interval since the transfer began.
+struct rdp_series {
+    unsigned long long step;    // interval length, 0 until the first add
+    unsigned int count;         // intervals in use
+    unsigned long long total;   // bytes over all of them
+    unsigned long long bytes[RDP_SERIES_SAMPLES];
+};
+
+void rdp_hist_add(struct rdp_hist *hist, unsigned int value);
+unsigned int rdp_hist_upper(unsigned int bucket);
+unsigned int rdp_hist_quantile(const struct rdp_hist *hist, double q);
+void rdp_hist_merge(struct rdp_hist *sum, const struct rdp_hist *add);
+void rdp_series_add(struct rdp_series *series, unsigned long long elapsed,
+    unsigned long long bytes);
+void rdp_series_merge(struct rdp_series *sum, const struct rdp_series *add);
+
+#endif // RDP_HIST_H
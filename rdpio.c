@@ -0,0 +1,653 @@
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/errqueue.h>
+#include "rdpio.h"
+
+#ifndef SCM_TXTIME
+#define SCM_TXTIME 61
+#endif
+
+/*
+ * @param zc zero-copy sends
+ * @param segs datagrams of one message flushed
+ * @param sent 1: the kernel took them, 0: they were dropped
+ */
+static void rdp_zc_flushed(struct rdp_zc *zc, unsigned int segs, int sent)
+{
+    while (segs--) {
+        zc->sent[zc->flushed++ % RDP_ZC_SLOTS] = !sent ? RDP_ZC_DROPPED :
+            segs ? RDP_ZC_PART : RDP_ZC_LAST;
+    }
+}
+
+/*
+ * @param data bytes sent from where they are
+ * @param length length of data
+ * @return unsigned int pages the kernel pins for data
+ */
+static unsigned int rdp_batch_pages(const void *data, size_t length)
+{
+    unsigned long at = (unsigned long) data;
+
+    return length ? (at + length - 1) / RDP_ZC_PAGE - at / RDP_ZC_PAGE + 1 :
+        0;
+}
+
+/*
+ * @param batch datagram batch
+ * @param i message index, sent as datagrams of its segment size when it
+ * holds several, and at its departure time with txtime
+ */
+static void rdp_batch_control(struct rdp_batch *batch, unsigned int i)
+{
+    struct msghdr *hdr = &batch->msgs[i].msg_hdr;
+    struct cmsghdr *cmsg;
+    unsigned short size = batch->segsize[i];
+    unsigned long long time = batch->times[i] * 1000;
+
+    hdr->msg_controllen = (batch->segs[i] > 1 ? CMSG_SPACE(sizeof(size)) :
+        0) + (batch->txtime ? CMSG_SPACE(sizeof(time)) : 0);
+    hdr->msg_control = hdr->msg_controllen ? batch->controls[i] : NULL;
+
+    if (!hdr->msg_control) {
+        return;
+    }
+
+    memset(batch->controls[i], 0, hdr->msg_controllen);
+    cmsg = CMSG_FIRSTHDR(hdr);
+
+    if (batch->segs[i] > 1) {
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(size));
+        memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+        cmsg = CMSG_NXTHDR(hdr, cmsg);
+    }
+
+    // fq holds the datagrams until then, in nanoseconds.
+    if (batch->txtime) {
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_TXTIME;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(time));
+        memcpy(CMSG_DATA(cmsg), &time, sizeof(time));
+    }
+}
+
+/*
+ * A GRO buffer holds datagrams of the size in its UDP_GRO message, the
+ * last one maybe shorter.
+ *
+ * @param batch datagram batch
+ * @param i message index, its datagrams are appended to datagrams
+ * @param stats statistics to count coalesced buffers
+ */
+static void rdp_batch_split(struct rdp_batch *batch, unsigned int i,
+    struct rdp_stats *stats)
+{
+    struct msghdr *hdr = &batch->msgs[i].msg_hdr;
+    struct cmsghdr *cmsg;
+    char *buffer = hdr->msg_iov[0].iov_base;
+    size_t length = batch->msgs[i].msg_len;
+    size_t size = length;
+    size_t at = 0;
+    int gro;
+
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            memcpy(&gro, CMSG_DATA(cmsg), sizeof(gro));
+            size = gro > 0 ? (size_t) gro : length;
+        }
+    }
+
+    if (size < length) {
+        stats->grecvs++;
+    }
+
+    do {
+        batch->datagrams[batch->count] = buffer + at;
+        batch->lengths[batch->count++] =
+            length - at < size ? length - at : size;
+        at += size;
+    } while (at < length);
+
+    // text headers are searched as strings, buffers keep a spare byte.
+    buffer[length] = '\0';
+}
+
+/*
+ * @param batch datagram batch
+ * @param peer destination of sent datagrams, NULL when each datagram has
+ * its own address
+ */
+void rdp_batch_init(struct rdp_batch *batch, struct socket_info *peer)
+{
+    int i;
+
+    memset(batch->msgs, 0, sizeof(batch->msgs));
+    batch->count = 0;
+    batch->segments = 0;
+    batch->chained = 0;
+    batch->gso = 0;
+    batch->gro = 0;
+    batch->txtime = 0;
+    batch->when = 0;
+    batch->zc = NULL;
+    batch->ring = NULL;
+
+    for (i = 0; i < RDP_BURST; i++) {
+        batch->iovs[i].iov_base = batch->buffers[i];
+        batch->iovs[i].iov_len = RDP_DGRAM_MAX;
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+
+        if (peer) {
+            batch->msgs[i].msg_hdr.msg_name = &peer->addr;
+            batch->msgs[i].msg_hdr.msg_namelen = peer->length;
+        } else {
+            batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+            batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+        }
+    }
+}
+
+/*
+ * @param batch datagram batch
+ * @return char * buffer of the next datagram, NULL when batch is full
+ */
+char *rdp_batch_next(struct rdp_batch *batch)
+{
+    return batch->segments < RDP_BURST ? batch->buffers[batch->segments] :
+        NULL;
+}
+
+/*
+ * @param batch datagram batch
+ * @param length length of the datagram filled by rdp_batch_next
+ */
+void rdp_batch_push(struct rdp_batch *batch, size_t length)
+{
+    struct msghdr *hdr = &batch->msgs[batch->count].msg_hdr;
+
+    batch->iovs[batch->count].iov_base = batch->buffers[batch->segments++];
+    batch->iovs[batch->count].iov_len = length;
+    hdr->msg_iov = &batch->iovs[batch->count];
+    hdr->msg_iovlen = 1;
+    hdr->msg_control = NULL;
+    hdr->msg_controllen = 0;
+    batch->segsize[batch->count] = length;
+    batch->times[batch->count] = batch->when;
+    batch->segs[batch->count++] = 1;
+}
+
+/*
+ * With gso set a datagram the size of the ones before it joins their
+ * message, a shorter one joins and ends it, the kernel splits it again.
+ * With txtime only one leaving at the same time joins.
+ * A zero-copy message pins no more pages than an skb holds fragments.
+ *
+ * @param batch datagram batch
+ * @param header header of the datagram, from rdp_batch_next or rdp_zc_next
+ * @param hlen header length
+ * @param data payload, sent from where it is
+ * @param length payload length
+ */
+void rdp_batch_attach(struct rdp_batch *batch, char *header, size_t hlen,
+    const void *data, size_t length)
+{
+    struct iovec *iov = batch->chain + batch->chained;
+    struct msghdr *hdr;
+    size_t size = hlen + length;
+    unsigned int last = batch->count - 1;
+    unsigned int frags = batch->zc ? rdp_batch_pages(header, hlen) +
+        rdp_batch_pages(data, length) : 0;
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = hlen;
+    iov[1].iov_base = (void *) data;
+    iov[1].iov_len = length;
+    batch->chained += 2;
+    batch->segments++;
+
+    if (batch->gso && batch->count && size && size <= batch->segsize[last] &&
+        (!batch->txtime || batch->times[last] == batch->when) &&
+        batch->bytes[last] == batch->segs[last] * batch->segsize[last] &&
+        batch->segs[last] < RDP_GSO_SEGS &&
+        batch->bytes[last] + size <= RDP_GSO_BYTES &&
+        batch->frags[last] + frags <= RDP_ZC_FRAGS) {
+        batch->msgs[last].msg_hdr.msg_iovlen += 2;
+        batch->bytes[last] += size;
+        batch->frags[last] += frags;
+        batch->segs[last]++;
+        return;
+    }
+
+    hdr = &batch->msgs[batch->count].msg_hdr;
+    hdr->msg_iov = iov;
+    hdr->msg_iovlen = 2;
+    hdr->msg_control = NULL;
+    hdr->msg_controllen = 0;
+    batch->segsize[batch->count] = size;
+    batch->times[batch->count] = batch->when;
+    batch->segs[batch->count] = 1;
+    batch->frags[batch->count] = frags;
+    batch->bytes[batch->count++] = size;
+}
+
+/*
+ * @param batch datagram batch initialized without a peer
+ * @param addr destination of the next datagram
+ */
+void rdp_batch_peer(struct rdp_batch *batch, const struct sockaddr_in *addr)
+{
+    batch->addrs[batch->count] = *addr;
+}
+
+/*
+ * @param batch datagram batch
+ * @param i message index
+ * @param error 0: the kernel took the message, else why it did not
+ * @param stats statistics to count sends
+ * @return unsigned int datagrams sent
+ */
+static unsigned int rdp_batch_sent(struct rdp_batch *batch, unsigned int i,
+    int error, struct rdp_stats *stats)
+{
+    if (error) {
+        // a device without UDP GSO fails it, datagrams go one by one.
+        if (batch->segs[i] > 1 && batch->gso) {
+            fprintf(stderr, "UDP GSO: %s, sending without it\n",
+                strerror(error));
+            batch->gso = 0;
+        }
+
+        if (batch->zc) {
+            rdp_zc_flushed(batch->zc, batch->segs[i], 0);
+        }
+
+        return 0;
+    }
+
+    if (batch->zc) {
+        rdp_zc_flushed(batch->zc, batch->segs[i], 1);
+        stats->zsends++;
+    }
+
+    if (batch->segs[i] > 1) {
+        stats->gsends++;
+    }
+
+    stats->smsgs += batch->segs[i];
+    return batch->segs[i];
+}
+
+/*
+ * @param sock socket handler
+ * @param batch datagram batch
+ * @param stats statistics to count batches
+ * @return int datagrams sent, -1 failed
+ */
+int rdp_batch_flush(int sock, struct rdp_batch *batch,
+    struct rdp_stats *stats)
+{
+    unsigned int sent = 0;
+    unsigned int segments = 0;
+    int flags = batch->zc ? MSG_ZEROCOPY : 0;
+    int result = 0;
+    int i;
+
+    // GSO sizes and departures are known once the messages are complete.
+    for (i = 0; i < batch->count; i++) {
+        rdp_batch_control(batch, i);
+    }
+
+    // through the ring every message succeeds or fails on its own.
+    if (batch->ring && batch->count) {
+        result = rdp_ring_sendmmsg(batch->ring, batch->msgs, batch->count,
+            flags, batch->results);
+
+        for (; result >= 0 && sent < batch->count; sent++) {
+            if (batch->results[sent] < 0 && batch->results[sent] !=
+                -EMSGSIZE && batch->segs[sent] == 1) {
+                fprintf(stderr, "sendmsg: %s\n",
+                    strerror(-batch->results[sent]));
+            }
+
+            segments += rdp_batch_sent(batch, sent,
+                batch->results[sent] < 0 ? -batch->results[sent] : 0, stats);
+        }
+
+        stats->sbatch += result >= 0;
+    }
+
+    // a short count means the socket buffer is full, send the rest.
+    while (!batch->ring && sent < batch->count) {
+        result = sendmmsg(sock, batch->msgs + sent, batch->count - sent,
+            flags);
+
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            // a datagram too big for the path is dropped like a lost one,
+            // as is a segmented one the device refuses.
+            if (errno == EMSGSIZE || batch->segs[sent] > 1) {
+                rdp_batch_sent(batch, sent++, errno, stats);
+                continue;
+            }
+
+            perror("sendmmsg");
+            break;
+        }
+
+        for (i = 0; i < result; i++) {
+            segments += rdp_batch_sent(batch, sent++, 0, stats);
+        }
+
+        stats->sbatch++;
+    }
+
+    // datagrams never sent hold their headers no longer.
+    for (; batch->zc && sent < batch->count; sent++) {
+        rdp_zc_flushed(batch->zc, batch->segs[sent], 0);
+    }
+
+    batch->count = 0;
+    batch->segments = 0;
+    batch->chained = 0;
+    return segments ? (int) segments : result;
+}
+
+/*
+ * @param sock socket handler
+ * @param batch datagram batch, count holds datagrams received
+ * @param vlen messages to receive at most
+ * @param flags MSG_DONTWAIT to drain, MSG_WAITFORONE to block
+ * @param stats statistics to count batches
+ * @return int datagrams received, -1 failed
+ */
+static int rdp_batch_wait(int sock, struct rdp_batch *batch,
+    unsigned int vlen, int flags, struct rdp_stats *stats)
+{
+    int i, result;
+
+    do {
+        result = batch->ring ?
+            rdp_ring_recvmmsg(batch->ring, batch->msgs, vlen, flags) :
+            recvmmsg(sock, batch->msgs, vlen, flags, NULL);
+    } while (result < 0 && errno == EINTR);
+
+    batch->count = 0;
+
+    if (result < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < result; i++) {
+        rdp_batch_split(batch, i, stats);
+    }
+
+    stats->rbatch++;
+    stats->rmsgs += batch->count;
+    return batch->count;
+}
+
+/*
+ * @param sock socket handler
+ * @param batch datagram batch, count holds datagrams received
+ * @param flags MSG_DONTWAIT to drain, MSG_WAITFORONE to block
+ * @param stats statistics to count batches
+ * @return int datagrams received, -1 failed
+ */
+int rdp_batch_recv(int sock, struct rdp_batch *batch, int flags,
+    struct rdp_stats *stats)
+{
+    char *flat = (char *) batch->buffers;
+    struct msghdr *hdr;
+    unsigned int vlen = batch->gro ? RDP_GRO_MSGS : RDP_BURST;
+    unsigned int i;
+
+    // GRO buffers take the room of several datagram buffers each.
+    for (i = 0; i < vlen; i++) {
+        hdr = &batch->msgs[i].msg_hdr;
+        batch->iovs[i].iov_base = batch->gro ? flat + i * RDP_GRO_SIZE :
+            batch->buffers[i];
+        batch->iovs[i].iov_len = batch->gro ? RDP_GRO_SIZE - 1 :
+            RDP_DGRAM_MAX;
+        hdr->msg_iov = &batch->iovs[i];
+        hdr->msg_iovlen = 1;
+        hdr->msg_namelen = sizeof(batch->addrs[i]);
+        hdr->msg_control = batch->gro ? batch->controls[i] : NULL;
+        hdr->msg_controllen = batch->gro ? sizeof(batch->controls[i]) : 0;
+    }
+
+    return rdp_batch_wait(sock, batch, vlen, flags, stats);
+}
+
+/*
+ * Datagram i is split into its first hlen bytes, span bytes at place +
+ * i * span and whatever is left, so consecutive segments of span bytes
+ * land where they belong without a copy. Nothing is placed past room.
+ * Not for a batch on a ring, the kernel picks its buffers.
+ *
+ * @param sock socket handler
+ * @param batch datagram batch, count holds datagrams received
+ * @param hlen header length, kept in the datagram buffer
+ * @param place where the payload of the first datagram belongs
+ * @param span payload length of each datagram, 0 places nothing
+ * @param room bytes at place that may be written
+ * @param flags MSG_DONTWAIT to drain, MSG_WAITFORONE to block
+ * @param stats statistics to count batches
+ * @return int datagrams received, -1 failed
+ */
+int rdp_batch_recv_into(int sock, struct rdp_batch *batch, size_t hlen,
+    char *place, size_t span, size_t room, int flags,
+    struct rdp_stats *stats)
+{
+    struct iovec *iov;
+    size_t at;
+    int i;
+
+    for (i = 0; i < RDP_BURST; i++) {
+        iov = batch->spans[i];
+        at = span * i;
+
+        iov[0].iov_base = batch->buffers[i];
+        iov[0].iov_len = hlen;
+        iov[1].iov_base = place + at;
+        iov[1].iov_len = at + span <= room ? span : 0;
+        iov[2].iov_base = batch->buffers[i] + hlen;
+        iov[2].iov_len = RDP_DGRAM_MAX - hlen - iov[1].iov_len;
+
+        batch->msgs[i].msg_hdr.msg_iov = iov;
+        batch->msgs[i].msg_hdr.msg_iovlen = 3;
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+        batch->msgs[i].msg_hdr.msg_control = NULL;
+        batch->msgs[i].msg_hdr.msg_controllen = 0;
+    }
+
+    return rdp_batch_wait(sock, batch, RDP_BURST, flags, stats);
+}
+
+/*
+ * @param batch datagram batch received by rdp_batch_recv_into
+ * @param i datagram index
+ * @return char * datagram i made whole in its buffer
+ */
+char *rdp_batch_gather(struct rdp_batch *batch, unsigned int i)
+{
+    struct iovec *iov = batch->spans[i];
+    size_t length = batch->msgs[i].msg_len;
+    size_t placed = length > iov[0].iov_len ? length - iov[0].iov_len : 0;
+    size_t rest = placed > iov[1].iov_len ? placed - iov[1].iov_len : 0;
+
+    placed -= rest;
+
+    // the placed part goes back between the header and the rest.
+    memmove((char *) iov[2].iov_base + placed, iov[2].iov_base, rest);
+    memcpy(iov[2].iov_base, iov[1].iov_base, placed);
+    batch->buffers[i][length] = '\0';
+    return batch->buffers[i];
+}
+
+/*
+ * @param sock socket handler
+ * @param receive 1: have the socket coalesce received datagrams, 0: only
+ * ask whether sends may be segmented
+ * @return int 1: UDP GRO or GSO in use, 0: not supported
+ */
+int rdp_offload(int sock, int receive)
+{
+    int value = receive;
+
+    if (setsockopt(sock, SOL_UDP, receive ? UDP_GRO : UDP_SEGMENT, &value,
+        sizeof(value)) < 0) {
+        perror(receive ? "UDP_GRO" : "UDP_SEGMENT");
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * @param sock socket handler, set to send with MSG_ZEROCOPY
+ * @return struct rdp_zc * zero-copy sends, NULL not supported
+ */
+struct rdp_zc *rdp_zc_new(int sock)
+{
+    struct rdp_zc *zc;
+    int one = 1;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) {
+        perror("SO_ZEROCOPY");
+        return NULL;
+    }
+
+    zc = calloc(1, sizeof(*zc));
+
+    if (!zc) {
+        perror("calloc");
+        return NULL;
+    }
+
+    zc->sock = sock;
+    return zc;
+}
+
+/*
+ * @param zc zero-copy sends, freed once the kernel is done with them or
+ * has taken too long
+ * @param stats statistics to count datagrams the kernel copied
+ */
+void rdp_zc_free(struct rdp_zc *zc, struct rdp_stats *stats)
+{
+    int tries;
+
+    for (tries = 0; zc && zc->tail != zc->flushed && tries < 10; tries++) {
+        rdp_zc_reap(zc, 1);
+    }
+
+    if (zc) {
+        stats->zcopied += zc->copied;
+    }
+
+    free(zc);
+}
+
+/*
+ * @param zc zero-copy sends
+ * @return char * header room of the next datagram
+ */
+char *rdp_zc_next(struct rdp_zc *zc)
+{
+    // every header in use, the oldest datagrams must complete first.
+    while (zc->head - zc->tail == RDP_ZC_SLOTS) {
+        rdp_zc_reap(zc, 1);
+    }
+
+    return zc->headers[zc->head++ % RDP_ZC_SLOTS];
+}
+
+/*
+ * The kernel numbers the messages it takes from 0 and reports them done
+ * in ranges; headers go back in the order they were handed out.
+ *
+ * @param zc zero-copy sends
+ * @param wait 1: wait RDP_ZC_WAIT for a completion, 0: take what is there
+ * @return int sends completed
+ */
+int rdp_zc_reap(struct rdp_zc *zc, int wait)
+{
+    char control[128];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct sock_extended_err *err;
+    struct pollfd pfd;
+    unsigned int id;
+    int state;
+    int reaped = 0;
+
+    pfd.fd = zc->sock;
+    pfd.events = 0;
+
+    // the error queue is signalled as POLLERR, asked for or not.
+    if (wait && poll(&pfd, 1, RDP_ZC_WAIT) <= 0) {
+        return 0;
+    }
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(zc->sock, &msg, MSG_ERRQUEUE) < 0) {
+            break;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) {
+                continue;
+            }
+
+            err = (struct sock_extended_err *) CMSG_DATA(cmsg);
+
+            if (err->ee_errno || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+
+            for (id = err->ee_info; id != err->ee_data + 1; id++) {
+                zc->done[id % RDP_ZC_SLOTS] = 1;
+                reaped++;
+            }
+
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zc->copied += err->ee_data - err->ee_info + 1;
+            }
+        }
+    }
+
+    // the headers of a message wait for its one completion, the last
+    // of them consumes it.
+    while (zc->tail != zc->flushed) {
+        state = zc->sent[zc->tail % RDP_ZC_SLOTS];
+
+        if (state != RDP_ZC_DROPPED) {
+            if (!zc->done[zc->ids % RDP_ZC_SLOTS]) {
+                break;
+            }
+
+            if (state == RDP_ZC_LAST) {
+                zc->done[zc->ids++ % RDP_ZC_SLOTS] = 0;
+            }
+        }
+
+        zc->tail++;
+    }
+
+    return reaped;
+}
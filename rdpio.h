@@ -0,0 +1,110 @@
+#ifndef RDP_IO_H
+#define RDP_IO_H
+
+#include <sys/socket.h>
+#include <netinet/udp.h>
+#include "rdp.h"
+#include "rdppkt.h"
+#include "rdpring.h"
+
+// packets in a burst, sent or drained with one system call.
+#define RDP_BURST 100
+
+// datagrams the kernel segments or coalesces at most, UDP GSO and GRO.
+#define RDP_GSO_SEGS 64
+
+// largest UDP payload, the most GSO sends or GRO hands over at once.
+#define RDP_GSO_BYTES 65507
+
+// GRO buffers share the datagram buffers of a batch.
+#define RDP_GRO_SIZE (RDP_GSO_BYTES + 1)
+#define RDP_GRO_MSGS (RDP_BURST * (RDP_DGRAM_MAX + 1) / RDP_GRO_SIZE)
+
+// datagrams a received batch holds, GRO buffers split into segments.
+#define RDP_BATCH_SEGS (RDP_GRO_MSGS * RDP_GSO_SEGS)
+
+// control data of a sent message, its GSO size and departure time.
+#define RDP_CONTROL_SIZE (CMSG_SPACE(sizeof(unsigned short)) + \
+    CMSG_SPACE(sizeof(unsigned long long)))
+
+// zero-copy datagrams in flight, each keeps its header until completed.
+#define RDP_ZC_SLOTS (4 * RDP_BURST)
+
+// room for the header of a data packet, text or binary.
+#define RDP_ZC_HDR 128
+
+// milliseconds to wait for zero-copy completions at a time.
+#define RDP_ZC_WAIT 100
+
+// pages a zero-copy message pins at most, the fragments of one skb.
+#define RDP_ZC_FRAGS 16
+#define RDP_ZC_PAGE 4096
+
+// header states, the kernel completes a message of several datagrams once.
+#define RDP_ZC_DROPPED 0
+#define RDP_ZC_LAST 1
+#define RDP_ZC_PART 2
+
+// RDP zero-copy sends, the kernel reads headers and payloads until it
+// reports the datagram done on the socket error queue.
+struct rdp_zc {
+    int sock;
+    unsigned int head;          // headers handed out
+    unsigned int flushed;       // headers of datagrams given to sendmmsg
+    unsigned int tail;          // headers free again
+    unsigned int ids;           // completions consumed, in kernel order
+    unsigned int copied;        // sends the kernel copied after all
+    unsigned char sent[RDP_ZC_SLOTS];   // RDP_ZC_DROPPED, _PART or _LAST
+    unsigned char done[RDP_ZC_SLOTS];   // completion seen, by kernel id
+    char headers[RDP_ZC_SLOTS][RDP_ZC_HDR];
+};
+
+// RDP datagram batch, a message carries several datagrams with GSO or GRO.
+struct rdp_batch {
+    struct mmsghdr msgs[RDP_BURST];
+    struct iovec iovs[RDP_BURST];
+    struct iovec spans[RDP_BURST][3];   // header, place in a file, the rest
+    struct iovec chain[2 * RDP_BURST];  // header and payload of each datagram
+    struct sockaddr_in addrs[RDP_BURST];
+    char controls[RDP_BURST][RDP_CONTROL_SIZE];
+    char buffers[RDP_BURST][RDP_DGRAM_MAX + 1];
+    char *datagrams[RDP_BATCH_SEGS];    // received, one per segment
+    unsigned int lengths[RDP_BATCH_SEGS];
+    unsigned short segsize[RDP_BURST];  // GSO segment size of each message
+    unsigned short segs[RDP_BURST];     // datagrams in each message
+    unsigned int bytes[RDP_BURST];
+    unsigned short frags[RDP_BURST];    // pages pinned, zero-copy only
+    unsigned long long times[RDP_BURST];    // departures, SO_TXTIME only
+    unsigned int count;         // messages, datagrams once received
+    unsigned int segments;      // datagrams queued to send
+    unsigned int chained;
+    int gso;                    // 1: equal datagrams go out as one message
+    int gro;                    // 1: the socket hands over coalesced buffers
+    int txtime;                 // 1: messages carry their departure time
+    unsigned long long when;    // departure of the next message queued
+    struct rdp_zc *zc;          // NULL unless sent with MSG_ZEROCOPY
+    struct rdp_ring *ring;      // NULL unless sent and received by io_uring
+    int results[RDP_BURST];     // send results through the ring
+};
+
+void rdp_batch_init(struct rdp_batch *batch, struct socket_info *peer);
+char *rdp_batch_next(struct rdp_batch *batch);
+void rdp_batch_push(struct rdp_batch *batch, size_t length);
+void rdp_batch_attach(struct rdp_batch *batch, char *header, size_t hlen,
+    const void *data, size_t length);
+void rdp_batch_peer(struct rdp_batch *batch, const struct sockaddr_in *addr);
+int rdp_batch_flush(int sock, struct rdp_batch *batch,
+    struct rdp_stats *stats);
+int rdp_batch_recv(int sock, struct rdp_batch *batch, int flags,
+    struct rdp_stats *stats);
+int rdp_batch_recv_into(int sock, struct rdp_batch *batch, size_t hlen,
+    char *place, size_t span, size_t room, int flags,
+    struct rdp_stats *stats);
+char *rdp_batch_gather(struct rdp_batch *batch, unsigned int i);
+int rdp_offload(int sock, int receive);
+struct rdp_zc *rdp_zc_new(int sock);
+void rdp_zc_free(struct rdp_zc *zc, struct rdp_stats *stats);
+char *rdp_zc_next(struct rdp_zc *zc);
+int rdp_zc_reap(struct rdp_zc *zc, int wait);
+
+#endif // RDP_IO_H
@@ -0,0 +1,236 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include "rdpclock.h"
+#include "rdplog.h"
+
+// records written per fwrite by the log writer.
+#define RDP_LOG_CHUNK 256
+
+// log writer sleep when the ring is empty, nanoseconds.
+#define RDP_LOG_IDLE 1000000
+
+struct rdp_slot {
+    unsigned long seq;
+    struct rdp_event event;
+};
+
+static const char *rdp_levels[] = {"error", "summary", "packet"};
+
+int rdp_log_level = RDP_LOG_SUMMARY;
+
+static struct rdp_slot rdp_ring[RDP_LOG_RING];
+static unsigned long rdp_head;
+static unsigned long rdp_tail;
+static unsigned long rdp_dropped;
+static int rdp_stop;
+static FILE *rdp_file;
+static pthread_t rdp_writer;
+
+/*
+ * @param name log level name
+ * @return int log level, -1: unknown
+ */
+int rdp_log_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < sizeof(rdp_levels) / sizeof(*rdp_levels); i++) {
+        if (!strcmp(rdp_levels[i], name)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Take the oldest record, only the log writer consumes.
+ *
+ * @param event record output
+ * @return int 1: record taken, 0: ring empty
+ */
+static int rdp_log_pop(struct rdp_event *event)
+{
+    struct rdp_slot *slot = &rdp_ring[rdp_tail & (RDP_LOG_RING - 1)];
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != rdp_tail + 1) {
+        return 0;
+    }
+
+    *event = slot->event;
+    __atomic_store_n(&slot->seq, rdp_tail + RDP_LOG_RING, __ATOMIC_RELEASE);
+    rdp_tail++;
+    return 1;
+}
+
+/*
+ * @return int records written
+ */
+static int rdp_log_drain(void)
+{
+    struct rdp_event events[RDP_LOG_CHUNK];
+    int count = 0;
+
+    while (count < RDP_LOG_CHUNK && rdp_log_pop(&events[count])) {
+        count++;
+    }
+
+    if (count && fwrite(events, sizeof(*events), count, rdp_file) != count) {
+        perror("log write");
+    }
+
+    return count;
+}
+
+/*
+ * @param arg unused
+ * @return void * unused
+ */
+static void *rdp_log_write(void *arg)
+{
+    struct timespec idle = {0, RDP_LOG_IDLE};
+
+    for (;;) {
+        if (rdp_log_drain()) {
+            continue;
+        }
+
+        // the ring is empty here, so nothing is left behind on stop.
+        if (__atomic_load_n(&rdp_stop, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        nanosleep(&idle, NULL);
+    }
+
+    return NULL;
+}
+
+/*
+ * @param path binary packet log, NULL for none
+ * @param level log level
+ * @return int 0: ok, -1: failed
+ */
+int rdp_log_open(const char *path, int level)
+{
+    struct rdp_log_header header;
+    struct timeval tv;
+    unsigned long i;
+
+    rdp_log_level = level;
+
+    if (!path) {
+        if (level >= RDP_LOG_PACKET) {
+            fprintf(stderr, "packet log needs a log file\n");
+            rdp_log_level = RDP_LOG_SUMMARY;
+            return -1;
+        }
+        return 0;
+    }
+
+    rdp_file = fopen(path, "wb");
+
+    if (!rdp_file) {
+        perror(path);
+        rdp_log_level = RDP_LOG_SUMMARY;
+        return -1;
+    }
+
+    // the decoder turns record times back into wall clock.
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, RDP_LOG_MAGIC);
+    gettimeofday(&tv, NULL);
+    header.epoch = tv.tv_sec * RDP_USEC + tv.tv_usec - rdp_clock();
+    header.size = sizeof(struct rdp_event);
+    fwrite(&header, sizeof(header), 1, rdp_file);
+
+    for (i = 0; i < RDP_LOG_RING; i++) {
+        rdp_ring[i].seq = i;
+    }
+
+    rdp_head = rdp_tail = rdp_dropped = 0;
+    rdp_stop = 0;
+
+    if (pthread_create(&rdp_writer, NULL, rdp_log_write, NULL)) {
+        fprintf(stderr, "log writer failed\n");
+        fclose(rdp_file);
+        rdp_file = NULL;
+        rdp_log_level = RDP_LOG_SUMMARY;
+        return -1;
+    }
+
+    return 0;
+}
+
+void rdp_log_close(void)
+{
+    if (!rdp_file) {
+        return;
+    }
+
+    // no more records, the writer empties the ring and quits.
+    rdp_log_level = rdp_log_level < RDP_LOG_PACKET ? rdp_log_level :
+        RDP_LOG_SUMMARY;
+    __atomic_store_n(&rdp_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(rdp_writer, NULL);
+
+    fclose(rdp_file);
+    rdp_file = NULL;
+
+    if (rdp_dropped) {
+        fprintf(stderr, "log: %lu events dropped\n", rdp_dropped);
+    }
+}
+
+/*
+ * Record a packet event without blocking, a full ring drops it.
+ *
+ * @param event event associated with packet
+ * @param sender sending address
+ * @param receiver receiving address
+ * @param type packet type
+ * @param number packet number
+ * @param info packet information
+ */
+void rdp_log_event(char event, const struct sockaddr_in *sender,
+    const struct sockaddr_in *receiver, int type, unsigned long long number,
+    unsigned int info)
+{
+    unsigned long pos = __atomic_load_n(&rdp_head, __ATOMIC_RELAXED);
+    struct rdp_slot *slot;
+    long diff;
+
+    // claim a slot the writer has released.
+    for (;;) {
+        slot = &rdp_ring[pos & (RDP_LOG_RING - 1)];
+        diff = (long) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (!diff) {
+            if (__atomic_compare_exchange_n(&rdp_head, &pos, pos + 1, 1,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&rdp_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&rdp_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->event.time = rdp_clock();
+    slot->event.saddr = sender->sin_addr.s_addr;
+    slot->event.daddr = receiver->sin_addr.s_addr;
+    slot->event.sport = sender->sin_port;
+    slot->event.dport = receiver->sin_port;
+    slot->event.number = number;
+    slot->event.info = info;
+    slot->event.event = event;
+    slot->event.type = type;
+    slot->event.reserved = 0;
+
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
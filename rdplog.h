@@ -0,0 +1,78 @@
+#ifndef RDP_LOG_H
+#define RDP_LOG_H
+
+#include <netinet/in.h>
+
+// log levels, each keeps everything below it.
+#define RDP_LOG_ERROR 0
+#define RDP_LOG_SUMMARY 1
+#define RDP_LOG_PACKET 2
+
+// packet events.
+#define RDP_SEND 's'
+#define RDP_RESEND 'S'
+#define RDP_RECEIVE 'r'
+#define RDP_DUPLICATE 'R'
+
+// event records buffered between the protocol and the log writer.
+#define RDP_LOG_RING (1 << 16)
+
+#define RDP_LOG_MAGIC "RDPLOG2"
+
+// binary log file header, records in host byte order follow.
+struct rdp_log_header {
+    char magic[8];
+    unsigned long long epoch;   // wall clock minus rdp_clock(), microseconds
+    unsigned int size;          // bytes per record
+    unsigned int reserved;
+};
+
+struct rdp_event {
+    unsigned long long time;    // rdp_clock() microseconds
+    unsigned long long number;
+    unsigned int saddr;         // addresses and ports in network byte order
+    unsigned int daddr;
+    unsigned short sport;
+    unsigned short dport;
+    unsigned int info;
+    char event;
+    unsigned char type;
+    unsigned short reserved;
+};
+
+extern int rdp_log_level;
+
+int rdp_log_find(const char *name);
+int rdp_log_open(const char *path, int level);
+void rdp_log_close(void);
+void rdp_log_event(char event, const struct sockaddr_in *sender,
+    const struct sockaddr_in *receiver, int type, unsigned long long number,
+    unsigned int info);
+
+/*
+ * @param level log level
+ * @return int 1: messages of the level are kept, 0: dropped
+ */
+static inline int rdp_log_enabled(int level)
+{
+    return rdp_log_level >= level;
+}
+
+/*
+ * @param event event associated with packet
+ * @param sender sending address
+ * @param receiver receiving address
+ * @param type packet type
+ * @param number packet number
+ * @param info packet information
+ */
+static inline void rdp_log(char event, const struct sockaddr_in *sender,
+    const struct sockaddr_in *receiver, int type, unsigned long long number,
+    unsigned int info)
+{
+    if (rdp_log_enabled(RDP_LOG_PACKET)) {
+        rdp_log_event(event, sender, receiver, type, number, info);
+    }
+}
+
+#endif // RDP_LOG_H
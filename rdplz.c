@@ -0,0 +1,423 @@
+#include <arpa/inet.h>
+#include <endian.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rdplz.h"
+
+// shortest match, a token's low nibble counts from it.
+#define RDP_LZ_MIN 4
+
+// matches are only looked for where a whole word is left to read.
+#define RDP_LZ_MARGIN 8
+
+// a nibble of 15 is continued by bytes, each of 255 continued again.
+#define RDP_LZ_RUN 15
+
+/*
+ * @return struct rdp_lz * compressor, NULL failed
+ */
+struct rdp_lz *rdp_lz_new(void)
+{
+    struct rdp_lz *lz = calloc(1, sizeof(*lz));
+
+    if (!lz) {
+        perror("calloc");
+        return NULL;
+    }
+
+    // a table entry of 0 is never a position of the block.
+    lz->base = 1;
+    return lz;
+}
+
+/*
+ * @param lz compressor, NULL for none
+ */
+void rdp_lz_free(struct rdp_lz *lz)
+{
+    free(lz);
+}
+
+/*
+ * @param in block
+ * @param ref earlier position matching ip
+ * @param ip position the match is extended from
+ * @param length block length
+ * @return unsigned int bytes that match from ref and ip on
+ */
+static unsigned int rdp_lz_match(const unsigned char *in, unsigned int ref,
+    unsigned int ip, unsigned int length)
+{
+    unsigned int start = ip;
+    uint64_t a, b;
+
+    // a word at a time, the first byte that differs ends it.
+    while (ip + sizeof(a) <= length) {
+        memcpy(&a, in + ref, sizeof(a));
+        memcpy(&b, in + ip, sizeof(b));
+
+        if (a != b) {
+            return ip - start + __builtin_ctzll(le64toh(a ^ b)) / 8;
+        }
+
+        ip += sizeof(a);
+        ref += sizeof(a);
+    }
+
+    while (ip < length && in[ref] == in[ip]) {
+        ip++;
+        ref++;
+    }
+
+    return ip - start;
+}
+
+/*
+ * @param out compressed output
+ * @param at where the length goes
+ * @param n length beyond a full nibble
+ * @return unsigned int position after it
+ */
+static unsigned int rdp_lz_length(unsigned char *out, unsigned int at,
+    unsigned int n)
+{
+    if (n < RDP_LZ_RUN) {
+        return at;
+    }
+
+    for (n -= RDP_LZ_RUN; n >= 255; n -= 255) {
+        out[at++] = 255;
+    }
+
+    out[at++] = n;
+    return at;
+}
+
+/*
+ * @param out compressed output
+ * @param op bytes in it, advanced past the sequence
+ * @param room output size
+ * @param lit literals before the match
+ * @param count literal count
+ * @param offset distance back to the match
+ * @param len match length, 0 for the literals ending the block
+ * @return int 1: written, 0: no room
+ */
+static int rdp_lz_emit(unsigned char *out, unsigned int *op,
+    unsigned int room, const unsigned char *lit, unsigned int count,
+    unsigned int offset, unsigned int len)
+{
+    unsigned int at = *op;
+    unsigned char *token;
+
+    // token, literals, offset and both lengths' bytes at most.
+    if ((unsigned long long) at + count + count / 255 + len / 255 + 5 >
+        room) {
+        return 0;
+    }
+
+    token = out + at++;
+    *token = (count < RDP_LZ_RUN ? count : RDP_LZ_RUN) << 4;
+    at = rdp_lz_length(out, at, count);
+    memcpy(out + at, lit, count);
+    at += count;
+
+    if (len) {
+        out[at++] = offset & 0xff;
+        out[at++] = offset >> 8;
+        len -= RDP_LZ_MIN;
+        *token |= len < RDP_LZ_RUN ? len : RDP_LZ_RUN;
+        at = rdp_lz_length(out, at, len);
+    }
+
+    *op = at;
+    return 1;
+}
+
+/*
+ * Greedy LZ77 over one block: a 4-byte sequence seen before in the block
+ * becomes a match, the bytes between matches literals. Sequences are a
+ * token of two nibbles, literal count and match length, as LZ4 has them.
+ *
+ * @param lz compressor, its table kept from block to block
+ * @param src block
+ * @param length block length
+ * @param dst compressed output
+ * @param room output size
+ * @return unsigned int compressed length, 0 when it does not fit room
+ */
+static unsigned int rdp_lz_compress(struct rdp_lz *lz, const char *src,
+    unsigned int length, char *dst, unsigned int room)
+{
+    const unsigned char *in = (const unsigned char *) src;
+    unsigned char *out = (unsigned char *) dst;
+    unsigned int ip = 0, anchor = 0, op = 0;
+    unsigned int hash, cand, ref, len;
+    uint32_t seq, old;
+
+    while (ip + RDP_LZ_MARGIN <= length) {
+        memcpy(&seq, in + ip, sizeof(seq));
+        hash = (seq * 2654435761u) >> (32 - RDP_LZ_BITS);
+        cand = lz->table[hash];
+        lz->table[hash] = lz->base + ip;
+
+        // an entry from an earlier block is not in this one.
+        if (cand >= lz->base) {
+            ref = cand - lz->base;
+            memcpy(&old, in + ref, sizeof(old));
+        }
+
+        if (cand < lz->base || old != seq) {
+            // the longer nothing matched, the further ahead to look.
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        len = RDP_LZ_MIN + rdp_lz_match(in, ref + RDP_LZ_MIN,
+            ip + RDP_LZ_MIN, length);
+
+        if (!rdp_lz_emit(out, &op, room, in + anchor, ip - anchor, ip - ref,
+            len)) {
+            return 0;
+        }
+
+        ip += len;
+        anchor = ip;
+    }
+
+    if (!rdp_lz_emit(out, &op, room, in + anchor, length - anchor, 0, 0)) {
+        return 0;
+    }
+
+    return op;
+}
+
+/*
+ * @param in compressed block
+ * @param ip position of the length's bytes, advanced past them
+ * @param length compressed length
+ * @param count length so far, the bytes added
+ * @return int 0: read, -1: past the end
+ */
+static int rdp_lz_more(const unsigned char *in, unsigned int *ip,
+    unsigned int length, unsigned int *count)
+{
+    unsigned char byte;
+
+    do {
+        if (*ip >= length) {
+            return -1;
+        }
+
+        byte = in[(*ip)++];
+        *count += byte;
+    } while (byte == 255);
+
+    return 0;
+}
+
+/*
+ * @param dst where the bytes go
+ * @param src where they come from, 8 or more bytes before dst or apart
+ * @param count bytes to copy, up to 7 more are written
+ */
+static inline void rdp_lz_copy(unsigned char *dst, const unsigned char *src,
+    unsigned int count)
+{
+    unsigned int i;
+
+    // fixed-size copies inline, a call per short run would cost more.
+    for (i = 0; i < count; i += 8) {
+        memcpy(dst + i, src + i, 8);
+    }
+}
+
+/*
+ * Every length and offset is checked, a malformed block never reads past
+ * its end or writes past room and RDP_LZ_SLACK bytes after it.
+ *
+ * @param src compressed block
+ * @param length compressed length
+ * @param dst block output, room and RDP_LZ_SLACK bytes
+ * @param room output size
+ * @return int block length, -1 malformed
+ */
+static int rdp_lz_decompress(const char *src, unsigned int length, char *dst,
+    unsigned int room)
+{
+    const unsigned char *in = (const unsigned char *) src;
+    unsigned char *out = (unsigned char *) dst;
+    unsigned int ip = 0, op = 0, token, count, offset;
+
+    for (;;) {
+        if (ip >= length) {
+            return -1;
+        }
+
+        token = in[ip++];
+        count = token >> 4;
+
+        if (count == RDP_LZ_RUN && rdp_lz_more(in, &ip, length, &count) < 0) {
+            return -1;
+        }
+
+        if (count > length - ip || count > room - op) {
+            return -1;
+        }
+
+        // the last literals may end the input, a word past them may not be.
+        if (length - ip - count >= 8) {
+            rdp_lz_copy(out + op, in + ip, count);
+        } else {
+            memcpy(out + op, in + ip, count);
+        }
+
+        ip += count;
+        op += count;
+
+        // the block ends with literals.
+        if (ip == length) {
+            return op;
+        }
+
+        if (length - ip < 2) {
+            return -1;
+        }
+
+        offset = in[ip] | in[ip + 1] << 8;
+        ip += 2;
+        count = token & RDP_LZ_RUN;
+
+        if (count == RDP_LZ_RUN && rdp_lz_more(in, &ip, length, &count) < 0) {
+            return -1;
+        }
+
+        count += RDP_LZ_MIN;
+
+        if (!offset || offset > op || count > room - op) {
+            return -1;
+        }
+
+        // a match overlapping itself repeats its first bytes.
+        if (offset >= 8) {
+            rdp_lz_copy(out + op, out + op - offset, count);
+            op += count;
+        } else {
+            for (; count; count--, op++) {
+                out[op] = out[op - offset];
+            }
+        }
+    }
+}
+
+/*
+ * @param lz compressor, lz->frame set to the block as sent
+ * @param data block, 1 to RDP_LZ_BLOCK bytes
+ * @param length block length
+ * @return unsigned int frame length
+ */
+unsigned int rdp_lz_pack(struct rdp_lz *lz, const char *data,
+    unsigned int length)
+{
+    uint32_t header[2];
+    unsigned int stored = rdp_lz_compress(lz, data, length,
+        lz->frame + RDP_LZ_HEADER, length - 1);
+
+    // a block that does not shrink is sent as it is.
+    if (!stored) {
+        memcpy(lz->frame + RDP_LZ_HEADER, data, length);
+        stored = length;
+    }
+
+    header[0] = htonl(length);
+    header[1] = htonl(stored);
+    memcpy(lz->frame, header, sizeof(header));
+
+    // positions stay increasing until they would wrap, then start over.
+    if (lz->base > UINT_MAX - 2 * RDP_LZ_BLOCK) {
+        memset(lz->table, 0, sizeof(lz->table));
+        lz->base = 1;
+    } else {
+        lz->base += length;
+    }
+
+    return RDP_LZ_HEADER + stored;
+}
+
+/*
+ * @return struct rdp_unlz * decompressor, NULL failed
+ */
+struct rdp_unlz *rdp_unlz_new(void)
+{
+    struct rdp_unlz *unlz = malloc(sizeof(*unlz));
+
+    if (!unlz) {
+        perror("malloc");
+        return NULL;
+    }
+
+    unlz->have = 0;
+    unlz->used = 0;
+    unlz->start = 0;
+    unlz->end = 0;
+    unlz->state = 1;
+    return unlz;
+}
+
+/*
+ * @param unlz decompressor, NULL for none
+ */
+void rdp_unlz_free(struct rdp_unlz *unlz)
+{
+    free(unlz);
+}
+
+/*
+ * @param unlz decompressor, its block delivered
+ * @return int 1: the next frame decoded into out, 0: it is not all
+ * received, -1: malformed
+ */
+int rdp_unlz_next(struct rdp_unlz *unlz)
+{
+    const char *frame = unlz->in + unlz->used;
+    size_t held = unlz->have - unlz->used;
+    uint32_t header[2];
+    unsigned int raw, stored;
+    int length;
+
+    if (held < RDP_LZ_HEADER) {
+        return 0;
+    }
+
+    memcpy(header, frame, sizeof(header));
+    raw = ntohl(header[0]);
+    stored = ntohl(header[1]);
+
+    if (!raw || raw > RDP_LZ_BLOCK || stored > raw) {
+        return -1;
+    }
+
+    if (held < RDP_LZ_HEADER + stored) {
+        return 0;
+    }
+
+    if (stored == raw) {
+        memcpy(unlz->out, frame + RDP_LZ_HEADER, raw);
+        length = raw;
+    } else {
+        length = rdp_lz_decompress(frame + RDP_LZ_HEADER, stored, unlz->out,
+            RDP_LZ_BLOCK);
+    }
+
+    if (length != (int) raw) {
+        return -1;
+    }
+
+    unlz->used += RDP_LZ_HEADER + stored;
+    unlz->start = 0;
+    unlz->end = raw;
+    return 1;
+}
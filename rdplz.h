@@ -0,0 +1,51 @@
+#ifndef RDP_LZ_H
+#define RDP_LZ_H
+
+#include <stddef.h>
+
+// raw bytes compressed as one block, each decoded on its own.
+#define RDP_LZ_BLOCK 65536
+
+// a block's raw and stored length, network order, before its bytes.
+#define RDP_LZ_HEADER 8
+#define RDP_LZ_FRAME (RDP_LZ_HEADER + RDP_LZ_BLOCK)
+
+// received bytes held for decoding, the most the receive window offers.
+#define RDP_LZ_STAGE (1 << 20)
+
+// bytes past a decoded block that copies a word at a time may write.
+#define RDP_LZ_SLACK 16
+
+// match table of 2^RDP_LZ_BITS entries.
+#define RDP_LZ_BITS 14
+#define RDP_LZ_TABLE (1 << RDP_LZ_BITS)
+
+// RDP block compressor, its match table and the block being filled.
+struct rdp_lz {
+    unsigned int table[RDP_LZ_TABLE]; // positions of 4-byte sequences
+    unsigned int base;          // position of the block's first byte
+    unsigned int fill;          // raw bytes in block
+    char block[RDP_LZ_BLOCK];
+    char frame[RDP_LZ_FRAME];   // the block as sent
+};
+
+// RDP block decompressor, frames received and the block they decode to.
+struct rdp_unlz {
+    char in[RDP_LZ_STAGE];      // bytes received, whole frames decoded
+    size_t have;                // bytes in it
+    size_t used;                // of them decoded
+    char out[RDP_LZ_BLOCK + RDP_LZ_SLACK];
+    unsigned int start;         // part of out not delivered yet
+    unsigned int end;
+    int state;                  // connection state, 1: open
+};
+
+struct rdp_lz *rdp_lz_new(void);
+void rdp_lz_free(struct rdp_lz *lz);
+unsigned int rdp_lz_pack(struct rdp_lz *lz, const char *data,
+    unsigned int length);
+struct rdp_unlz *rdp_unlz_new(void);
+void rdp_unlz_free(struct rdp_unlz *unlz);
+int rdp_unlz_next(struct rdp_unlz *unlz);
+
+#endif // RDP_LZ_H
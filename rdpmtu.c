@@ -0,0 +1,118 @@
+#include "rdpmtu.h"
+
+// datagram sizes of common links, 1500 byte Ethernet and jumbo frames.
+static const unsigned int rdp_plateaus[] = {1472, RDP_DGRAM_MAX};
+
+/*
+ * @param pmtu path MTU search
+ * @param size datagram size known to pass
+ * @param ceiling largest datagram size both ends take
+ */
+void rdp_pmtu_init(struct rdp_pmtu *pmtu, unsigned int size,
+    unsigned int ceiling)
+{
+    pmtu->size = size < ceiling ? size : ceiling;
+    pmtu->ceiling = ceiling;
+    pmtu->probe = 0;
+    pmtu->seq = 0;
+    pmtu->fails = 0;
+    pmtu->failed = 0;
+}
+
+/*
+ * Common link sizes are tried first, a lost probe then halves the range
+ * left between the size that passed and the size that did not.
+ *
+ * @param pmtu path MTU search
+ * @return unsigned int datagram size to probe, 0 for none
+ */
+unsigned int rdp_pmtu_next(const struct rdp_pmtu *pmtu)
+{
+    unsigned int i;
+
+    if (pmtu->probe || pmtu->size >= pmtu->ceiling) {
+        return 0;
+    }
+
+    for (i = 0; i < sizeof(rdp_plateaus) / sizeof(*rdp_plateaus); i++) {
+        if (rdp_plateaus[i] > pmtu->size && rdp_plateaus[i] <= pmtu->ceiling) {
+            return rdp_plateaus[i];
+        }
+    }
+
+    if (!pmtu->failed) {
+        return pmtu->ceiling;
+    }
+
+    if (pmtu->ceiling - pmtu->size < RDP_PMTU_STEP) {
+        return 0;
+    }
+
+    return pmtu->size + (pmtu->ceiling - pmtu->size + 1) / 2;
+}
+
+/*
+ * @param pmtu path MTU search
+ * @param seq sequence number of the probe
+ * @param size datagram size of the probe
+ */
+void rdp_pmtu_sent(struct rdp_pmtu *pmtu, unsigned long long seq,
+    unsigned int size)
+{
+    pmtu->probe = size;
+    pmtu->seq = seq;
+}
+
+/*
+ * @param pmtu path MTU search
+ * @param seq sequence number of a segment
+ * @return int 1: segment is the probe in flight, 0: not
+ */
+int rdp_pmtu_probe(const struct rdp_pmtu *pmtu, unsigned long long seq)
+{
+    return pmtu->probe && pmtu->seq == seq;
+}
+
+/*
+ * @param pmtu path MTU search
+ * @param packet ACK received
+ * @return int 1: the probe arrived and the size grew, 0: not
+ */
+int rdp_pmtu_ack(struct rdp_pmtu *pmtu, const struct rdp_packet *packet)
+{
+    unsigned int i;
+    int arrived = pmtu->probe && packet->number > pmtu->seq;
+
+    for (i = 0; i < packet->sacks && pmtu->probe && !arrived; i++) {
+        arrived = packet->sack[i].start <= pmtu->seq &&
+            packet->sack[i].end > pmtu->seq;
+    }
+
+    if (!arrived) {
+        return 0;
+    }
+
+    pmtu->size = pmtu->probe > pmtu->size ? pmtu->probe : pmtu->size;
+    pmtu->probe = 0;
+    pmtu->fails = 0;
+    return 1;
+}
+
+/*
+ * @param pmtu path MTU search
+ */
+void rdp_pmtu_lost(struct rdp_pmtu *pmtu)
+{
+    if (!pmtu->probe) {
+        return;
+    }
+
+    // the path is taken to refuse the size after repeated losses.
+    if (++pmtu->fails >= RDP_PMTU_TRIES) {
+        pmtu->ceiling = pmtu->probe - 1;
+        pmtu->failed = 1;
+        pmtu->fails = 0;
+    }
+
+    pmtu->probe = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef RDP_MTU_H
+#define RDP_MTU_H
+
+#include "rdppkt.h"
+
+// lost probes of one size before the path is taken to refuse it.
+#define RDP_PMTU_TRIES 2
+
+// searching stops once the unknown range is this narrow.
+#define RDP_PMTU_STEP 64
+
+// RDP path MTU search, sizes are whole datagrams.
+struct rdp_pmtu {
+    unsigned int size;
+    unsigned int ceiling;
+    unsigned int probe;
+    unsigned long long seq;
+    unsigned int fails;
+    unsigned int failed;
+};
+
+void rdp_pmtu_init(struct rdp_pmtu *pmtu, unsigned int size,
+    unsigned int ceiling);
+unsigned int rdp_pmtu_next(const struct rdp_pmtu *pmtu);
+void rdp_pmtu_sent(struct rdp_pmtu *pmtu, unsigned long long seq,
+    unsigned int size);
+int rdp_pmtu_probe(const struct rdp_pmtu *pmtu, unsigned long long seq);
+int rdp_pmtu_ack(struct rdp_pmtu *pmtu, const struct rdp_packet *packet);
+void rdp_pmtu_lost(struct rdp_pmtu *pmtu);
+
+#endif // RDP_MTU_H
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/net_tstamp.h>
+#include "rdppace.h"
+
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#endif
+
+/*
+ * @param pace pacer, unpaced until a rate is set
+ * @param sock socket handler
+ * @param txtime 1: hand departures to the kernel, which needs the fq
+ * qdisc to keep them
+ * @param now current time
+ */
+void rdp_pace_init(struct rdp_pace *pace, int sock, int txtime,
+    unsigned long long now)
+{
+    struct sock_txtime config;
+
+    memset(pace, 0, sizeof(*pace));
+    pace->next = now;
+    pace->since = now;
+
+    if (!txtime) {
+        return;
+    }
+
+    // the departures are rdp_clock times, on the clock fq keeps.
+    config.clockid = CLOCK_MONOTONIC;
+    config.flags = 0;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_TXTIME, &config,
+        sizeof(config)) < 0) {
+        perror("SO_TXTIME, pacing without it");
+        return;
+    }
+
+    pace->txtime = 1;
+}
+
+/*
+ * @param pace pacer
+ * @param rate bytes/s, 0 for unpaced
+ * @param mss largest datagram, a quantum holds a few at least
+ * @param now current time
+ */
+void rdp_pace_set(struct rdp_pace *pace, double rate, unsigned int mss,
+    unsigned long long now)
+{
+    double quantum = rate * RDP_PACE_SLICE / 1e6;
+
+    // the target is kept over the time datagrams were paced.
+    if (pace->start && pace->rate > 0) {
+        pace->planned += pace->rate * (now - pace->since) / 1e6;
+    }
+
+    quantum = quantum < RDP_PACE_BYTES ? quantum : RDP_PACE_BYTES;
+    quantum = quantum > RDP_PACE_SEGS * mss ? quantum : RDP_PACE_SEGS * mss;
+
+    pace->rate = rate;
+    pace->quantum = quantum;
+    pace->since = now;
+}
+
+/*
+ * @param pace pacer
+ * @param now current time
+ * @return unsigned long long time the next datagram may be queued, 0: now
+ */
+unsigned long long rdp_pace_due(const struct rdp_pace *pace,
+    unsigned long long now)
+{
+    unsigned long long ahead = pace->txtime ? RDP_PACE_HORIZON : 0;
+
+    if (pace->rate <= 0 || pace->next <= now + ahead) {
+        return 0;
+    }
+
+    return pace->next - ahead;
+}
+
+/*
+ * @param pace pacer
+ * @param bytes datagram length
+ * @param now current time
+ * @return unsigned long long departure of the datagram, not before now
+ */
+unsigned long long rdp_pace_sent(struct rdp_pace *pace, unsigned int bytes,
+    unsigned long long now)
+{
+    double credit;
+    unsigned long long at;
+
+    if (pace->rate <= 0) {
+        return now;
+    }
+
+    // an idle pacer sends one quantum back to back, no more.
+    credit = pace->quantum * 1e6 / pace->rate;
+
+    if (pace->next + credit < now) {
+        pace->next = now - credit;
+    }
+
+    at = pace->next > now ? pace->next : now;
+    pace->next += bytes * 1e6 / pace->rate;
+
+    if (!pace->start) {
+        pace->start = at;
+        pace->planned = 0;
+        pace->since = at;
+    }
+
+    pace->last = at;
+    pace->bytes += bytes;
+    return at;
+}
+
+/*
+ * @param pace pacer of a transfer that ended
+ * @param stats statistics the bytes paced, the time they took and what
+ * the target rate allowed in it are added to
+ */
+void rdp_pace_stats(const struct rdp_pace *pace, struct rdp_stats *stats)
+{
+    double planned = pace->planned;
+
+    if (!pace->start) {
+        return;
+    }
+
+    if (pace->last > pace->since) {
+        planned += pace->rate * (pace->last - pace->since) / 1e6;
+    }
+
+    stats->paced += pace->bytes;
+    stats->pacetime += pace->last - pace->start;
+    stats->planned += planned;
+}
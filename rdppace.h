@@ -0,0 +1,43 @@
+#ifndef RDP_PACE_H
+#define RDP_PACE_H
+
+#include "rdp.h"
+
+// waits shorter than this are spun, select sleeps too long, microseconds.
+#define RDP_PACE_SPIN 100
+
+// time the bytes sent back to back span at the rate, microseconds.
+#define RDP_PACE_SLICE 1000
+
+// bytes sent back to back at most, and at least in datagrams.
+#define RDP_PACE_BYTES 65536
+#define RDP_PACE_SEGS 2
+
+// how far ahead the kernel is handed departures with SO_TXTIME.
+#define RDP_PACE_HORIZON 2000
+
+// RDP pacer, datagrams leave at a rate instead of in line rate bursts.
+// Idle time earns at most a quantum of credit, sent back to back.
+struct rdp_pace {
+    double rate;                // bytes/s, 0 for unpaced
+    double planned;             // bytes the target rate allowed so far
+    double next;                // departure of the next datagram
+    unsigned long long since;   // time the rate was last set
+    unsigned long long start;   // departure of the first paced datagram
+    unsigned long long last;    // departure of the latest one
+    unsigned long long bytes;   // bytes paced
+    unsigned int quantum;       // bytes sent back to back at most
+    int txtime;                 // the kernel holds datagrams to departure
+};
+
+void rdp_pace_init(struct rdp_pace *pace, int sock, int txtime,
+    unsigned long long now);
+void rdp_pace_set(struct rdp_pace *pace, double rate, unsigned int mss,
+    unsigned long long now);
+unsigned long long rdp_pace_due(const struct rdp_pace *pace,
+    unsigned long long now);
+unsigned long long rdp_pace_sent(struct rdp_pace *pace, unsigned int bytes,
+    unsigned long long now);
+void rdp_pace_stats(const struct rdp_pace *pace, struct rdp_stats *stats);
+
+#endif // RDP_PACE_H
@@ -1,30 +1,119 @@
+#include <arpa/inet.h>
+#include <endian.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "rdppkt.h"
 
 #define RDP_DELIMS " \t\n:"
-#define RDP_BITS_COUNT 6
+#define RDP_BITS_COUNT 14
 #define RDP_TOKEN_COUNT RDP_BITS_COUNT * 2 + 1
 
 // RDP header bits.
 #define RDP_ACK_BITS 0x0001
-#define RDP_MAG_BITS 0x0002
-#define RDP_PAY_BITS 0x0004
-#define RDP_SEQ_BITS 0x0008
-#define RDP_TYP_BITS 0x0010
-#define RDP_WIN_BITS 0x0020
-#define RDP_DAT_BITS 0x0040
+#define RDP_CAP_BITS 0x0002
+#define RDP_CON_BITS 0x0004
+#define RDP_FRQ_BITS 0x0008
+#define RDP_MAG_BITS 0x0010
+#define RDP_MSS_BITS 0x0020
+#define RDP_OFF_BITS 0x0040
+#define RDP_PAY_BITS 0x0080
+#define RDP_RES_BITS 0x0100
+#define RDP_SEQ_BITS 0x0200
+#define RDP_SIZ_BITS 0x0400
+#define RDP_STR_BITS 0x0800
+#define RDP_TYP_BITS 0x1000
+#define RDP_WIN_BITS 0x2000
+#define RDP_DAT_BITS 0x4000
+
+// optional header bits.
+#define RDP_OPT_BITS (RDP_CAP_BITS | RDP_CON_BITS | RDP_FRQ_BITS | \
+    RDP_MSS_BITS | RDP_OFF_BITS | RDP_RES_BITS | RDP_SIZ_BITS | \
+    RDP_STR_BITS | RDP_DAT_BITS)
+
+// RDP header strings.
+#define RDP_ACK_HDR "Magic: cscs361p2\nType: ACK\nAcknowledgement: %llu\nWindow: %u\n\n"
+#define RDP_DAT_HDR "Magic: cscs361p2\nType: DAT\nSequence: %llu\nPayload %u\n\n"
+#define RDP_FIN_HDR "Magic: cscs361p2\nType: FIN\nSequence: %llu\n\n"
+#define RDP_RST_HDR "Magic: cscs361p2\nType: RST\n\n"
+#define RDP_SYN_HDR "Magic: cscs361p2\nType: SYN\nSequence: %llu\n\n"
+
+// RDP header strings with capabilities.
+#define RDP_ACK_CAP_HDR "Magic: cscs361p2\nType: ACK\nAcknowledgement: %llu\nWindow: %u\nCapability: %u\nMss: %u\nConnection: %u\n"
+#define RDP_SYN_CAP_HDR "Magic: cscs361p2\nType: SYN\nSequence: %llu\nCapability: %u\nMss: %u\nConnection: %u\n"
+
+// optional SYN fields, after the ones above and before the blank line.
+#define RDP_SYN_STR_OPT "Stripes: %u\nOffset: %llu\n"
+#define RDP_SYN_SIZ_OPT "Size: %llu\n"
+#define RDP_SYN_FRQ_OPT "Frequency: %u\n"
+#define RDP_SYN_RES_OPT "Resume: %llu\n"
+#define RDP_ACK_OFF_OPT "Offset: %llu\n"
+
+// RDP binary header, all fields in network byte order.
+struct rdp_wire {
+    uint16_t magic;
+    uint8_t type;
+    uint8_t flags;
+    uint16_t length;
+    uint16_t hlen;
+    uint64_t number;
+    uint32_t window;
+} __attribute__((packed));
+
+// RDP binary header options.
+#define RDP_OPT_SACK 1
+#define RDP_OPT_TS 2
+#define RDP_OPT_FEC 3
+
+// largest header with every option.
+#define RDP_OPT_MAX (RDP_BIN_LEN + 3 * sizeof(struct rdp_option) + \
+    RDP_SACK_BLOCKS * 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t) + \
+    sizeof(struct rdp_fec_tag))
+
+// RDP binary header option, length includes this header.
+struct rdp_option {
+    uint8_t kind;
+    uint8_t length;
+    uint16_t reserved;
+} __attribute__((packed));
+
+// RDP FEC option, the tag of a data or parity packet.
+struct rdp_fec_tag {
+    uint32_t block;
+    uint8_t index;
+    uint8_t count;
+    uint8_t parity;
+    uint8_t reserved;
+} __attribute__((packed));
 
 
 int rdp_interp_magic(char *, struct rdp_packet*);
 int rdp_interp_number(char *, struct rdp_packet*);
 int rdp_interp_info(char *, struct rdp_packet*);
 int rdp_interp_type(char *, struct rdp_packet*);
+int rdp_interp_caps(char *, struct rdp_packet*);
+int rdp_interp_mss(char *, struct rdp_packet*);
+int rdp_interp_conn(char *, struct rdp_packet*);
+int rdp_interp_offset(char *, struct rdp_packet*);
+int rdp_interp_resume(char *, struct rdp_packet*);
+int rdp_interp_stripes(char *, struct rdp_packet*);
+int rdp_interp_size(char *, struct rdp_packet*);
+int rdp_interp_ackfreq(char *, struct rdp_packet*);
 
 
 typedef int (*rdp_interp_func)(char *, struct rdp_packet *);
 
-const int rdp_contents[RDP_TYPE_COUNT] = {
+const char *rdp_types[RDP_TYPE_COUNT] = {
+    "ACK",
+    "DAT",
+    "FIN",
+    "RST",
+    "SYN",
+    "FEC"
+};
+
+const int rdp_contents[RDP_TEXT_COUNT] = {
     RDP_MAG_BITS | RDP_TYP_BITS | RDP_ACK_BITS | RDP_WIN_BITS,
     RDP_MAG_BITS | RDP_TYP_BITS | RDP_SEQ_BITS | RDP_PAY_BITS,
     RDP_MAG_BITS | RDP_TYP_BITS | RDP_SEQ_BITS,
@@ -34,18 +123,34 @@ const int rdp_contents[RDP_TYPE_COUNT] = {
 
 const char *rdp_fields[RDP_BITS_COUNT] = {
     "acknowledgement",
+    "capability",
+    "connection",
+    "frequency",
     "magic",
+    "mss",
+    "offset",
     "payload",
+    "resume",
     "sequence",
+    "size",
+    "stripes",
     "type",
     "window"
 };
 
 const rdp_interp_func rdp_parsers[RDP_BITS_COUNT] = {
     rdp_interp_number,
+    rdp_interp_caps,
+    rdp_interp_conn,
+    rdp_interp_ackfreq,
     rdp_interp_magic,
+    rdp_interp_mss,
+    rdp_interp_offset,
     rdp_interp_info,
+    rdp_interp_resume,
     rdp_interp_number,
+    rdp_interp_size,
+    rdp_interp_stripes,
     rdp_interp_type,
     rdp_interp_info
 };
@@ -84,7 +189,7 @@ int rdp_bsearch(char *field, const char **array, size_t length)
  */
 int rdp_interp_type(char *field, struct rdp_packet *packet)
 {
-    int result = rdp_bsearch(field, rdp_types, RDP_TYPE_COUNT);
+    int result = rdp_bsearch(field, rdp_types, RDP_TEXT_COUNT);
     
     if (result < 0) {
         return -1; 
@@ -94,6 +199,84 @@ int rdp_interp_type(char *field, struct rdp_packet *packet)
     return result;
 }
 
+/*
+ * @param buffer RDP packet with binary header
+ * @param length packet length
+ * @param packet structure of packet
+ * @return int packet type, -1 failed
+ */
+int rdp_interp_binary(char *buffer, size_t length, struct rdp_packet *packet)
+{
+    struct rdp_wire wire;
+    struct rdp_option option;
+    struct rdp_fec_tag tag;
+    uint64_t edge[2];
+    uint32_t stamp[2];
+    size_t hlen, pay, at;
+    unsigned int i;
+
+    memcpy(&wire, buffer, sizeof(wire));
+    hlen = ntohs(wire.hlen);
+    pay = ntohs(wire.length);
+
+    packet->type = wire.type;
+    packet->number = be64toh(wire.number);
+    packet->info = wire.type == RDP_DAT || wire.type == RDP_FEC ? pay :
+        ntohl(wire.window);
+    packet->caps = 0;
+    packet->data = buffer + hlen;
+
+    // single test for every malformed case.
+    if ((wire.type >= RDP_TYPE_COUNT) | (hlen < RDP_BIN_LEN) |
+        (hlen + pay > length)) {
+        packet->type = -1;
+        return -1;
+    }
+
+    // options fill the header past its fixed part.
+    for (at = RDP_BIN_LEN; at + sizeof(option) <= hlen; at += option.length) {
+        memcpy(&option, buffer + at, sizeof(option));
+
+        if (option.length < sizeof(option) || at + option.length > hlen) {
+            packet->type = -1;
+            return -1;
+        }
+
+        if (option.kind == RDP_OPT_SACK) {
+            packet->sacks = (option.length - sizeof(option)) / sizeof(edge);
+            packet->sacks = packet->sacks < RDP_SACK_BLOCKS ?
+                packet->sacks : RDP_SACK_BLOCKS;
+
+            for (i = 0; i < packet->sacks; i++) {
+                memcpy(edge, buffer + at + sizeof(option) + i * sizeof(edge),
+                    sizeof(edge));
+                packet->sack[i].start = be64toh(edge[0]);
+                packet->sack[i].end = be64toh(edge[1]);
+            }
+        } else if (option.kind == RDP_OPT_TS &&
+            option.length == sizeof(option) + sizeof(stamp)) {
+            memcpy(stamp, buffer + at + sizeof(option), sizeof(stamp));
+            packet->tsval = ntohl(stamp[0]);
+            packet->tsecr = ntohl(stamp[1]);
+        } else if (option.kind == RDP_OPT_FEC &&
+            option.length == sizeof(option) + sizeof(tag)) {
+            memcpy(&tag, buffer + at + sizeof(option), sizeof(tag));
+            packet->tag.block = ntohl(tag.block);
+            packet->tag.index = tag.index;
+            packet->tag.count = tag.count;
+            packet->tag.parity = tag.parity;
+        }
+    }
+
+    // parity is only sent with its tag.
+    if (packet->type == RDP_FEC && !packet->tag.block) {
+        packet->type = -1;
+        return -1;
+    }
+
+    return packet->type;
+}
+
 /* 
  * @param buffer RDP packet
  * @param length packet length
@@ -108,9 +291,27 @@ int rdp_interp(char *buffer, size_t length,
     int field;
     int contents = 0;
     packet->type = -1;
+    packet->caps = 0;
+    packet->mss = 0;
+    packet->conn = 0;
+    packet->stripes = 0;
+    packet->offset = 0;
+    packet->size = 0;
+    packet->resume = 0;
+    packet->ackfreq = 0;
+    packet->sacks = 0;
+    packet->tsval = 0;
+    packet->tsecr = 0;
+    memset(&packet->tag, 0, sizeof(packet->tag));
 
     int ret = -1;
 
+    // binary header is recognized by its magic number.
+    if (length >= RDP_BIN_LEN && (((unsigned char) buffer[0] << 8) |
+        (unsigned char) buffer[1]) == RDP_BIN_MAGIC) {
+        return rdp_interp_binary(buffer, length, packet);
+    }
+
     token = strstr(buffer, "\n\n");
 
     if (!token)  return ret;
@@ -141,13 +342,198 @@ int rdp_interp(char *buffer, size_t length,
     if (packet->type < 0) {
         return 1;
     } else {
-        if (rdp_contents[packet->type] != contents)
+        if (rdp_contents[packet->type] != (contents & ~RDP_OPT_BITS))
             return -1;
         else
             return packet->type;
     }
 }
 
+/*
+ * @param buffer header output
+ * @param length buffer size
+ * @param packet SYN offering capabilities
+ * @return int header length, -1 failed
+ */
+static int rdp_format_syn(char *buffer, size_t length,
+    const struct rdp_packet *packet)
+{
+    size_t fill_len = snprintf(buffer, length, RDP_SYN_CAP_HDR,
+        packet->number, packet->caps, packet->mss, packet->conn);
+
+    if (packet->stripes && fill_len < length) {
+        fill_len += snprintf(buffer + fill_len, length - fill_len,
+            RDP_SYN_STR_OPT, packet->stripes, packet->offset);
+    }
+
+    if (packet->size && fill_len < length) {
+        fill_len += snprintf(buffer + fill_len, length - fill_len,
+            RDP_SYN_SIZ_OPT, packet->size);
+    }
+
+    if (packet->ackfreq && fill_len < length) {
+        fill_len += snprintf(buffer + fill_len, length - fill_len,
+            RDP_SYN_FRQ_OPT, packet->ackfreq);
+    }
+
+    if (packet->resume && fill_len < length) {
+        fill_len += snprintf(buffer + fill_len, length - fill_len,
+            RDP_SYN_RES_OPT, packet->resume);
+    }
+
+    if (fill_len + 1 >= length) {
+        return -1;
+    }
+
+    buffer[fill_len++] = '\n';
+    buffer[fill_len] = '\0';
+    return fill_len;
+}
+
+/*
+ * @param buffer header output
+ * @param length buffer size
+ * @param packet ACK of a SYN, offset the bytes a resumed transfer skips
+ * @return int header length, -1 failed
+ */
+static int rdp_format_ack(char *buffer, size_t length,
+    const struct rdp_packet *packet)
+{
+    size_t fill_len = snprintf(buffer, length, RDP_ACK_CAP_HDR,
+        packet->number, packet->info, packet->caps, packet->mss,
+        packet->conn);
+
+    if (packet->offset && fill_len < length) {
+        fill_len += snprintf(buffer + fill_len, length - fill_len,
+            RDP_ACK_OFF_OPT, packet->offset);
+    }
+
+    if (fill_len + 1 >= length) {
+        return -1;
+    }
+
+    buffer[fill_len++] = '\n';
+    buffer[fill_len] = '\0';
+    return fill_len;
+}
+
+/*
+ * @param buffer header output
+ * @param length buffer size
+ * @param caps negotiated capabilities
+ * @param packet packet to describe, data is not copied
+ * @return int header length, -1 failed
+ */
+int rdp_format(char *buffer, size_t length, unsigned int caps,
+    const struct rdp_packet *packet)
+{
+    struct rdp_wire wire;
+    struct rdp_option option;
+    struct rdp_fec_tag tag;
+    uint64_t edge[2];
+    uint32_t stamp[2];
+    unsigned int cap = packet->caps;
+    int data = packet->type == RDP_DAT || packet->type == RDP_FEC;
+    unsigned int i, hlen = RDP_BIN_LEN;
+
+    // SYN and its ACK negotiate, so they are always text.
+    if ((caps & RDP_CAP_BIN) && !cap && packet->type != RDP_SYN) {
+        if (length < RDP_OPT_MAX) {
+            return -1;
+        }
+
+        if (packet->sacks && (caps & RDP_CAP_SACK)) {
+            option.kind = RDP_OPT_SACK;
+            option.length = sizeof(option) + packet->sacks * sizeof(edge);
+            option.reserved = 0;
+            memcpy(buffer + hlen, &option, sizeof(option));
+
+            for (i = 0; i < packet->sacks; i++) {
+                edge[0] = htobe64(packet->sack[i].start);
+                edge[1] = htobe64(packet->sack[i].end);
+                memcpy(buffer + hlen + sizeof(option) + i * sizeof(edge),
+                    edge, sizeof(edge));
+            }
+
+            hlen += option.length;
+        }
+
+        if (caps & RDP_CAP_TS) {
+            option.kind = RDP_OPT_TS;
+            option.length = sizeof(option) + sizeof(stamp);
+            option.reserved = 0;
+            stamp[0] = htonl(packet->tsval);
+            stamp[1] = htonl(packet->tsecr);
+            memcpy(buffer + hlen, &option, sizeof(option));
+            memcpy(buffer + hlen + sizeof(option), stamp, sizeof(stamp));
+            hlen += option.length;
+        }
+
+        if (data && (caps & RDP_CAP_FEC) && packet->tag.block) {
+            option.kind = RDP_OPT_FEC;
+            option.length = sizeof(option) + sizeof(tag);
+            option.reserved = 0;
+            tag.block = htonl(packet->tag.block);
+            tag.index = packet->tag.index;
+            tag.count = packet->tag.count;
+            tag.parity = packet->tag.parity;
+            tag.reserved = 0;
+            memcpy(buffer + hlen, &option, sizeof(option));
+            memcpy(buffer + hlen + sizeof(option), &tag, sizeof(tag));
+            hlen += option.length;
+        }
+
+        wire.magic = htons(RDP_BIN_MAGIC);
+        wire.type = packet->type;
+        wire.flags = 0;
+        wire.length = htons(data ? packet->info : 0);
+        wire.hlen = htons(hlen);
+        wire.number = htobe64(packet->number);
+        wire.window = htonl(data ? 0 : packet->info);
+        memcpy(buffer, &wire, sizeof(wire));
+        return hlen;
+    }
+
+    switch (packet->type) {
+    case RDP_ACK:
+        if (cap) {
+            return rdp_format_ack(buffer, length, packet);
+        }
+        return snprintf(buffer, length, RDP_ACK_HDR, packet->number,
+            packet->info);
+    case RDP_DAT:
+        return snprintf(buffer, length, RDP_DAT_HDR, packet->number,
+            packet->info);
+    case RDP_FIN:
+        return snprintf(buffer, length, RDP_FIN_HDR, packet->number);
+    case RDP_RST:
+        return snprintf(buffer, length, RDP_RST_HDR);
+    case RDP_SYN:
+        if (cap) {
+            return rdp_format_syn(buffer, length, packet);
+        }
+        return snprintf(buffer, length, RDP_SYN_HDR, packet->number);
+    }
+
+    return -1;
+}
+
+/*
+ * @param caps negotiated capabilities
+ * @return unsigned int header length of a data packet
+ */
+unsigned int rdp_overhead(unsigned int caps)
+{
+    if (!(caps & RDP_CAP_BIN)) {
+        return RDP_BUF_SIZE - RDP_MAX_PAY;
+    }
+
+    return RDP_BIN_LEN + (caps & RDP_CAP_TS ?
+        sizeof(struct rdp_option) + 2 * sizeof(uint32_t) : 0) +
+        (caps & RDP_CAP_FEC ?
+        sizeof(struct rdp_option) + sizeof(struct rdp_fec_tag) : 0);
+}
+
 /*
  * @param field string to check
  * @param packet dummy parameter
@@ -166,7 +552,7 @@ int rdp_interp_magic(char *field, struct rdp_packet *packet)
  */
 int rdp_interp_number(char *field, struct rdp_packet *packet)
 {
-    packet->number = atoi(field);
+    packet->number = strtoull(field, NULL, 10);
     return 0;
 }
 
@@ -177,8 +563,95 @@ int rdp_interp_number(char *field, struct rdp_packet *packet)
  */
 int rdp_interp_info(char *field, struct rdp_packet *packet)
 {
-    packet->info = atoi(field);
+    packet->info = strtoul(field, NULL, 10);
+    return 0;
+}
+
+/*
+ * @param field string to check
+ * @param packet RDP packet
+ * @return int 0
+ */
+int rdp_interp_caps(char *field, struct rdp_packet *packet)
+{
+    packet->caps = atoi(field);
     return 0;
 }
 
 
+/*
+ * @param field string to check
+ * @param packet RDP packet
+ * @return int 0
+ */
+int rdp_interp_mss(char *field, struct rdp_packet *packet)
+{
+    packet->mss = atoi(field);
+    return 0;
+}
+
+/*
+ * @param field string to check
+ * @param packet RDP packet
+ * @return int 0
+ */
+int rdp_interp_conn(char *field, struct rdp_packet *packet)
+{
+    packet->conn = strtoul(field, NULL, 10);
+    return 0;
+}
+
+/*
+ * @param field string to check
+ * @param packet RDP packet
+ * @return int 0
+ */
+int rdp_interp_offset(char *field, struct rdp_packet *packet)
+{
+    packet->offset = strtoull(field, NULL, 10);
+    return 0;
+}
+
+/*
+ * @param field string to check
+ * @param packet RDP packet
+ * @return int 0
+ */
+int rdp_interp_resume(char *field, struct rdp_packet *packet)
+{
+    packet->resume = strtoull(field, NULL, 10);
+    return 0;
+}
+
+/*
+ * @param field string to check
+ * @param packet RDP packet
+ * @return int 0
+ */
+int rdp_interp_stripes(char *field, struct rdp_packet *packet)
+{
+    packet->stripes = atoi(field);
+    return 0;
+}
+
+/*
+ * @param field string to check
+ * @param packet RDP packet
+ * @return int 0
+ */
+int rdp_interp_size(char *field, struct rdp_packet *packet)
+{
+    packet->size = strtoull(field, NULL, 10);
+    return 0;
+}
+
+/*
+ * @param field string to check
+ * @param packet RDP packet
+ * @return int 0
+ */
+int rdp_interp_ackfreq(char *field, struct rdp_packet *packet)
+{
+    packet->ackfreq = atoi(field);
+    return 0;
+}
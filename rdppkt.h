@@ -1,32 +1,86 @@
 #ifndef RDP_PKT_H
 #define RDP_PKT_H
 
+#include <stddef.h>
+
 // RDP header types.
 #define RDP_ACK 0
 #define RDP_DAT 1
 #define RDP_FIN 2
 #define RDP_RST 3
 #define RDP_SYN 4
+#define RDP_FEC 5
+
+// types with a text header, FEC is binary only.
+#define RDP_TEXT_COUNT 5
+#define RDP_TYPE_COUNT 6
+
+// packet size.
+#define RDP_BUF_SIZE 1024
+#define RDP_MAX_PAY 959
+
+// largest datagram, a 9000 byte MTU less IP and UDP headers.
+#define RDP_DGRAM_MAX 8972
+
+// RDP capabilities, offered in SYN and confirmed in its ACK.
+#define RDP_CAP_BIN 0x0001
+#define RDP_CAP_SACK 0x0002
+#define RDP_CAP_TS 0x0004
+#define RDP_CAP_FEC 0x0008
+#define RDP_CAP_LZ 0x0010
+
+// offered by every sender, FEC and LZ only by one that sends parity or
+// compressed blocks.
+#define RDP_CAPS (RDP_CAP_BIN | RDP_CAP_SACK | RDP_CAP_TS)
 
-#define RDP_TYPE_COUNT 5
+// RDP binary header.
+#define RDP_BIN_MAGIC 0x52b1
+#define RDP_BIN_LEN 20
+
+// selective acknowledgement blocks in an ACK.
+#define RDP_SACK_BLOCKS 4
+
+// RDP selective acknowledgement block, [start, end).
+struct rdp_sack {
+    unsigned long long start;
+    unsigned long long end;
+};
+
+// RDP FEC tag of a data or parity packet, block 0 for none.
+struct rdp_tag {
+    unsigned int block;
+    unsigned int index;         // segment in the block, or stripe of parity
+    unsigned int count;         // data segments in the block, parity only
+    unsigned int parity;        // parity segments of the block
+};
 
 // RDP packet 
 struct rdp_packet {
     char *data;
-    unsigned int number;
+    unsigned long long number;
     unsigned int info;
+    unsigned int caps;
+    unsigned int mss;
+    unsigned int conn;
+    unsigned int stripes;
+    unsigned long long offset;
+    unsigned long long size;
+    unsigned long long resume;
+    unsigned int ackfreq;
+    unsigned int sacks;
+    struct rdp_sack sack[RDP_SACK_BLOCKS];
+    unsigned int tsval;
+    unsigned int tsecr;
+    struct rdp_tag tag;
     int type; 
 };
 
 // RPD types
-static const char *rdp_types[RDP_TYPE_COUNT] = {
-    "ACK",
-    "DAT",
-    "FIN",
-    "RST",
-    "SYN"
-};
+extern const char *rdp_types[RDP_TYPE_COUNT];
 
 int rdp_interp(char *buffer, size_t length, struct rdp_packet *packet);
+int rdp_format(char *buffer, size_t length, unsigned int caps,
+    const struct rdp_packet *packet);
+unsigned int rdp_overhead(unsigned int caps);
 
 #endif // RDP_PKT_H
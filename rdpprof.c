@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <string.h>
+#include "rdpprof.h"
+
+#ifdef RDP_PROFILE
+
+static const char *rdp_stage_names[RDP_STAGES] = {
+    "header", "copy", "fec", "send", "wait", "recv", "parse", "log",
+    "lz"
+};
+
+/*
+ * @param prof stage accumulators, cleared
+ */
+void rdp_prof_init(struct rdp_prof *prof)
+{
+    memset(prof, 0, sizeof(*prof));
+    prof->ns = rdp_prof_ns();
+    prof->tick = rdp_prof_tick();
+}
+
+/*
+ * @param sum stage accumulators holding the sums
+ * @param add stage accumulators of a flow
+ */
+void rdp_prof_merge(struct rdp_prof *sum, const struct rdp_prof *add)
+{
+    unsigned int i;
+
+    for (i = 0; i < RDP_STAGES; i++) {
+        sum->ticks[i] += add->ticks[i];
+        sum->calls[i] += add->calls[i];
+    }
+
+    // flows ran side by side, the earliest start calibrates them all.
+    if (!sum->ns || (add->ns && add->ns < sum->ns)) {
+        sum->ns = add->ns;
+        sum->tick = add->tick;
+    }
+}
+
+/*
+ * @param prof stage accumulators
+ * @param packets data packets the stages handled
+ */
+void rdp_prof_print(const struct rdp_prof *prof, unsigned long long packets)
+{
+    unsigned long long ns = rdp_prof_ns() - prof->ns;
+    unsigned long long ticks = rdp_prof_tick() - prof->tick;
+    double scale = ticks ? (double) ns / ticks : 1.0;
+    double total = 0;
+    unsigned int i;
+
+    packets = packets ? packets : 1;
+    printf("stage cost per data packet (ns):");
+
+    for (i = 0; i < RDP_STAGES; i++) {
+        printf(" %s %.1f", rdp_stage_names[i],
+            prof->ticks[i] * scale / packets);
+        total += prof->ticks[i] * scale / packets;
+    }
+
+    printf(", total %.1f\n", total);
+    printf("stage calls:");
+
+    for (i = 0; i < RDP_STAGES; i++) {
+        printf(" %s %llu", rdp_stage_names[i], prof->calls[i]);
+    }
+
+    printf("\n");
+}
+
+#endif // RDP_PROFILE
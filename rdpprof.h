@@ -0,0 +1,76 @@
+#ifndef RDP_PROF_H
+#define RDP_PROF_H
+
+// stages of the packet path timed in a build with -DRDP_PROFILE.
+#define RDP_STAGE_HEADER 0      // rdp_format and rdp_ack
+#define RDP_STAGE_COPY 1        // payloads copied into the receive buffer
+#define RDP_STAGE_FEC 2         // parity summed and segments rebuilt
+#define RDP_STAGE_SEND 3        // sendmmsg, or the ring's submissions
+#define RDP_STAGE_WAIT 4        // select, or the ring's waits
+#define RDP_STAGE_RECV 5        // recvmmsg, blocking for the first datagram
+#define RDP_STAGE_PARSE 6       // rdp_interp
+#define RDP_STAGE_LOG 7         // rdp_log
+#define RDP_STAGE_LZ 8          // blocks compressed or decoded
+#define RDP_STAGES 9
+
+#ifdef RDP_PROFILE
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// RDP stage accumulators, in ticks of rdp_prof_tick().
+struct rdp_prof {
+    unsigned long long ticks[RDP_STAGES];
+    unsigned long long calls[RDP_STAGES];
+    unsigned long long tick;    // ticks and nanoseconds when timing began,
+    unsigned long long ns;      // which convert ticks to time
+};
+
+/*
+ * @return unsigned long long nanoseconds of CLOCK_MONOTONIC_RAW
+ */
+static inline unsigned long long rdp_prof_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * @return unsigned long long time stamp counter where there is one, else
+ * nanoseconds
+ */
+static inline unsigned long long rdp_prof_tick(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return rdp_prof_ns();
+#endif
+}
+
+// times the statements given as one stage.
+#define RDP_PROF(prof, stage, ...) do { \
+    unsigned long long rdp_prof_start = rdp_prof_tick(); \
+    __VA_ARGS__; \
+    (prof)->ticks[stage] += rdp_prof_tick() - rdp_prof_start; \
+    (prof)->calls[stage]++; \
+} while (0)
+
+void rdp_prof_init(struct rdp_prof *prof);
+void rdp_prof_merge(struct rdp_prof *sum, const struct rdp_prof *add);
+void rdp_prof_print(const struct rdp_prof *prof, unsigned long long packets);
+
+#else
+
+// compiled out, the statements run as they are and prof is never looked at.
+#define RDP_PROF(prof, stage, ...) do { \
+    __VA_ARGS__; \
+} while (0)
+
+#endif // RDP_PROFILE
+
+#endif // RDP_PROF_H
@@ -0,0 +1,541 @@
+/**
+ * RDP impairment proxy
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "rdpclock.h"
+
+// clients at most, each with its own socket towards the server.
+#define RDPPROXY_CLIENTS 64
+
+// datagrams held at most, the rest are dropped.
+#define RDPPROXY_HELD 65536
+
+// largest datagram.
+#define RDPPROXY_DGRAM 65536
+
+// time a reordered datagram is held back for the next ones to overtake
+// it, microseconds.
+#define RDPPROXY_REORDER 1000
+
+// bytes waiting behind a rate cap before datagrams are dropped.
+#define RDPPROXY_QUEUE (1 << 20)
+
+// receive buffer of each socket, bursts wait there while the proxy sleeps.
+#define RDPPROXY_RCVBUF (8 << 20)
+
+// RDP impairment profile, applied to each direction on its own.
+struct rdpproxy_profile {
+    double delay;               // one way, microseconds
+    double jitter;              // delay varies by up to this either way
+    double loss;                // chance a datagram is dropped
+    double reorder;             // chance it is held back
+    double duplicate;           // chance it is sent twice
+    double rate;                // bytes/s, 0 for no cap
+    unsigned long long queue;   // bytes waiting for the cap at most
+};
+
+// RDP proxy direction, the link the datagrams of one way share.
+struct rdpproxy_link {
+    const char *name;
+    unsigned long long free;    // time the link sent all it holds
+    unsigned long long forwarded;
+    unsigned long long lost;
+    unsigned long long queued;  // dropped by a full queue
+    unsigned long long duplicated;
+    unsigned long long reordered;
+};
+
+struct rdpproxy_client {
+    struct sockaddr_in addr;
+    int sock;                   // towards the server, the replies come here
+};
+
+// RDP proxy datagram, sent once its time comes.
+struct rdpproxy_held {
+    unsigned long long due;
+    unsigned long long order;   // datagrams due at once leave in order
+    struct sockaddr_in to;
+    int sock;
+    size_t length;
+    char *data;
+};
+
+struct rdpproxy {
+    int sock;                   // the clients send here
+    struct sockaddr_in server;
+    struct rdpproxy_profile profile;
+    struct rdpproxy_link links[2]; // 0: to the server, 1: to the clients
+    struct rdpproxy_client clients[RDPPROXY_CLIENTS];
+    unsigned int count;
+    struct rdpproxy_held *heap;
+    unsigned int held;
+    unsigned long long order;
+};
+
+static const struct option rdpproxy_options[] = {
+    {"delay", required_argument, NULL, 'd'},
+    {"jitter", required_argument, NULL, 'j'},
+    {"loss", required_argument, NULL, 'l'},
+    {"reorder", required_argument, NULL, 'r'},
+    {"duplicate", required_argument, NULL, 'D'},
+    {"rate", required_argument, NULL, 'b'},
+    {"queue", required_argument, NULL, 'q'},
+    {"seed", required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0}
+};
+
+static volatile sig_atomic_t rdpproxy_stop;
+
+/*
+ * @param sig signal received
+ */
+static void rdpproxy_signal(int sig)
+{
+    rdpproxy_stop = 1;
+}
+
+/*
+ * @param arg rate in bit/s, with an optional k, M or G suffix
+ * @return double rate in bytes/s, 0 for a malformed one
+ */
+static double rdpproxy_rate(const char *arg)
+{
+    char *end;
+    double rate = strtod(arg, &end);
+
+    switch (*end) {
+    case 'G':
+        rate *= 1e3;
+        // fall through
+    case 'M':
+        rate *= 1e3;
+        // fall through
+    case 'k':
+        rate *= 1e3;
+        end++;
+    }
+
+    return *end || rate <= 0 ? 0 : rate / 8;
+}
+
+/*
+ * @param arg probability
+ * @return double probability, -1 for a malformed one
+ */
+static double rdpproxy_chance(const char *arg)
+{
+    char *end;
+    double chance = strtod(arg, &end);
+
+    return *end || chance < 0 || chance > 1 ? -1 : chance;
+}
+
+/*
+ * @param a held datagram
+ * @param b held datagram
+ * @return int a leaves before b
+ */
+static int rdpproxy_before(const struct rdpproxy_held *a,
+    const struct rdpproxy_held *b)
+{
+    return a->due < b->due || (a->due == b->due && a->order < b->order);
+}
+
+/*
+ * @param proxy proxy, the datagram added to its heap
+ * @param held datagram
+ */
+static void rdpproxy_push(struct rdpproxy *proxy,
+    const struct rdpproxy_held *held)
+{
+    struct rdpproxy_held *heap = proxy->heap;
+    unsigned int i = proxy->held++;
+
+    while (i && rdpproxy_before(held, &heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+
+    heap[i] = *held;
+}
+
+/*
+ * @param proxy proxy, its first datagram taken off the heap
+ * @param held filled with the datagram
+ */
+static void rdpproxy_pop(struct rdpproxy *proxy, struct rdpproxy_held *held)
+{
+    struct rdpproxy_held *heap = proxy->heap;
+    struct rdpproxy_held last = heap[--proxy->held];
+    unsigned int i = 0, child;
+
+    *held = heap[0];
+
+    while ((child = 2 * i + 1) < proxy->held) {
+        if (child + 1 < proxy->held &&
+            rdpproxy_before(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+
+        if (!rdpproxy_before(&heap[child], &last)) {
+            break;
+        }
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = last;
+}
+
+/*
+ * Like netem, a datagram first waits for the rate cap to send it, then
+ * for the delay, and the jitter may reorder datagrams.
+ *
+ * @param proxy proxy
+ * @param link direction the datagram goes
+ * @param sock socket it leaves from
+ * @param to address it goes to
+ * @param data datagram
+ * @param length datagram size
+ * @param now current time
+ */
+static void rdpproxy_hold(struct rdpproxy *proxy, struct rdpproxy_link *link,
+    int sock, const struct sockaddr_in *to, const char *data, size_t length,
+    unsigned long long now)
+{
+    const struct rdpproxy_profile *profile = &proxy->profile;
+    struct rdpproxy_held held;
+    unsigned long long start;
+    double delay;
+    int copies = 1;
+
+    if (drand48() < profile->loss) {
+        link->lost++;
+        return;
+    }
+
+    if (drand48() < profile->duplicate) {
+        link->duplicated++;
+        copies++;
+    }
+
+    while (copies--) {
+        held.due = now;
+
+        if (profile->rate > 0) {
+            start = link->free > now ? link->free : now;
+
+            if ((start - now) * profile->rate / RDP_USEC > profile->queue) {
+                link->queued++;
+                continue;
+            }
+
+            link->free = start + length * RDP_USEC / profile->rate;
+            held.due = link->free;
+        }
+
+        delay = profile->delay + profile->jitter * (2 * drand48() - 1);
+        held.due += delay > 0 ? delay : 0;
+
+        if (drand48() < profile->reorder) {
+            link->reordered++;
+            held.due += RDPPROXY_REORDER;
+        }
+
+        held.data = proxy->held < RDPPROXY_HELD ? malloc(length) : NULL;
+
+        if (!held.data) {
+            link->queued++;
+            continue;
+        }
+
+        memcpy(held.data, data, length);
+        held.length = length;
+        held.order = proxy->order++;
+        held.sock = sock;
+        held.to = *to;
+        rdpproxy_push(proxy, &held);
+    }
+}
+
+/*
+ * @param proxy proxy
+ * @param addr client address
+ * @return struct rdpproxy_client * client, NULL without room for one
+ */
+static struct rdpproxy_client *rdpproxy_client(struct rdpproxy *proxy,
+    const struct sockaddr_in *addr)
+{
+    struct rdpproxy_client *client;
+    int rcvbuf = RDPPROXY_RCVBUF;
+    unsigned int i;
+
+    for (i = 0; i < proxy->count; i++) {
+        client = &proxy->clients[i];
+
+        if (client->addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            client->addr.sin_port == addr->sin_port) {
+            return client;
+        }
+    }
+
+    if (proxy->count == RDPPROXY_CLIENTS) {
+        return NULL;
+    }
+
+    // the server sees each client from a port of its own.
+    client = &proxy->clients[proxy->count];
+    client->sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (client->sock < 0) {
+        perror("socket");
+        return NULL;
+    }
+
+    setsockopt(client->sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    client->addr = *addr;
+    proxy->count++;
+    return client;
+}
+
+/*
+ * @param proxy proxy
+ * @param sock readable socket
+ * @param client client the socket belongs to, NULL for the listening one
+ * @param buffer receive buffer of RDPPROXY_DGRAM bytes
+ */
+static void rdpproxy_input(struct rdpproxy *proxy, int sock,
+    struct rdpproxy_client *client, char *buffer)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen;
+    ssize_t length;
+    unsigned long long now;
+    struct rdpproxy_client *from;
+
+    for (;;) {
+        addrlen = sizeof(addr);
+        length = recvfrom(sock, buffer, RDPPROXY_DGRAM, MSG_DONTWAIT,
+            (struct sockaddr *) &addr, &addrlen);
+
+        if (length < 0) {
+            return;
+        }
+
+        now = rdp_clock();
+
+        if (client) {
+            rdpproxy_hold(proxy, &proxy->links[1], proxy->sock,
+                &client->addr, buffer, length, now);
+        } else if ((from = rdpproxy_client(proxy, &addr))) {
+            rdpproxy_hold(proxy, &proxy->links[0], from->sock,
+                &proxy->server, buffer, length, now);
+        }
+    }
+}
+
+/*
+ * @param proxy proxy, datagrams due sent
+ * @param now current time
+ */
+static void rdpproxy_output(struct rdpproxy *proxy, unsigned long long now)
+{
+    struct rdpproxy_held held;
+
+    while (proxy->held && proxy->heap[0].due <= now) {
+        rdpproxy_pop(proxy, &held);
+
+        if (sendto(held.sock, held.data, held.length, 0,
+            (struct sockaddr *) &held.to, sizeof(held.to)) >= 0) {
+            proxy->links[held.sock == proxy->sock].forwarded++;
+        }
+
+        free(held.data);
+    }
+}
+
+/*
+ * @param proxy proxy
+ */
+static void rdpproxy_stats(const struct rdpproxy *proxy)
+{
+    const struct rdpproxy_link *link;
+    unsigned int i;
+
+    for (i = 0; i < 2; i++) {
+        link = &proxy->links[i];
+        printf("%s: forwarded %llu, lost %llu, queue drops %llu, "
+            "duplicated %llu, reordered %llu\n", link->name, link->forwarded,
+            link->lost, link->queued, link->duplicated, link->reordered);
+    }
+}
+
+/*
+ * @param proxy proxy
+ * @param mask signal mask to wait with, letting the stop signals in
+ * @return int 0: stopped by a signal, -1: failed
+ */
+static int rdpproxy_run(struct rdpproxy *proxy, const sigset_t *mask)
+{
+    static char buffer[RDPPROXY_DGRAM];
+    struct pollfd fds[RDPPROXY_CLIENTS + 1];
+    struct timespec timeout;
+    unsigned long long now, wait;
+    unsigned int i, count;
+    int result;
+
+    while (!rdpproxy_stop) {
+        fds[0].fd = proxy->sock;
+        fds[0].events = POLLIN;
+        count = proxy->count;
+
+        for (i = 0; i < count; i++) {
+            fds[i + 1].fd = proxy->clients[i].sock;
+            fds[i + 1].events = POLLIN;
+        }
+
+        // poll sleeps to the microsecond the next datagram is due.
+        now = rdp_clock();
+        wait = proxy->held && proxy->heap[0].due > now ?
+            proxy->heap[0].due - now : 0;
+        timeout.tv_sec = wait / RDP_USEC;
+        timeout.tv_nsec = wait % RDP_USEC * 1000;
+        result = ppoll(fds, count + 1, proxy->held ? &timeout : NULL, mask);
+
+        if (result < 0 && errno != EINTR) {
+            perror("ppoll");
+            return -1;
+        }
+
+        for (i = 0; result > 0 && i <= count; i++) {
+            if (fds[i].revents & POLLIN) {
+                rdpproxy_input(proxy, fds[i].fd, i ? &proxy->clients[i - 1] :
+                    NULL, buffer);
+            }
+        }
+
+        rdpproxy_output(proxy, rdp_clock());
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static struct rdpproxy proxy;
+    struct rdpproxy_profile *profile = &proxy.profile;
+    struct sockaddr_in addr;
+    struct sigaction action;
+    sigset_t stops, mask;
+    char *prog = *argv;
+    int rcvbuf = RDPPROXY_RCVBUF;
+    long seed = 1;
+    int opt, result;
+
+    profile->queue = RDPPROXY_QUEUE;
+
+    while ((opt = getopt_long(argc, argv, "b:d:D:j:l:q:r:s:", rdpproxy_options, NULL)) != -1) {
+        switch (opt) {
+        case 'b':
+            profile->rate = rdpproxy_rate(optarg);
+
+            if (!profile->rate) {
+                fprintf(stderr, "rate must be bit/s, like 100M\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'd':
+            profile->delay = atof(optarg) * 1000;
+            break;
+        case 'j':
+            profile->jitter = atof(optarg) * 1000;
+            break;
+        case 'D':
+            profile->duplicate = rdpproxy_chance(optarg);
+            break;
+        case 'l':
+            profile->loss = rdpproxy_chance(optarg);
+            break;
+        case 'r':
+            profile->reorder = rdpproxy_chance(optarg);
+            break;
+        case 'q':
+            profile->queue = strtoull(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = atol(optarg);
+            break;
+        default:
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    argv += optind - 1;
+    argc -= optind - 1;
+
+    if (argc < 5) {
+        printf("usage: %s [-d delay_ms] [-j jitter_ms] [-l loss] "
+            "[-r reorder] [-D duplicate] [-b rate [-q queue_bytes]] "
+            "[-s seed] proxy_ip proxy_port receiver_ip receiver_port\n",
+            prog);
+        exit(EXIT_FAILURE);
+    }
+
+    if (profile->loss < 0 || profile->reorder < 0 ||
+        profile->duplicate < 0 || profile->delay < 0 || profile->jitter < 0) {
+        fprintf(stderr, "chances must be 0 to 1, times not negative\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the same seed drops the same datagrams of the same traffic.
+    srand48(seed);
+    proxy.links[0].name = "to receiver";
+    proxy.links[1].name = "to sender";
+    proxy.heap = malloc(RDPPROXY_HELD * sizeof(*proxy.heap));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(argv[1]);
+    addr.sin_port = htons(atoi(argv[2]));
+
+    memset(&proxy.server, 0, sizeof(proxy.server));
+    proxy.server.sin_family = AF_INET;
+    proxy.server.sin_addr.s_addr = inet_addr(argv[3]);
+    proxy.server.sin_port = htons(atoi(argv[4]));
+
+    proxy.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(proxy.sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    if (!proxy.heap || bind(proxy.sock, (struct sockaddr *) &addr,
+        sizeof(addr)) < 0) {
+        perror("rdpproxy");
+        exit(EXIT_FAILURE);
+    }
+
+    // the statistics are printed once a signal stops the proxy; it is
+    // only let in while ppoll waits, so none slips in before the wait.
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = rdpproxy_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigemptyset(&stops);
+    sigaddset(&stops, SIGINT);
+    sigaddset(&stops, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stops, &mask);
+
+    result = rdpproxy_run(&proxy, &mask);
+    rdpproxy_stats(&proxy);
+
+    return result < 0 ? EXIT_FAILURE : 0;
+}
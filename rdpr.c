@@ -1,52 +1,430 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include "rdp.h"
+#include "rdpclock.h"
+#include "rdpexport.h"
+#include "rdplog.h"
+#include "rdppkt.h"
+#include "rdpresume.h"
+#include "rdpserv.h"
 
 #define BUFFER_SIZE 65536
 
+// server threads at most, each with its own socket on the port.
+#define RDPR_THREADS 64
+
+struct rdpr_worker {
+    pthread_t thread;
+    struct rdp_server *server;
+    unsigned int count;
+    struct rdp_conf conf;
+    char export[RDP_EXPORT_PATH]; // statistics file of this thread
+};
+
+static const struct option rdpr_options[] = {
+    {"log", required_argument, NULL, 'l'},
+    {"level", required_argument, NULL, 'v'},
+    {"mss", required_argument, NULL, 'm'},
+    {"server", no_argument, NULL, 'S'},
+    {"count", required_argument, NULL, 'n'},
+    {"threads", required_argument, NULL, 'j'},
+    {"offload", no_argument, NULL, 'g'},
+    {"uring", no_argument, NULL, 'u'},
+    {"ackfreq", required_argument, NULL, 'k'},
+    {"export", required_argument, NULL, 'x'},
+    {"copy", no_argument, NULL, 'c'},
+    {"resume", no_argument, NULL, 'R'},
+    {NULL, 0, NULL, 0}
+};
+
+/*
+ * @param arg server thread
+ * @return void * NULL
+ */
+static void *rdpr_serve(void *arg)
+{
+    struct rdpr_worker *worker = arg;
+
+    rdp_server_run(worker->server, worker->count);
+    return NULL;
+}
+
+/*
+ * @param fd output file
+ * @param path checkpoint file, NULL for none
+ * @param receiver rdp connection
+ * @param offset bytes of the file received in order
+ * @param due time the next checkpoint is due, 0 for now
+ */
+static void rdpr_checkpoint(int fd, const char *path,
+    const struct rdp_conn *receiver, unsigned long long offset,
+    unsigned long long *due)
+{
+    struct rdp_resume resume;
+    unsigned long long now = rdp_clock();
+
+    // a sender that offered no token cannot resume.
+    if (!path || !receiver->token || now < *due) {
+        return;
+    }
+
+    // the offset is only recorded once the bytes before it are on disk.
+    if (fdatasync(fd) < 0) {
+        perror("fdatasync");
+        return;
+    }
+
+    resume.token = receiver->token;
+    resume.size = receiver->size;
+    resume.offset = offset;
+    rdp_resume_save(path, &resume);
+    *due = now + RDP_RESUME_EVERY;
+}
+
+/*
+ * The file is sized to what the sender announced and mapped, payloads are
+ * received into the mapping and reach the file without a write.
+ *
+ * @param sock socket handler
+ * @param receiver rdp connection, the size announced in its SYN
+ * @param fd output file, opened for reading and writing
+ * @param path checkpoint file, NULL for none
+ * @return int 0: closed, -1: reset or no mapping
+ */
+static int rdpr_receive_map(int sock, struct rdp_conn *receiver, int fd,
+    const char *path)
+{
+    size_t received = receiver->resumed;
+    unsigned long long due = rdp_clock() + RDP_RESUME_EVERY;
+    char *map;
+    int result;
+
+    // without room reserved a full disk shows up as SIGBUS in the mapping.
+    if (fallocate(fd, 0, 0, receiver->size) < 0) {
+        perror("fallocate");
+        return -1;
+    }
+
+    map = mmap(NULL, receiver->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+        0);
+
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    do {
+        result = rdp_receive_map(sock, receiver, map, receiver->size,
+            &received);
+        rdpr_checkpoint(fd, path, receiver, received, &due);
+    } while (result > 0);
+
+    munmap(map, receiver->size);
+
+    // a transfer cut short keeps only the bytes received in order.
+    if (received < receiver->size && ftruncate(fd, received) < 0) {
+        perror("ftruncate");
+    }
+
+    // a complete file needs no checkpoint, a partial one the latest.
+    if (received < receiver->size) {
+        due = 0;
+        rdpr_checkpoint(fd, path, receiver, received, &due);
+    } else if (path) {
+        remove(path);
+    }
+
+    return result;
+}
+
+/*
+ * The kernel spreads flows over sockets sharing the port by address, so
+ * each thread serves its own connections without locking.
+ *
+ * @param addr receiver address
+ * @param conf connection settings
+ * @param prefix output files are named prefix.1, prefix.2, ...
+ * @param threads server threads
+ * @param count return after this many transfers completed, 0: never
+ * @return int 0: done, -1: failed
+ */
+static int rdpr_server(struct sockaddr_in *addr, const struct rdp_conf *conf,
+    const char *prefix, int threads, int count)
+{
+    static struct rdpr_worker workers[RDPR_THREADS];
+    int i, sock, reuse = 1, result = 0;
+
+    for (i = 0; i < threads; i++) {
+        sock = socket(AF_INET, SOCK_DGRAM, 0);
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+
+        if (bind(sock, (struct sockaddr *) addr, sizeof(*addr)) < 0) {
+            perror("bind");
+            close(sock);
+            break;
+        }
+
+        // each thread keeps stats_file.i, the file gets the totals.
+        workers[i].conf = *conf;
+
+        if (conf->export && threads > 1) {
+            snprintf(workers[i].export, sizeof(workers[i].export), "%s.%d",
+                conf->export, i);
+            workers[i].conf.export = workers[i].export;
+        }
+
+        workers[i].server = rdp_server_new(sock, &workers[i].conf, prefix);
+        workers[i].count = count;
+
+        if (!workers[i].server) {
+            close(sock);
+            break;
+        }
+    }
+
+    threads = i ? i : -1;
+
+    for (i = 1; i < threads; i++) {
+        pthread_create(&workers[i].thread, NULL, rdpr_serve, &workers[i]);
+    }
+
+    if (threads > 0) {
+        rdpr_serve(&workers[0]);
+    }
+
+    for (i = 0; i < threads; i++) {
+        if (i) {
+            pthread_join(workers[i].thread, NULL);
+            rdp_server_merge(workers[0].server, workers[i].server);
+        }
+    }
+
+    if (threads > 0) {
+        rdp_server_stats(workers[0].server);
+
+        if (conf->export) {
+            rdp_server_export(workers[0].server, conf->export);
+        }
+    } else {
+        result = -1;
+    }
+
+    for (i = 0; i < threads; i++) {
+        close(workers[i].server->sock);
+        rdp_server_free(workers[i].server);
+    }
+
+    return result;
+}
+
 int main(int argc, char **argv)
 {
     char buffer[BUFFER_SIZE];
     struct sockaddr_in addr;
     struct rdp_conn receiver;
-    int fd, result, sock;
+    struct rdp_conf conf;
+    const char *log = NULL;
+    char *prog = *argv;
+    int fd, level = -1, opt, result, sock;
+    int serve = 0, count = 0, threads = 1, copy = 0, resume = 0;
+    char checkpoint[RDP_RESUME_PATH];
+    struct rdp_resume saved;
+    struct stat st;
     size_t received;
 
+    // the sender picks the segment size, up to the largest one.
+    rdp_conf_init(&conf);
+    conf.mss = RDP_DGRAM_MAX;
+
+    while ((opt = getopt_long(argc, argv, "cgj:k:l:m:n:RSuv:x:", rdpr_options, NULL)) != -1) {
+        switch (opt) {
+        case 'l':
+            log = optarg;
+            break;
+        case 'm':
+            conf.mss = atoi(optarg);
+
+            if (conf.mss < RDP_BUF_SIZE || conf.mss > RDP_DGRAM_MAX) {
+                fprintf(stderr, "segment size must be %d to %d\n",
+                    RDP_BUF_SIZE, RDP_DGRAM_MAX);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            threads = atoi(optarg);
+
+            if (threads < 1 || threads > RDPR_THREADS) {
+                fprintf(stderr, "server threads must be 1 to %d\n",
+                    RDPR_THREADS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'k':
+            conf.ackfreq = atoi(optarg);
+
+            if (conf.ackfreq < 1 || conf.ackfreq > RDP_ACK_MAX) {
+                fprintf(stderr, "segments per ACK must be 1 to %d\n",
+                    RDP_ACK_MAX);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'S':
+            serve = 1;
+            break;
+        case 'R':
+            resume = 1;
+            break;
+        case 'g':
+            conf.offload = 1;
+            break;
+        case 'u':
+            conf.uring = 1;
+            break;
+        case 'c':
+            copy = 1;
+            break;
+        case 'x':
+            conf.export = optarg;
+            break;
+        case 'v':
+            level = rdp_log_find(optarg);
+
+            if (level < 0) {
+                fprintf(stderr, "unknown log level %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    argv += optind - 1;
+    argc -= optind - 1;
+
     if (argc < 4) {
-        printf("usage: %s receiver_ip receiver_port receiver_file_name\n", 
-            *argv);
+        printf("usage: %s [-l log_file_name] [-v error|summary|packet] "
+            "[-m segment_size] [-g] [-u] [-k acks_every] [-x stats_file] "
+            "[-c | -R | -S [-n transfers] [-j threads]] "
+            "receiver_ip receiver_port receiver_file_name\n", prog);
         exit(EXIT_FAILURE);
     }
 
-    fd = open(argv[3], O_CREAT|O_TRUNC|O_WRONLY, 0777);
-
-    sock = socket(AF_INET, SOCK_DGRAM, 0);    
+    // a log file keeps packet events unless told otherwise.
+    if (rdp_log_open(log, level < 0 ? (log ? RDP_LOG_PACKET :
+        RDP_LOG_SUMMARY) : level) < 0) {
+        exit(EXIT_FAILURE);
+    }
 
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = inet_addr(argv[1]);
     addr.sin_port = htons(atoi(argv[2]));
+
+    // a server names its files by arrival, none is the one to resume.
+    if (serve && resume) {
+        fprintf(stderr, "a server cannot resume transfers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the server's sockets and batches do not take coalesced datagrams.
+    if (serve && conf.offload) {
+        fprintf(stderr, "a server cannot offload segmentation\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the copy path writes from the file's start.
+    if (copy && resume) {
+        fprintf(stderr, "a copy cannot resume transfers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (resume && snprintf(checkpoint, sizeof(checkpoint), "%s%s", argv[3],
+        RDP_RESUME_SUFFIX) >= (int) sizeof(checkpoint)) {
+        fprintf(stderr, "%s: name too long\n", argv[3]);
+        exit(EXIT_FAILURE);
+    }
+
+    // every sender on the port, transfers go to file_name.1, .2, ...
+    if (serve) {
+        result = rdpr_server(&addr, &conf, argv[3], threads, count);
+        rdp_log_close();
+        return result < 0 ? EXIT_FAILURE : 0;
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);    
     result = bind(sock, (struct sockaddr *) &addr, sizeof(addr));
 
-    rdp_accept(sock, &receiver);
+    fd = open(argv[3], O_CREAT|(resume ? 0 : O_TRUNC)|O_RDWR, 0777);
 
+    // a sender starting over resumes from the checkpoint just written.
     do {
-        result = rdp_receive(sock, &receiver, buffer, BUFFER_SIZE, &received);
-        // received data -> file.
-        int r = write(fd, buffer, received);
-		if (r < 0) {
-			fprintf(stderr, "write data error\n");
-		}
-    } while (result > 0);
+        conf.resume = 0;
+        conf.resumed = 0;
+
+        // the bytes a checkpoint names must still be in the file.
+        if (resume && rdp_resume_load(checkpoint, &saved) == 0 &&
+            fstat(fd, &st) == 0 && (unsigned long long) st.st_size >=
+            saved.offset) {
+            conf.resume = saved.token;
+            conf.resumed = saved.offset;
+        }
+
+        if (rdp_accept(sock, &receiver, &conf) < 0) {
+            close(fd);
+            close(sock);
+            rdp_log_close();
+            exit(EXIT_FAILURE);
+        }
+
+        // a transfer of another file starts over.
+        if (resume && !receiver.resumed) {
+            remove(checkpoint);
+
+            if (ftruncate(fd, 0) < 0) {
+                perror("ftruncate");
+            }
+        }
+
+        // a sender announcing the size is received straight into the
+        // file, unless -c asks for the copy path.
+        if (receiver.size && !copy) {
+            result = rdpr_receive_map(sock, &receiver, fd,
+                resume ? checkpoint : NULL);
+        } else {
+            do {
+                result = rdp_receive(sock, &receiver, buffer, BUFFER_SIZE,
+                    &received);
+                // received data -> file.
+                int r = write(fd, buffer, received);
+                if (r < 0) {
+                    fprintf(stderr, "write data error\n");
+                }
+            } while (result > 0);
+        }
+    } while (resume && result == -2);
 
     rdp_stats(&receiver, 0);
 
+    // the file left behind holds the totals, not the last periodic ones.
+    if (conf.export) {
+        rdp_stats_export(&receiver, 0, conf.export);
+    }
+
     close(fd);
     close(sock);
+    rdp_log_close();
 
     return 0;
 }
@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rdpreasm.h"
+
+/*
+ * @param size ring size, at least the advertised window, 0 when the caller
+ * keeps the data in place and only the ranges are tracked
+ * @return struct rdp_reasm * reassembly buffer, NULL failed
+ */
+struct rdp_reasm *rdp_reasm_new(unsigned int size)
+{
+    struct rdp_reasm *reasm = malloc(sizeof(*reasm));
+
+    if (!reasm) {
+        return NULL;
+    }
+
+    reasm->buffer = size ? malloc(size) : NULL;
+    reasm->size = size;
+    reasm->count = 0;
+    reasm->last = 0;
+
+    if (size && !reasm->buffer) {
+        free(reasm);
+        return NULL;
+    }
+
+    return reasm;
+}
+
+/*
+ * @param reasm reassembly buffer
+ */
+void rdp_reasm_free(struct rdp_reasm *reasm)
+{
+    if (reasm) {
+        free(reasm->buffer);
+        free(reasm);
+    }
+}
+
+/*
+ * @param reasm reassembly buffer
+ * @param seq sequence number
+ * @param data ring output or input
+ * @param length bytes to copy
+ * @param store 1: data -> ring, 0: ring -> data
+ */
+static void rdp_reasm_copy(struct rdp_reasm *reasm, unsigned long long seq,
+    char *data, unsigned int length, int store)
+{
+    unsigned int at, first;
+
+    if (!reasm->buffer) {
+        return;
+    }
+
+    at = seq % reasm->size;
+    first = reasm->size - at < length ? reasm->size - at : length;
+
+    if (store) {
+        memcpy(reasm->buffer + at, data, first);
+        memcpy(reasm->buffer, data + first, length - first);
+    } else {
+        memcpy(data, reasm->buffer + at, first);
+        memcpy(data + first, reasm->buffer, length - first);
+    }
+}
+
+/*
+ * @param reasm reassembly buffer
+ * @param seq sequence number of segment
+ * @param data segment payload
+ * @param length segment length
+ * @return int 1: new data held, 0: duplicate, -1: no room
+ */
+int rdp_reasm_insert(struct rdp_reasm *reasm, unsigned long long seq,
+    const char *data, unsigned int length)
+{
+    struct rdp_sack *ranges = reasm->ranges;
+    unsigned long long end = seq + length;
+    unsigned int i, j;
+
+    // first range ending at or after the segment.
+    for (i = 0; i < reasm->count && ranges[i].end < seq; i++);
+
+    if (i < reasm->count && ranges[i].start <= seq && ranges[i].end >= end) {
+        return 0;
+    }
+
+    // segment touches no range, a new one is needed.
+    if (i == reasm->count || ranges[i].start > end) {
+        if (reasm->count == RDP_REASM_RANGES) {
+            return -1;
+        }
+
+        memmove(ranges + i + 1, ranges + i,
+            (reasm->count - i) * sizeof(*ranges));
+        ranges[i].start = seq;
+        ranges[i].end = end;
+        reasm->count++;
+    } else {
+        // merge with every range the segment overlaps or touches.
+        for (j = i; j + 1 < reasm->count && ranges[j + 1].start <= end; j++);
+
+        ranges[i].start = ranges[i].start < seq ? ranges[i].start : seq;
+        ranges[i].end = ranges[j].end > end ? ranges[j].end : end;
+        memmove(ranges + i + 1, ranges + j + 1,
+            (reasm->count - j - 1) * sizeof(*ranges));
+        reasm->count -= j - i;
+    }
+
+    rdp_reasm_copy(reasm, seq, (char *) data, length, 1);
+    reasm->last = seq;
+    return 1;
+}
+
+/*
+ * @param reasm reassembly buffer
+ * @param base next sequence number expected
+ * @param data delivered data
+ * @param length room in data
+ * @return unsigned int bytes delivered from base
+ */
+unsigned int rdp_reasm_deliver(struct rdp_reasm *reasm,
+    unsigned long long base, char *data, size_t length)
+{
+    struct rdp_sack *first = reasm->ranges;
+    unsigned int fill_len = 0;
+
+    // drop ranges delivered in order already.
+    while (reasm->count && first->start <= base) {
+        if (first->end > base) {
+            fill_len = first->end - base < length ?
+                first->end - base : length;
+            rdp_reasm_copy(reasm, base, data, fill_len, 0);
+
+            // the rest stays for the next delivery.
+            if (base + fill_len < first->end) {
+                first->start = base + fill_len;
+                break;
+            }
+        }
+
+        reasm->count--;
+        memmove(first, first + 1, reasm->count * sizeof(*first));
+    }
+
+    return fill_len;
+}
+
+/*
+ * Reports the range holding the newest segment first, as RFC 2018 asks,
+ * then the ranges below it, which arriving in order were reported last,
+ * wrapping round to the highest ones.
+ *
+ * @param reasm reassembly buffer
+ * @param blocks selective acknowledgement blocks
+ * @param count most blocks to report
+ * @return unsigned int blocks reported
+ */
+unsigned int rdp_reasm_sack(const struct rdp_reasm *reasm,
+    struct rdp_sack *blocks, unsigned int count)
+{
+    unsigned int i, first;
+
+    // the newest segment may have been delivered since.
+    for (first = 0; first < reasm->count &&
+        reasm->ranges[first].end <= reasm->last; first++);
+
+    if (first == reasm->count || reasm->ranges[first].start > reasm->last) {
+        first = 0;
+    }
+
+    for (i = 0; i < reasm->count && i < count; i++) {
+        blocks[i] = reasm->ranges[(first + reasm->count - i) % reasm->count];
+    }
+
+    return i;
+}
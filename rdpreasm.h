@@ -0,0 +1,28 @@
+#ifndef RDP_REASM_H
+#define RDP_REASM_H
+
+#include "rdppkt.h"
+
+// bytes held out of order, the largest window a receiver advertises.
+#define RDP_REASM_SIZE (1 << 20)
+#define RDP_REASM_RANGES 64
+
+// RDP reassembly buffer, a ring indexed by sequence number.
+struct rdp_reasm {
+    char *buffer;
+    unsigned int size;
+    unsigned int count;
+    unsigned long long last;    // sequence number of the newest segment
+    struct rdp_sack ranges[RDP_REASM_RANGES];
+};
+
+struct rdp_reasm *rdp_reasm_new(unsigned int size);
+void rdp_reasm_free(struct rdp_reasm *reasm);
+int rdp_reasm_insert(struct rdp_reasm *reasm, unsigned long long seq,
+    const char *data, unsigned int length);
+unsigned int rdp_reasm_deliver(struct rdp_reasm *reasm,
+    unsigned long long base, char *data, size_t length);
+unsigned int rdp_reasm_sack(const struct rdp_reasm *reasm,
+    struct rdp_sack *blocks, unsigned int count);
+
+#endif // RDP_REASM_H
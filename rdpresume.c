@@ -0,0 +1,103 @@
+#include <errno.h>
+#include <stdio.h>
+#include "rdpexport.h"
+#include "rdpresume.h"
+
+#define RDP_FNV_BASIS 14695981039346656037ULL
+#define RDP_FNV_PRIME 1099511628211ULL
+
+/*
+ * @param hash FNV-1a hash so far
+ * @param data bytes to add
+ * @param length byte count
+ * @return unsigned long long hash with the bytes added
+ */
+static unsigned long long rdp_resume_hash(unsigned long long hash,
+    const unsigned char *data, unsigned long long length)
+{
+    unsigned long long i;
+
+    for (i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * RDP_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * Hashing all of a large file would cost as much as sending it, the token
+ * covers its size, modification time and the bytes at either end.
+ *
+ * @param data file contents
+ * @param size file length
+ * @param mtime modification time, nanoseconds
+ * @return unsigned long long token naming the file, never 0
+ */
+unsigned long long rdp_resume_token(const char *data, unsigned long long size,
+    unsigned long long mtime)
+{
+    unsigned long long hash = RDP_FNV_BASIS;
+    unsigned long long sample = size < RDP_RESUME_SAMPLE ? size :
+        RDP_RESUME_SAMPLE;
+
+    hash = rdp_resume_hash(hash, (const unsigned char *) &size, sizeof(size));
+    hash = rdp_resume_hash(hash, (const unsigned char *) &mtime,
+        sizeof(mtime));
+    hash = rdp_resume_hash(hash, (const unsigned char *) data, sample);
+    hash = rdp_resume_hash(hash, (const unsigned char *) data + size - sample,
+        sample);
+    return hash ? hash : 1;
+}
+
+/*
+ * @param path checkpoint file
+ * @param resume checkpoint read
+ * @return int 0: read, -1: missing or malformed
+ */
+int rdp_resume_load(const char *path, struct rdp_resume *resume)
+{
+    FILE *file = fopen(path, "r");
+    int fields;
+
+    if (!file) {
+        if (errno != ENOENT) {
+            perror(path);
+        }
+        return -1;
+    }
+
+    fields = fscanf(file, "token %llu size %llu offset %llu", &resume->token,
+        &resume->size, &resume->offset);
+    fclose(file);
+
+    if (fields != 3 || !resume->token || resume->offset > resume->size) {
+        fprintf(stderr, "%s: malformed checkpoint\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * @param file checkpoint file
+ * @param arg struct rdp_resume to write
+ */
+static void rdp_resume_write(FILE *file, const void *arg)
+{
+    const struct rdp_resume *resume = arg;
+
+    fprintf(file, "token %llu\nsize %llu\noffset %llu\n", resume->token,
+        resume->size, resume->offset);
+}
+
+/*
+ * An interrupted write leaves the previous checkpoint.
+ *
+ * @param path checkpoint file
+ * @param resume checkpoint to write
+ * @return int 0: written, -1: failed
+ */
+int rdp_resume_save(const char *path, const struct rdp_resume *resume)
+{
+    return rdp_replace(path, rdp_resume_write, resume);
+}
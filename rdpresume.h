@@ -0,0 +1,28 @@
+#ifndef RDP_RESUME_H
+#define RDP_RESUME_H
+
+// bytes at each end of a file its resume token is computed over.
+#define RDP_RESUME_SAMPLE 65536
+
+// time between checkpoints of a transfer being received, microseconds.
+#define RDP_RESUME_EVERY 1000000
+
+// appended to the received file's name to name its checkpoint.
+#define RDP_RESUME_SUFFIX ".resume"
+
+// longest checkpoint file name.
+#define RDP_RESUME_PATH 4096
+
+// RDP resume checkpoint, kept by the receiver beside the file.
+struct rdp_resume {
+    unsigned long long token;   // identity of the sender's file
+    unsigned long long size;    // its length
+    unsigned long long offset;  // bytes received in order and on disk
+};
+
+unsigned long long rdp_resume_token(const char *data, unsigned long long size,
+    unsigned long long mtime);
+int rdp_resume_load(const char *path, struct rdp_resume *resume);
+int rdp_resume_save(const char *path, const struct rdp_resume *resume);
+
+#endif // RDP_RESUME_H
@@ -0,0 +1,453 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "rdpclock.h"
+#include "rdpio.h"
+#include "rdpring.h"
+
+// completion kinds, the low half of user_data holds an index or generation.
+#define RDP_RING_RECV (1ULL << 32)
+#define RDP_RING_SEND (2ULL << 32)
+#define RDP_RING_TIMEOUT (3ULL << 32)
+#define RDP_RING_CANCEL (4ULL << 32)
+
+/*
+ * @param ring io_uring transport
+ * @param complete completions to wait for
+ * @param flags IORING_ENTER_GETEVENTS to wait or run completions
+ * @return int entries submitted, -1 failed
+ */
+static int rdp_ring_enter(struct rdp_ring *ring, unsigned int complete,
+    unsigned int flags)
+{
+    int result;
+
+    result = syscall(__NR_io_uring_enter, ring->fd, ring->queued, complete,
+        flags, NULL, 0);
+    ring->enters++;
+
+    if (result > 0) {
+        ring->queued -= result;
+    }
+
+    return result;
+}
+
+/*
+ * @param ring io_uring transport
+ * @return struct io_uring_sqe * cleared entry, submitted with the next
+ * rdp_ring_enter
+ */
+static struct io_uring_sqe *rdp_ring_sqe(struct rdp_ring *ring)
+{
+    unsigned int tail = *ring->sq_tail;
+    unsigned int index = tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    // a full queue goes in before another entry is taken.
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) ==
+        ring->sq_entries) {
+        rdp_ring_enter(ring, 0, 0);
+    }
+
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+    return sqe;
+}
+
+/*
+ * @param ring io_uring transport
+ * @param bid receive buffer handed back to the kernel
+ */
+static void rdp_ring_recycle(struct rdp_ring *ring, unsigned short bid)
+{
+    struct io_uring_buf *buf = &ring->bufs->bufs[ring->tail &
+        (ring->count - 1)];
+
+    // a spare byte ends text headers as strings.
+    buf->addr = (unsigned long) (ring->pool + bid * ring->size);
+    buf->len = ring->size - 1;
+    buf->bid = bid;
+    __atomic_store_n(&ring->bufs->tail, ++ring->tail, __ATOMIC_RELEASE);
+}
+
+/*
+ * @param ring io_uring transport, the multishot receive posted
+ */
+static void rdp_ring_arm(struct rdp_ring *ring)
+{
+    struct io_uring_sqe *sqe = rdp_ring_sqe(ring);
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = ring->sock;
+    sqe->addr = (unsigned long) &ring->tmpl;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RDP_RING_GROUP;
+    sqe->user_data = RDP_RING_RECV;
+    ring->armed = 1;
+}
+
+/*
+ * @param ring io_uring transport, every completion posted consumed
+ */
+static void rdp_ring_reap(struct rdp_ring *ring)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head = *ring->cq_head;
+    unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned int low;
+
+    for (; head != tail; head++) {
+        cqe = &ring->cqes[head & ring->cq_mask];
+        low = (unsigned int) cqe->user_data;
+
+        switch (cqe->user_data & ~0xffffffffULL) {
+        case RDP_RING_RECV:
+            // out of buffers or cancelled, posted again when needed.
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                ring->armed = 0;
+            }
+
+            if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                ring->ready[ring->filled++ % RDP_RING_BUFS] =
+                    cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            }
+            break;
+        case RDP_RING_SEND:
+            ring->results[low] = cqe->res;
+            ring->sending--;
+            break;
+        case RDP_RING_TIMEOUT:
+            // a removed timer from an earlier wait is no news.
+            if (low == ring->timer) {
+                ring->timing = 0;
+                ring->expired = cqe->res == -ETIME;
+            }
+            break;
+        }
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * @param sock socket handler, received from only through the ring
+ * @param gro 1: the socket coalesces datagrams, buffers take UDP_GRO
+ * @return struct rdp_ring * io_uring transport, NULL not supported
+ */
+struct rdp_ring *rdp_ring_new(int sock, int gro)
+{
+    struct io_uring_params params;
+    struct io_uring_buf_reg reg;
+    struct rdp_ring *ring = calloc(1, sizeof(*ring));
+    char *rings;
+    size_t sq_size;
+    unsigned int i;
+
+    if (!ring) {
+        perror("calloc");
+        return NULL;
+    }
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+    params.cq_entries = 4 * RDP_RING_ENTRIES;
+    ring->sock = sock;
+    ring->fd = syscall(__NR_io_uring_setup, RDP_RING_ENTRIES, &params);
+
+    if (ring->fd < 0) {
+        perror("io_uring_setup");
+        free(ring);
+        return NULL;
+    }
+
+    // both rings share one mapping on every kernel with multishot receives.
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->rings_size = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->rings_size = sq_size > ring->rings_size ? sq_size :
+        ring->rings_size;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->rings = mmap(NULL, ring->rings_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    // GRO buffers are large, fewer of them.
+    ring->count = gro ? RDP_RING_BUFS / 4 : RDP_RING_BUFS;
+    ring->tmpl.msg_namelen = sizeof(struct sockaddr_in);
+    ring->tmpl.msg_controllen = gro ? CMSG_SPACE(sizeof(int)) : 0;
+    ring->size = sizeof(struct io_uring_recvmsg_out) +
+        ring->tmpl.msg_namelen + ring->tmpl.msg_controllen +
+        (gro ? RDP_GSO_BYTES : RDP_DGRAM_MAX) + 1;
+    ring->bufs = mmap(NULL, ring->count * sizeof(struct io_uring_buf),
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->pool = malloc(ring->count * ring->size);
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        ring->rings == MAP_FAILED || ring->sqes == MAP_FAILED ||
+        ring->bufs == MAP_FAILED || !ring->pool) {
+        fprintf(stderr, "io_uring rings cannot be mapped\n");
+        rdp_ring_free(ring, NULL);
+        return NULL;
+    }
+
+    rings = ring->rings;
+    ring->sq_head = (unsigned int *) (rings + params.sq_off.head);
+    ring->sq_tail = (unsigned int *) (rings + params.sq_off.tail);
+    ring->sq_array = (unsigned int *) (rings + params.sq_off.array);
+    ring->sq_mask = *(unsigned int *) (rings + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned int *) (rings + params.cq_off.head);
+    ring->cq_tail = (unsigned int *) (rings + params.cq_off.tail);
+    ring->cq_mask = *(unsigned int *) (rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (rings + params.cq_off.cqes);
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long) ring->bufs;
+    reg.ring_entries = ring->count;
+    reg.bgid = RDP_RING_GROUP;
+
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING,
+        &reg, 1) < 0) {
+        perror("IORING_REGISTER_PBUF_RING");
+        rdp_ring_free(ring, NULL);
+        return NULL;
+    }
+
+    for (i = 0; i < ring->count; i++) {
+        rdp_ring_recycle(ring, i);
+    }
+
+    rdp_ring_arm(ring);
+    return ring;
+}
+
+/*
+ * @param ring io_uring transport, its receive cancelled so that plain
+ * receives on the socket see every datagram again
+ * @param stats statistics to count system calls, NULL for none
+ */
+void rdp_ring_free(struct rdp_ring *ring, struct rdp_stats *stats)
+{
+    struct io_uring_sqe *sqe;
+    int tries;
+
+    if (!ring) {
+        return;
+    }
+
+    if (ring->armed) {
+        sqe = rdp_ring_sqe(ring);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = RDP_RING_RECV;
+        sqe->user_data = RDP_RING_CANCEL;
+    }
+
+    for (tries = 0; ring->armed && tries < RDP_RING_TRIES; tries++) {
+        rdp_ring_enter(ring, 1, IORING_ENTER_GETEVENTS);
+        rdp_ring_reap(ring);
+    }
+
+    if (stats) {
+        stats->enters += ring->enters;
+    }
+
+    if (ring->bufs && ring->bufs != MAP_FAILED) {
+        munmap(ring->bufs, ring->count * sizeof(struct io_uring_buf));
+    }
+
+    if (ring->sqes && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+
+    if (ring->rings && ring->rings != MAP_FAILED) {
+        munmap(ring->rings, ring->rings_size);
+    }
+
+    free(ring->pool);
+    close(ring->fd);
+    free(ring);
+}
+
+/*
+ * Like sendmmsg(), but every message is an entry of its own and all of
+ * them go in with one system call, which also returns completions.
+ *
+ * @param ring io_uring transport
+ * @param msgs messages to send
+ * @param vlen number of messages
+ * @param flags send flags, MSG_ZEROCOPY
+ * @param results bytes sent or -errno, by message
+ * @return int messages sent or failed, -1 the ring failed
+ */
+int rdp_ring_sendmmsg(struct rdp_ring *ring, struct mmsghdr *msgs,
+    unsigned int vlen, int flags, int *results)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int i;
+
+    ring->results = results;
+
+    // hard links keep datagrams in order, on the wire and in the zero-copy
+    // ids, and a failed one does not cancel the rest.
+    for (i = 0; i < vlen; i++) {
+        sqe = rdp_ring_sqe(ring);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = ring->sock;
+        sqe->addr = (unsigned long) &msgs[i].msg_hdr;
+        sqe->len = 1;
+        sqe->msg_flags = flags;
+        sqe->flags = i + 1 < vlen ? IOSQE_IO_HARDLINK : 0;
+        sqe->user_data = RDP_RING_SEND | i;
+        ring->sending++;
+    }
+
+    while (ring->sending) {
+        if (rdp_ring_enter(ring, ring->sending, IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR) {
+            perror("io_uring_enter");
+            return -1;
+        }
+
+        rdp_ring_reap(ring);
+    }
+
+    return vlen;
+}
+
+/*
+ * Like recvmmsg(), but datagrams stay in the buffers the kernel picked:
+ * the iovec of each message is pointed at its payload, the buffers are
+ * lent until the next call.
+ *
+ * @param ring io_uring transport
+ * @param msgs messages received, msg_name filled when set
+ * @param vlen number of messages at most
+ * @param flags MSG_DONTWAIT to drain, MSG_WAITFORONE to block
+ * @return int messages received, -1 failed or none with MSG_DONTWAIT
+ */
+int rdp_ring_recvmmsg(struct rdp_ring *ring, struct mmsghdr *msgs,
+    unsigned int vlen, int flags)
+{
+    struct io_uring_recvmsg_out *out;
+    struct msghdr *hdr;
+    char *buffer;
+    size_t skip = sizeof(*out) + ring->tmpl.msg_namelen +
+        ring->tmpl.msg_controllen;
+    size_t room = ring->size - 1 - skip;
+    unsigned int i, wait;
+    unsigned short bid;
+
+    while (ring->held) {
+        rdp_ring_recycle(ring, ring->lent[--ring->held]);
+    }
+
+    // completions are posted once the task enters the kernel.
+    do {
+        if (!ring->armed) {
+            rdp_ring_arm(ring);
+        }
+
+        wait = (flags & MSG_WAITFORONE) && ring->head == ring->filled;
+
+        if (rdp_ring_enter(ring, wait, IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR) {
+            perror("io_uring_enter");
+            return -1;
+        }
+
+        rdp_ring_reap(ring);
+    } while (wait && ring->head == ring->filled);
+
+    if (ring->head == ring->filled) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    for (i = 0; i < vlen && ring->head != ring->filled; i++) {
+        bid = ring->ready[ring->head++ % RDP_RING_BUFS];
+        ring->lent[ring->held++] = bid;
+        buffer = ring->pool + bid * ring->size;
+        out = (struct io_uring_recvmsg_out *) buffer;
+        hdr = &msgs[i].msg_hdr;
+
+        if (hdr->msg_name) {
+            memcpy(hdr->msg_name, buffer + sizeof(*out),
+                out->namelen < hdr->msg_namelen ? out->namelen :
+                hdr->msg_namelen);
+        }
+
+        hdr->msg_control = ring->tmpl.msg_controllen ?
+            buffer + sizeof(*out) + ring->tmpl.msg_namelen : NULL;
+        hdr->msg_controllen = ring->tmpl.msg_controllen ? out->controllen : 0;
+        hdr->msg_iov[0].iov_base = buffer + skip;
+        msgs[i].msg_len = out->payloadlen < room ? out->payloadlen : room;
+    }
+
+    return i;
+}
+
+/*
+ * @param ring io_uring transport
+ * @param wait microseconds to wait for a datagram
+ * @return int 1: datagram pending, 0: timeout, -1: failed
+ */
+int rdp_ring_wait(struct rdp_ring *ring, unsigned long long wait)
+{
+    struct io_uring_sqe *sqe;
+
+    rdp_ring_reap(ring);
+
+    if (ring->head != ring->filled) {
+        return 1;
+    }
+
+    if (!ring->armed) {
+        rdp_ring_arm(ring);
+    }
+
+    // the timer is an entry like the rest, it goes in with them.
+    ring->ts.tv_sec = wait / RDP_USEC;
+    ring->ts.tv_nsec = wait % RDP_USEC * 1000;
+    sqe = rdp_ring_sqe(ring);
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (unsigned long) &ring->ts;
+    sqe->len = 1;
+    sqe->user_data = RDP_RING_TIMEOUT | ++ring->timer;
+    ring->timing = 1;
+    ring->expired = 0;
+
+    while (ring->head == ring->filled && !ring->expired) {
+        if (rdp_ring_enter(ring, 1, IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR) {
+            perror("io_uring_enter");
+            return -1;
+        }
+
+        rdp_ring_reap(ring);
+
+        if (!ring->armed) {
+            rdp_ring_arm(ring);
+        }
+    }
+
+    // a timer no longer needed is removed with the next submission.
+    if (ring->timing) {
+        sqe = rdp_ring_sqe(ring);
+        sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+        sqe->addr = RDP_RING_TIMEOUT | ring->timer;
+        sqe->user_data = RDP_RING_CANCEL;
+        ring->timing = 0;
+    }
+
+    return ring->head != ring->filled;
+}
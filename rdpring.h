@@ -0,0 +1,69 @@
+#ifndef RDP_RING_H
+#define RDP_RING_H
+
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+#include "rdp.h"
+
+// submission queue entries, a burst of sends and the timer fit at once.
+#define RDP_RING_ENTRIES 256
+
+// receive buffers the kernel picks from, a power of two.
+#define RDP_RING_BUFS 256
+
+// buffer group of the receive buffers.
+#define RDP_RING_GROUP 1
+
+// completions of the waits for a cancelled receive, at most.
+#define RDP_RING_TRIES 10
+
+// RDP io_uring transport. A multishot receive stays posted on the socket
+// and fills buffers the kernel picks; sends, the timer and cancellation
+// are queued behind it and go in with the next io_uring_enter.
+struct rdp_ring {
+    int fd;
+    int sock;
+    int armed;                  // the multishot receive is posted
+    int timing;                 // the newest timeout is pending
+    int expired;                // the newest timeout fired
+    unsigned int timer;         // generation of the newest timeout
+    unsigned int sending;       // send completions outstanding
+    unsigned int queued;        // entries not yet submitted
+    unsigned int enters;        // io_uring_enter calls
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_array;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *rings;
+    size_t rings_size;
+    size_t sqes_size;
+    struct io_uring_buf_ring *bufs;
+    char *pool;
+    size_t size;                // bytes per receive buffer
+    unsigned int count;         // receive buffers
+    unsigned short tail;
+    unsigned int head;          // received buffers, read up to here
+    unsigned int filled;        // received buffers, filled up to here
+    unsigned int held;          // buffers lent to the caller
+    unsigned short ready[RDP_RING_BUFS];    // buffer ids received, in order
+    unsigned short lent[RDP_RING_BUFS];
+    int *results;               // send results, by message
+    struct msghdr tmpl;         // layout of each received buffer
+    struct __kernel_timespec ts;
+};
+
+struct rdp_ring *rdp_ring_new(int sock, int gro);
+void rdp_ring_free(struct rdp_ring *ring, struct rdp_stats *stats);
+int rdp_ring_sendmmsg(struct rdp_ring *ring, struct mmsghdr *msgs,
+    unsigned int vlen, int flags, int *results);
+int rdp_ring_recvmmsg(struct rdp_ring *ring, struct mmsghdr *msgs,
+    unsigned int vlen, int flags);
+int rdp_ring_wait(struct rdp_ring *ring, unsigned long long wait);
+
+#endif // RDP_RING_H
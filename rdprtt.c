@@ -0,0 +1,62 @@
+#include "rdprtt.h"
+
+/*
+ * @param rtt round trip time estimator
+ */
+void rdp_rtt_init(struct rdp_rtt *rtt)
+{
+    rtt->srtt = 0;
+    rtt->rttvar = 0;
+    rtt->rto = RDP_RTO_INIT;
+    rtt->backoff = 0;
+    rtt->samples = 0;
+}
+
+/*
+ * RFC 6298 smoothing. Callers follow Karn's rule and never sample a
+ * retransmitted segment unless its timestamp echo tells them apart.
+ *
+ * @param rtt round trip time estimator
+ * @param sample measured round trip time
+ */
+void rdp_rtt_sample(struct rdp_rtt *rtt, unsigned int sample)
+{
+    unsigned int delta, var;
+
+    if (!rtt->samples++) {
+        rtt->srtt = sample;
+        rtt->rttvar = sample / 2;
+    } else {
+        delta = rtt->srtt > sample ? rtt->srtt - sample : sample - rtt->srtt;
+        rtt->rttvar = (3 * rtt->rttvar + delta) / 4;
+        rtt->srtt = (7 * rtt->srtt + sample) / 8;
+    }
+
+    var = 4 * rtt->rttvar > RDP_RTO_GRANULARITY ?
+        4 * rtt->rttvar : RDP_RTO_GRANULARITY;
+    rtt->rto = rtt->srtt + var;
+    rtt->rto = rtt->rto > RDP_RTO_MIN ? rtt->rto : RDP_RTO_MIN;
+    rtt->rto = rtt->rto < RDP_RTO_MAX ? rtt->rto : RDP_RTO_MAX;
+    rtt->backoff = 0;
+}
+
+/*
+ * @param rtt round trip time estimator
+ */
+void rdp_rtt_backoff(struct rdp_rtt *rtt)
+{
+    if (rdp_rtt_rto(rtt) < RDP_RTO_MAX) {
+        rtt->backoff++;
+    }
+}
+
+/*
+ * @param rtt round trip time estimator
+ * @return unsigned int retransmission timeout with backoff
+ */
+unsigned int rdp_rtt_rto(const struct rdp_rtt *rtt)
+{
+    unsigned long long rto = (unsigned long long) rtt->rto << rtt->backoff;
+
+    return rto < RDP_RTO_MAX ? rto : RDP_RTO_MAX;
+}
@@ -0,0 +1,26 @@
+#ifndef RDP_RTT_H
+#define RDP_RTT_H
+
+// retransmission timeout bounds in microseconds.
+#define RDP_RTO_INIT 1000000
+#define RDP_RTO_MIN 10000
+#define RDP_RTO_MAX 60000000
+
+// clock granularity.
+#define RDP_RTO_GRANULARITY 1000
+
+// RDP round trip time estimator, times in microseconds.
+struct rdp_rtt {
+    unsigned int srtt;
+    unsigned int rttvar;
+    unsigned int rto;
+    unsigned int backoff;
+    unsigned int samples;
+};
+
+void rdp_rtt_init(struct rdp_rtt *rtt);
+void rdp_rtt_sample(struct rdp_rtt *rtt, unsigned int sample);
+void rdp_rtt_backoff(struct rdp_rtt *rtt);
+unsigned int rdp_rtt_rto(const struct rdp_rtt *rtt);
+
+#endif // RDP_RTT_H
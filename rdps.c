@@ -4,7 +4,11 @@
  */
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,27 +16,362 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include "rdp.h"
+#include "rdpcc.h"
+#include "rdpclock.h"
+#include "rdpexport.h"
+#include "rdpfec.h"
+#include "rdplog.h"
+#include "rdppkt.h"
+#include "rdpresume.h"
+
+// parallel flows at most.
+#define RDPS_FLOWS 64
+
+// ranges of a striped file start on page boundaries.
+#define RDPS_ALIGN 4096
+
+// bytes read from standard input at a time.
+#define RDPS_CHUNK 65536
+
+// RDP flow sending one range of the file from its own thread and port.
+struct rdps_flow {
+    pthread_t thread;
+    struct sockaddr_in srcaddr;
+    struct sockaddr_in dstaddr;
+    struct rdp_conf conf;
+    struct rdp_conn sender;
+    const char *cc;
+    const char *data;
+    size_t length;
+    int input;                  // read to its end and streamed, -1: data
+    int cpu;                    // core the flow runs on, -1 for any
+    char export[RDP_EXPORT_PATH]; // statistics file of this flow
+    int result;                 // 0: sent, -1: not connected or not sent
+};
+
+static const struct option rdps_options[] = {
+    {"cc", required_argument, NULL, 'c'},
+    {"log", required_argument, NULL, 'l'},
+    {"level", required_argument, NULL, 'v'},
+    {"mss", required_argument, NULL, 'm'},
+    {"probe", no_argument, NULL, 'p'},
+    {"flows", required_argument, NULL, 'j'},
+    {"pin", no_argument, NULL, 'a'},
+    {"zerocopy", no_argument, NULL, 'z'},
+    {"offload", no_argument, NULL, 'g'},
+    {"uring", no_argument, NULL, 'u'},
+    {"ackfreq", required_argument, NULL, 'k'},
+    {"fec", required_argument, NULL, 'f'},
+    {"rate", required_argument, NULL, 'r'},
+    {"pace", no_argument, NULL, 'P'},
+    {"txtime", no_argument, NULL, 'T'},
+    {"export", required_argument, NULL, 'x'},
+    {"resume", no_argument, NULL, 'R'},
+    {"compress", no_argument, NULL, 'Z'},
+    {NULL, 0, NULL, 0}
+};
+
+/*
+ * @param arg rate in bit/s, with an optional k, M or G suffix
+ * @return double rate in bytes/s, 0 for a malformed one
+ */
+static double rdps_rate(const char *arg)
+{
+    char *end;
+    double rate = strtod(arg, &end);
+
+    switch (*end) {
+    case 'G':
+        rate *= 1e3;
+        // fall through
+    case 'M':
+        rate *= 1e3;
+        // fall through
+    case 'k':
+        rate *= 1e3;
+        end++;
+    }
+
+    return *end || rate <= 0 ? 0 : rate / 8;
+}
+
+/*
+ * @param sock socket handler
+ * @param sender rdp connection
+ * @param fd input streamed until it ends
+ * @return int 0: sent, -1: reset or the input failed
+ */
+static int rdps_stream(int sock, struct rdp_conn *sender, int fd)
+{
+    char chunk[RDPS_CHUNK];
+    struct rdp_stream *stream = rdp_stream_open(sock, sender, 0);
+    ssize_t length;
+    int result = 0;
+
+    if (!stream) {
+        return -1;
+    }
+
+    while (!result && (length = read(fd, chunk, sizeof(chunk)))) {
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (length < 0) {
+            perror("read");
+            result = -1;
+            break;
+        }
+
+        result = rdp_stream_write(stream, chunk, length);
+    }
+
+    // what was read is delivered even when the input failed.
+    if (rdp_stream_close(stream) < 0) {
+        return -1;
+    }
+
+    // but the receiver must not take it for the whole input.
+    if (result < 0) {
+        rdp_reset(sock, sender);
+    }
+
+    return result;
+}
+
+/*
+ * @param arg flow to run
+ * @return void * NULL
+ */
+static void *rdps_send(void *arg)
+{
+    struct rdps_flow *flow = arg;
+    cpu_set_t cpus;
+    int sock;
+
+    if (flow->cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(flow->cpu, &cpus);
+
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) {
+            fprintf(stderr, "cannot pin flow to core %d\n", flow->cpu);
+        }
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (bind(sock, (struct sockaddr *) &flow->srcaddr,
+        sizeof(flow->srcaddr)) < 0) {
+        perror("bind");
+    }
+
+    // Establish connection with receiver.
+    flow->result = rdp_connect(sock, &flow->dstaddr, &flow->sender,
+        &flow->conf);
+
+    if (flow->result < 0) {
+        close(sock);
+        return NULL;
+    }
+
+    // Congestion control of this connection.
+    if (flow->cc) {
+        rdp_set_cc(&flow->sender, flow->cc);
+    }
+
+    // Send contents of file, or of standard input as it is read, past
+    // the bytes a resuming receiver holds.
+    if (flow->input >= 0) {
+        flow->result = rdps_stream(sock, &flow->sender, flow->input);
+    } else {
+        flow->result = rdp_send(sock, &flow->sender,
+            flow->data + flow->sender.resumed,
+            flow->length - flow->sender.resumed);
+    }
+
+    // a failed send has already reset the receiver.
+    if (flow->result == 0) {
+        flow->result = rdp_close(sock, &flow->sender);
+    }
+
+    // the file left behind holds the totals, not the last periodic ones.
+    if (flow->result == 0 && flow->conf.export) {
+        rdp_stats_export(&flow->sender, 1, flow->conf.export);
+    }
+
+    close(sock);
+    return NULL;
+}
 
 int main(int argc, char **argv)
 {
+    static struct rdps_flow flows[RDPS_FLOWS];
     struct sockaddr_in srcaddr;
     struct sockaddr_in dstaddr;
-    struct rdp_conn sender;
+    struct rdp_conf conf;
     struct stat fs;
+    const char *cc = NULL;
+    const char *log = NULL;
+    int level = -1, mss = 0, count = 1, pin = 0, resume = 0;
+    char *prog = *argv;
+    size_t range;
     void *data;
-    int fd, result, sock;
+    int cores, fd, i, opt, result;
+
+    rdp_conf_init(&conf);
+
+    while ((opt = getopt_long(argc, argv, "ac:f:gj:k:l:m:pPr:RTuv:x:zZ", rdps_options, NULL)) != -1) {
+        switch (opt) {
+        case 'a':
+            pin = 1;
+            break;
+        case 'c':
+            cc = optarg;
+
+            if (!rdp_cc_find(cc)) {
+                fprintf(stderr, "unknown congestion control %s\n", cc);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            // segments per block, then parity per block or none to adapt.
+            if (sscanf(optarg, "%u/%u", &conf.fec, &conf.parity) < 1 ||
+                conf.fec < 2 || conf.fec > RDP_FEC_LENGTH ||
+                conf.parity > RDP_FEC_PARITY) {
+                fprintf(stderr, "FEC block must be 2 to %d segments, "
+                    "with 0 to %d parity\n", RDP_FEC_LENGTH, RDP_FEC_PARITY);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            count = atoi(optarg);
+
+            if (count < 1 || count > RDPS_FLOWS) {
+                fprintf(stderr, "parallel flows must be 1 to %d\n",
+                    RDPS_FLOWS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'k':
+            conf.ackfreq = atoi(optarg);
+
+            if (conf.ackfreq < 1 || conf.ackfreq > RDP_ACK_MAX) {
+                fprintf(stderr, "segments per ACK must be 1 to %d\n",
+                    RDP_ACK_MAX);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'l':
+            log = optarg;
+            break;
+        case 'm':
+            mss = atoi(optarg);
+
+            if (mss < RDP_BUF_SIZE || mss > RDP_DGRAM_MAX) {
+                fprintf(stderr, "segment size must be %d to %d\n",
+                    RDP_BUF_SIZE, RDP_DGRAM_MAX);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            conf.probe = 1;
+            break;
+        case 'P':
+            conf.pace = 1;
+            break;
+        case 'r':
+            conf.rate = rdps_rate(optarg);
+
+            if (!conf.rate) {
+                fprintf(stderr, "rate must be bit/s, like 800M\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'R':
+            resume = 1;
+            break;
+        case 'T':
+            conf.txtime = 1;
+            break;
+        case 'v':
+            level = rdp_log_find(optarg);
+
+            if (level < 0) {
+                fprintf(stderr, "unknown log level %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'x':
+            conf.export = optarg;
+            break;
+        case 'z':
+            conf.zerocopy = 1;
+            break;
+        case 'Z':
+            conf.compress = 1;
+            break;
+        case 'g':
+            conf.offload = 1;
+            break;
+        case 'u':
+            conf.uring = 1;
+            break;
+        default:
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    argv += optind - 1;
+    argc -= optind - 1;
 
     if (argc < 6) {
-        printf("usage: %s sender_ip sender_port receiver_ip "
-            "receiver_port sender_file_name\n", *argv);
+        printf("usage: %s [-c newreno|cubic|bbr] [-l log_file_name] "
+            "[-v error|summary|packet] [-m segment_size] [-p] "
+            "[-j flows [-a]] [-z] [-Z] [-g] [-u] [-k acks_every] "
+            "[-f block[/parity]] [-r rate | -P] [-T] [-x stats_file] [-R] "
+            "sender_ip sender_port receiver_ip receiver_port "
+            "sender_file_name|-\n", prog);
         exit(EXIT_FAILURE);
     }
 
-    fd = open(argv[5], O_RDONLY);
-	fstat(fd, &fs);
-    data = mmap(NULL, fs.st_size, PROT_READ, MAP_SHARED, fd, 0);    
+    // a log file keeps packet events unless told otherwise.
+    if (rdp_log_open(log, level < 0 ? (log ? RDP_LOG_PACKET :
+        RDP_LOG_SUMMARY) : level) < 0) {
+        exit(EXIT_FAILURE);
+    }
 
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    // a resumed transfer continues one file at one receiver.
+    if (resume && count > 1) {
+        fprintf(stderr, "a striped transfer cannot be resumed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // - streams standard input, its length unknown until it ends.
+    if (!strcmp(argv[5], "-")) {
+        if (resume) {
+            fprintf(stderr, "standard input cannot be resumed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (count > 1) {
+            fprintf(stderr, "standard input cannot be striped\n");
+            exit(EXIT_FAILURE);
+        }
+
+        fd = STDIN_FILENO;
+        fs.st_size = 0;
+        data = NULL;
+    } else {
+        fd = open(argv[5], O_RDONLY);
+        fstat(fd, &fs);
+        data = mmap(NULL, fs.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        // the receiver's checkpoint must name this very file.
+        if (resume && fs.st_size) {
+            conf.resume = rdp_resume_token(data, fs.st_size,
+                fs.st_mtim.tv_sec * 1000000000ULL + fs.st_mtim.tv_nsec);
+        }
+    }
 
     // Sender
     memset(&srcaddr, 0, sizeof(srcaddr));
@@ -46,19 +385,78 @@ int main(int argc, char **argv)
     dstaddr.sin_addr.s_addr = inet_addr(argv[3]);
     dstaddr.sin_port = htons(atoi(argv[4]));
 
-    result = bind(sock, (struct sockaddr *) &srcaddr, sizeof(srcaddr));
+    // probing searches up to the largest size unless one is given.
+    conf.mss = mss ? mss : conf.probe ? RDP_DGRAM_MAX : RDP_BUF_SIZE;
 
-    // Establish connection with receiver.
-    rdp_connect(sock, &dstaddr, &sender);
+    // a small file needs fewer flows than asked for.
+    range = (fs.st_size + count - 1) / count;
+    range = (range + RDPS_ALIGN - 1) / RDPS_ALIGN * RDPS_ALIGN;
+    count = range ? (fs.st_size + range - 1) / range : 1;
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // flow i sends range i from sender_port + i, all under one id.
+    for (i = 0; i < count; i++) {
+        flows[i].srcaddr = srcaddr;
+        flows[i].dstaddr = dstaddr;
+        flows[i].conf = conf;
+        flows[i].cc = cc;
+        flows[i].data = (const char *) data + range * i;
+        flows[i].length = fs.st_size - range * i < range ?
+            fs.st_size - range * i : range;
+        flows[i].input = data ? -1 : fd;
+        flows[i].cpu = pin && cores > 0 ? i % cores : -1;
+        flows[i].conf.size = flows[i].length;
+
+        if (srcaddr.sin_port) {
+            flows[i].srcaddr.sin_port = htons(ntohs(srcaddr.sin_port) + i);
+        }
 
-    // Send contents of file.
-    rdp_send(sock, &sender, data, fs.st_size);
+        if (count > 1) {
+            flows[i].conf.id = (rdp_clock() * 2654435761u) ^ getpid();
+            flows[i].conf.id = i ? flows[0].conf.id : flows[i].conf.id | 1;
+            flows[i].conf.stripes = count;
+            flows[i].conf.offset = range * i;
+
+            // the rate asked for is the sum over the flows.
+            flows[i].conf.rate = conf.rate / count;
+
+            // each flow keeps stats_file.i, the file gets the totals.
+            if (conf.export) {
+                snprintf(flows[i].export, sizeof(flows[i].export), "%s.%d",
+                    conf.export, i);
+                flows[i].conf.export = flows[i].export;
+            }
+        }
+    }
+
+    for (i = 1; i < count; i++) {
+        pthread_create(&flows[i].thread, NULL, rdps_send, &flows[i]);
+    }
+
+    rdps_send(&flows[0]);
+    result = flows[0].result;
+
+    for (i = 1; i < count; i++) {
+        pthread_join(flows[i].thread, NULL);
+        rdp_stats_merge(&flows[0].sender, &flows[i].sender);
+        result |= flows[i].result;
+    }
 
     // Output connection statistics.
-    rdp_stats(&sender, 1);
+    if (result == 0) {
+        rdp_stats(&flows[0].sender, 1);
+    }
 
-    close(sock);
-    munmap(data, fs.st_size);
+    if (result == 0 && count > 1 && conf.export) {
+        rdp_stats_export(&flows[0].sender, 1, conf.export);
+    }
+
+    close(fd);
+
+    if (data) {
+        munmap(data, fs.st_size);
+    }
+    rdp_log_close();
 
-    return 0;
+    return result < 0 ? EXIT_FAILURE : 0;
 }
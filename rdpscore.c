@@ -0,0 +1,209 @@
+#include <string.h>
+#include "rdpclock.h"
+#include "rdpscore.h"
+
+#define RDP_SCORE_AT(score, i) (&(score)->segments[(i) % RDP_SCORE_SIZE])
+
+/*
+ * @param score retransmission scoreboard
+ */
+void rdp_score_init(struct rdp_score *score)
+{
+    score->head = 0;
+    score->tail = 0;
+    score->lost = 0;
+    score->pipe = 0;
+    score->dupacks = 0;
+}
+
+/*
+ * @param score retransmission scoreboard
+ * @return unsigned int segments outstanding
+ */
+unsigned int rdp_score_count(const struct rdp_score *score)
+{
+    return score->tail - score->head;
+}
+
+/*
+ * @param score retransmission scoreboard
+ * @param seq sequence number of new segment
+ * @param length payload length
+ * @return struct rdp_segment * segment sent, NULL when board is full
+ */
+struct rdp_segment *rdp_score_add(struct rdp_score *score,
+    unsigned long long seq, unsigned int length)
+{
+    struct rdp_segment *segment;
+
+    if (rdp_score_count(score) == RDP_SCORE_SIZE) {
+        return NULL;
+    }
+
+    segment = RDP_SCORE_AT(score, score->tail++);
+    segment->seq = seq;
+    segment->length = length;
+    segment->retrans = 0;
+    segment->state = RDP_SEG_SENT;
+    segment->sent = rdp_clock();
+    score->pipe += length;
+
+    return segment;
+}
+
+/*
+ * @param score retransmission scoreboard
+ * @param ack cumulative acknowledgement
+ * @param rtt round trip time of the newest segment released, 0 when it
+ * was sent more than once
+ * @return unsigned int segments released
+ */
+unsigned int rdp_score_ack(struct rdp_score *score, unsigned long long ack,
+    unsigned int *rtt)
+{
+    struct rdp_segment *segment;
+    unsigned int acked = 0;
+
+    *rtt = 0;
+
+    while (score->head != score->tail) {
+        segment = RDP_SCORE_AT(score, score->head);
+
+        if (segment->seq + segment->length > ack) {
+            break;
+        }
+
+        score->lost -= segment->state == RDP_SEG_LOST;
+        score->pipe -= segment->state == RDP_SEG_SENT ? segment->length : 0;
+        *rtt = segment->retrans ? 0 : rdp_clock() - segment->sent;
+        score->head++;
+        acked++;
+    }
+
+    return acked;
+}
+
+/*
+ * @param score retransmission scoreboard
+ * @param blocks selective acknowledgement blocks
+ * @param count blocks in ACK
+ */
+void rdp_score_sack(struct rdp_score *score, const struct rdp_sack *blocks,
+    unsigned int count)
+{
+    struct rdp_segment *segment;
+    unsigned int i, j;
+
+    for (j = 0; j < count; j++) {
+        for (i = score->head; i != score->tail; i++) {
+            segment = RDP_SCORE_AT(score, i);
+
+            if (segment->seq >= blocks[j].end) {
+                break;
+            }
+
+            if (segment->seq >= blocks[j].start &&
+                segment->seq + segment->length <= blocks[j].end &&
+                segment->state != RDP_SEG_SACKED) {
+                score->lost -= segment->state == RDP_SEG_LOST;
+                score->pipe -= segment->state == RDP_SEG_SENT ?
+                    segment->length : 0;
+                segment->state = RDP_SEG_SACKED;
+            }
+        }
+    }
+}
+
+/*
+ * Marks segments a later SACK block skipped over as lost, or the first
+ * segment when the peer sends no blocks.
+ *
+ * @param score retransmission scoreboard
+ * @return unsigned int segments marked lost
+ */
+unsigned int rdp_score_loss(struct rdp_score *score)
+{
+    struct rdp_segment *segment;
+    unsigned int i, end = score->head + 1;
+    unsigned int marked = 0;
+
+    // segments below the highest one held by the receiver.
+    for (i = score->head + 1; i != score->tail; i++) {
+        if (RDP_SCORE_AT(score, i)->state == RDP_SEG_SACKED) {
+            end = i;
+        }
+    }
+
+    for (i = score->head; i != end && i != score->tail; i++) {
+        segment = RDP_SCORE_AT(score, i);
+
+        if (segment->state == RDP_SEG_SENT) {
+            segment->state = RDP_SEG_LOST;
+            score->pipe -= segment->length;
+            marked++;
+        }
+    }
+
+    score->lost += marked;
+    return marked;
+}
+
+/*
+ * @param score retransmission scoreboard
+ * @return unsigned int segments marked lost, all not held by the peer
+ */
+unsigned int rdp_score_timeout(struct rdp_score *score)
+{
+    struct rdp_segment *segment;
+    unsigned int i, marked = 0;
+
+    for (i = score->head; i != score->tail; i++) {
+        segment = RDP_SCORE_AT(score, i);
+
+        if (segment->state == RDP_SEG_SENT) {
+            segment->state = RDP_SEG_LOST;
+            score->pipe -= segment->length;
+            marked++;
+        }
+    }
+
+    score->lost += marked;
+    return marked;
+}
+
+/*
+ * @param score retransmission scoreboard
+ * @return struct rdp_segment * first lost segment, NULL for none
+ */
+struct rdp_segment *rdp_score_lost(struct rdp_score *score)
+{
+    struct rdp_segment *segment;
+    unsigned int i;
+
+    if (!score->lost) {
+        return NULL;
+    }
+
+    for (i = score->head; i != score->tail; i++) {
+        segment = RDP_SCORE_AT(score, i);
+
+        if (segment->state == RDP_SEG_LOST) {
+            return segment;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * @param score retransmission scoreboard
+ * @param segment lost segment sent again
+ */
+void rdp_score_resend(struct rdp_score *score, struct rdp_segment *segment)
+{
+    score->lost--;
+    score->pipe += segment->length;
+    segment->retrans++;
+    segment->state = RDP_SEG_SENT;
+    segment->sent = rdp_clock();
+}
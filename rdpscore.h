@@ -0,0 +1,49 @@
+#ifndef RDP_SCORE_H
+#define RDP_SCORE_H
+
+#include "rdppkt.h"
+
+// segments outstanding at most, a power of two.
+#define RDP_SCORE_SIZE 4096
+
+// duplicate ACKs that trigger a fast retransmit.
+#define RDP_DUP_THRESH 3
+
+// segment states.
+#define RDP_SEG_SENT 0
+#define RDP_SEG_SACKED 1
+#define RDP_SEG_LOST 2
+
+// RDP outstanding segment
+struct rdp_segment {
+    unsigned long long seq;
+    unsigned int length;
+    unsigned long long sent;
+    unsigned short retrans;
+    unsigned short state;
+};
+
+// RDP retransmission scoreboard, a ring of segments in sequence order.
+struct rdp_score {
+    struct rdp_segment segments[RDP_SCORE_SIZE];
+    unsigned int head;
+    unsigned int tail;
+    unsigned int lost;
+    unsigned int pipe;
+    unsigned int dupacks;
+};
+
+void rdp_score_init(struct rdp_score *score);
+struct rdp_segment *rdp_score_add(struct rdp_score *score,
+    unsigned long long seq, unsigned int length);
+unsigned int rdp_score_ack(struct rdp_score *score, unsigned long long ack,
+    unsigned int *rtt);
+void rdp_score_sack(struct rdp_score *score, const struct rdp_sack *blocks,
+    unsigned int count);
+unsigned int rdp_score_loss(struct rdp_score *score);
+unsigned int rdp_score_timeout(struct rdp_score *score);
+struct rdp_segment *rdp_score_lost(struct rdp_score *score);
+void rdp_score_resend(struct rdp_score *score, struct rdp_segment *segment);
+unsigned int rdp_score_count(const struct rdp_score *score);
+
+#endif // RDP_SCORE_H
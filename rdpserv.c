@@ -0,0 +1,1033 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "rdpexport.h"
+#include "rdplog.h"
+#include "rdppkt.h"
+#include "rdpreasm.h"
+#include "rdpserv.h"
+
+// output file name room.
+#define RDP_NAME_LEN 256
+
+// socket receive buffer shared by every peer.
+#define RDP_SERVER_RCVBUF (8 << 20)
+
+// segments held out of order are written out in chunks of this size.
+#define RDP_SERVER_CHUNK 65536
+
+// striped transfers and file numbers, shared by the servers of a port.
+static pthread_mutex_t rdp_stripe_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rdp_stripe *rdp_stripes;
+static unsigned int rdp_server_files;
+static unsigned int rdp_server_done;
+
+/*
+ * @param addr peer address
+ * @param size hash buckets, a power of two
+ * @return unsigned int bucket of the peer
+ */
+static unsigned int rdp_server_hash(const struct sockaddr_in *addr,
+    unsigned int size)
+{
+    unsigned long long key = (unsigned long long) addr->sin_addr.s_addr << 16 |
+        addr->sin_port;
+
+    return (key * 0x9e3779b97f4a7c15ULL) >> 32 & (size - 1);
+}
+
+/*
+ * @param server rdp server
+ * @param addr peer address
+ * @return struct rdp_peer ** link to the peer, to NULL when unknown
+ */
+static struct rdp_peer **rdp_server_find(struct rdp_server *server,
+    const struct sockaddr_in *addr)
+{
+    struct rdp_peer **link = &server->buckets[rdp_server_hash(addr,
+        server->size)];
+
+    while (*link && ((*link)->addr.sin_addr.s_addr != addr->sin_addr.s_addr ||
+        (*link)->addr.sin_port != addr->sin_port)) {
+        link = &(*link)->next;
+    }
+
+    return link;
+}
+
+/*
+ * @param server rdp server, buckets doubled and every peer rehashed
+ */
+static void rdp_server_grow(struct rdp_server *server)
+{
+    struct rdp_peer **buckets = calloc(server->size * 2, sizeof(*buckets));
+    struct rdp_peer *peer, *next;
+    unsigned int i, at;
+
+    // a full table only makes chains longer.
+    if (!buckets) {
+        return;
+    }
+
+    for (i = 0; i < server->size; i++) {
+        for (peer = server->buckets[i]; peer; peer = next) {
+            next = peer->next;
+            at = rdp_server_hash(&peer->addr, server->size * 2);
+            peer->next = buckets[at];
+            buckets[at] = peer;
+        }
+    }
+
+    free(server->buckets);
+    server->buckets = buckets;
+    server->size *= 2;
+}
+
+/*
+ * @param addr peer address
+ * @param packet SYN of one flow of a striped transfer
+ * @return struct rdp_stripe * transfer the flow joined, NULL failed
+ */
+static struct rdp_stripe *rdp_stripe_join(const struct sockaddr_in *addr,
+    const struct rdp_packet *packet)
+{
+    struct rdp_stripe *stripe;
+
+    pthread_mutex_lock(&rdp_stripe_lock);
+
+    for (stripe = rdp_stripes; stripe; stripe = stripe->next) {
+        if (stripe->addr == addr->sin_addr.s_addr && stripe->id == packet->conn) {
+            break;
+        }
+    }
+
+    // the first flow to arrive names the file.
+    if (!stripe && (stripe = calloc(1, sizeof(*stripe)))) {
+        stripe->addr = addr->sin_addr.s_addr;
+        stripe->id = packet->conn;
+        stripe->serial = __atomic_add_fetch(&rdp_server_files, 1,
+            __ATOMIC_RELAXED);
+        stripe->flows = packet->stripes;
+        stripe->fd = -1;
+        stripe->next = rdp_stripes;
+        rdp_stripes = stripe;
+    }
+
+    if (stripe) {
+        stripe->refs++;
+    } else {
+        perror("calloc");
+    }
+
+    pthread_mutex_unlock(&rdp_stripe_lock);
+    return stripe;
+}
+
+/*
+ * @param stripe striped transfer, freed once no flow is left
+ */
+static void rdp_stripe_leave(struct rdp_stripe *stripe)
+{
+    struct rdp_stripe **link;
+
+    pthread_mutex_lock(&rdp_stripe_lock);
+
+    if (!--stripe->refs) {
+        for (link = &rdp_stripes; *link != stripe; link = &(*link)->next);
+        *link = stripe->next;
+
+        if (stripe->fd >= 0) {
+            close(stripe->fd);
+        }
+
+        free(stripe);
+    }
+
+    pthread_mutex_unlock(&rdp_stripe_lock);
+}
+
+/*
+ * @param server rdp server
+ * @param addr peer address
+ * @param packet SYN received
+ * @return struct rdp_peer * new connection, NULL failed
+ */
+static struct rdp_peer *rdp_server_add(struct rdp_server *server,
+    const struct sockaddr_in *addr, const struct rdp_packet *packet)
+{
+    struct rdp_peer **link;
+    struct rdp_peer *peer = calloc(1, sizeof(*peer));
+
+    if (!peer) {
+        perror("calloc");
+        return NULL;
+    }
+
+    // one flow of several writes its range of a shared file.
+    if (packet->stripes > 1) {
+        peer->stripe = rdp_stripe_join(addr, packet);
+
+        if (!peer->stripe) {
+            free(peer);
+            return NULL;
+        }
+
+        peer->serial = peer->stripe->serial;
+        peer->offset = packet->offset;
+    } else {
+        peer->serial = __atomic_add_fetch(&rdp_server_files, 1,
+            __ATOMIC_RELAXED);
+    }
+
+    server->serial++;
+    peer->addr = *addr;
+    peer->id = packet->conn;
+    peer->number = packet->number + 1;
+    peer->caps = packet->caps & RDP_CAPS;
+    peer->ackfreq = rdp_conf_ackfreq(NULL, packet->ackfreq ?
+        packet->ackfreq : server->ackfreq);
+    peer->fd = -1;
+    peer->seen = rdp_clock();
+    rdp_timer_init(&peer->idle, peer);
+    rdp_timer_init(&peer->delack, peer);
+    rdp_timer_arm(&server->wheel, &peer->idle, peer->seen + RDP_SERVER_IDLE);
+
+    // every other capability is carried by the binary header.
+    if (!(peer->caps & RDP_CAP_BIN)) {
+        peer->caps = 0;
+    }
+
+    if (++server->count > server->size) {
+        rdp_server_grow(server);
+    }
+
+    link = &server->buckets[rdp_server_hash(addr, server->size)];
+    peer->next = *link;
+    *link = peer;
+    return peer;
+}
+
+/*
+ * @param server rdp server
+ * @param link link to the peer dropped
+ */
+static void rdp_server_drop(struct rdp_server *server, struct rdp_peer **link)
+{
+    struct rdp_peer *peer = *link;
+
+    *link = peer->next;
+    server->count--;
+    rdp_timer_cancel(&server->wheel, &peer->idle);
+    rdp_timer_cancel(&server->wheel, &peer->delack);
+
+    if (peer->stripe) {
+        rdp_stripe_leave(peer->stripe);
+    } else if (peer->fd >= 0) {
+        close(peer->fd);
+    }
+
+    rdp_reasm_free(peer->reasm);
+    free(peer);
+}
+
+/*
+ * @param server rdp server
+ * @param peer connection
+ * @return int 0: output file open, -1: failed
+ */
+static int rdp_server_open(struct rdp_server *server, struct rdp_peer *peer)
+{
+    char name[RDP_NAME_LEN];
+    int fd;
+
+    if (peer->fd >= 0) {
+        return 0;
+    }
+
+    // the flows of a striped transfer share the file the first one opens.
+    if (peer->stripe) {
+        pthread_mutex_lock(&rdp_stripe_lock);
+    }
+
+    fd = peer->stripe ? peer->stripe->fd : -1;
+
+    if (fd < 0) {
+        snprintf(name, sizeof(name), "%s.%u", server->prefix, peer->serial);
+        fd = open(name, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+
+        if (fd < 0) {
+            perror(name);
+        } else if (peer->stripe) {
+            peer->stripe->fd = fd;
+        }
+    }
+
+    if (peer->stripe) {
+        pthread_mutex_unlock(&rdp_stripe_lock);
+    }
+
+    peer->fd = fd;
+    return fd < 0 ? -1 : 0;
+}
+
+/*
+ * @param server rdp server
+ * @param peer connection
+ * @param data in order data
+ * @param length data length
+ * @return int 0: written, -1: failed
+ */
+static int rdp_server_write(struct rdp_server *server, struct rdp_peer *peer,
+    const char *data, unsigned int length)
+{
+    if (rdp_server_open(server, peer) < 0) {
+        return -1;
+    }
+
+    if (pwrite(peer->fd, data, length, peer->offset) != length) {
+        perror("pwrite");
+        return -1;
+    }
+
+    if (peer->stripe) {
+        __atomic_add_fetch(&peer->stripe->bytes, length, __ATOMIC_RELAXED);
+    }
+
+    peer->number += length;
+    peer->offset += length;
+    return 0;
+}
+
+/*
+ * @param server rdp server
+ * @param addr destination
+ * @param caps capabilities of the destination
+ * @param packet packet to queue
+ */
+static void rdp_server_queue(struct rdp_server *server,
+    const struct sockaddr_in *addr, unsigned int caps,
+    const struct rdp_packet *packet)
+{
+    char *buffer = rdp_batch_next(&server->acks);
+    int fill_len;
+
+    // a full batch goes out before more is queued.
+    if (!buffer) {
+        rdp_batch_flush(server->sock, &server->acks, &server->stats);
+        buffer = rdp_batch_next(&server->acks);
+    }
+
+    fill_len = rdp_format(buffer, RDP_BUF_SIZE, caps, packet);
+
+    if (fill_len > 0) {
+        rdp_batch_peer(&server->acks, addr);
+        rdp_batch_push(&server->acks, fill_len);
+        rdp_log(RDP_SEND, &server->self.addr, addr, packet->type,
+            packet->number, packet->info);
+    }
+}
+
+/*
+ * @param server rdp server
+ * @param peer connection
+ * @param number acknowledgement number
+ */
+static void rdp_server_ack(struct rdp_server *server, struct rdp_peer *peer,
+    unsigned long long number)
+{
+    struct rdp_packet packet;
+    unsigned long long held = 0;
+
+    packet.type = RDP_ACK;
+    packet.number = number;
+    packet.info = RDP_SERVER_WINDOW;
+    packet.caps = 0;
+    packet.sacks = peer->reasm ? rdp_reasm_sack(peer->reasm, packet.sack,
+        RDP_SACK_BLOCKS) : 0;
+    packet.tsval = rdp_clock();
+    packet.tsecr = peer->tsecr;
+
+    // the delayed ACK timer was armed when the wait began.
+    if (rdp_timer_pending(&peer->delack)) {
+        held = packet.tsval + RDP_ACK_DELAY - peer->delack.expires;
+    }
+
+    rdp_hist_add(&server->stats.ackdelay, held);
+
+    peer->unacked = 0;
+    rdp_timer_cancel(&server->wheel, &peer->delack);
+
+    server->stats.ack++;
+    rdp_server_queue(server, &peer->addr, peer->caps, &packet);
+}
+
+/*
+ * Like rdp_receive(), a segment in order is acknowledged along with the
+ * ackfreq-th one or by the delayed ACK timer, anything else at once.
+ *
+ * @param server rdp server
+ * @param peer connection
+ * @param packet DAT handled
+ * @param expected next sequence number before the packet was handled
+ * @param held segments were held out of order before it
+ * @return int 1: acknowledge now, 0: the ACK is held back
+ */
+static int rdp_server_due(struct rdp_server *server, struct rdp_peer *peer,
+    const struct rdp_packet *packet, unsigned long long expected, int held)
+{
+    if (packet->number != expected || held ||
+        (peer->reasm && peer->reasm->count) ||
+        ++peer->unacked >= peer->ackfreq) {
+        return 1;
+    }
+
+    if (!rdp_timer_pending(&peer->delack)) {
+        rdp_timer_arm(&server->wheel, &peer->delack,
+            rdp_clock() + RDP_ACK_DELAY);
+    }
+
+    server->stats.acksup++;
+    return 0;
+}
+
+/*
+ * @param server rdp server
+ * @param addr peer with no connection
+ */
+static void rdp_server_reset(struct rdp_server *server,
+    const struct sockaddr_in *addr)
+{
+    struct rdp_packet packet;
+
+    packet.type = RDP_RST;
+    packet.number = 0;
+    packet.info = 0;
+    packet.caps = 0;
+
+    server->stats.rts++;
+    rdp_server_queue(server, addr, 0, &packet);
+}
+
+/*
+ * @param server rdp server
+ * @param peer connection
+ * @param packet SYN received
+ */
+static void rdp_server_accept(struct rdp_server *server,
+    struct rdp_peer *peer, struct rdp_packet *packet)
+{
+    // a peer naming no size sends what fits RDP_BUF_SIZE.
+    packet->mss = packet->mss > RDP_BUF_SIZE ? packet->mss : RDP_BUF_SIZE;
+    packet->mss = packet->mss < server->mss ? packet->mss : server->mss;
+
+    // ACK packet, confirming the capabilities both ends support.
+    packet->type = RDP_ACK;
+    packet->number = peer->number;
+    packet->info = RDP_SERVER_WINDOW;
+    packet->caps = peer->caps;
+    packet->conn = peer->id;
+
+    // the SYN's offset places a stripe, the server resumes nothing.
+    packet->offset = 0;
+
+    server->stats.ack++;
+    rdp_server_queue(server, &peer->addr, 0, packet);
+}
+
+/*
+ * @param server rdp server
+ * @param peer connection
+ * @param packet DAT received
+ * @param length payload bytes in the datagram
+ * @return int 0: ok, -1: output failed
+ */
+static int rdp_server_data(struct rdp_server *server, struct rdp_peer *peer,
+    const struct rdp_packet *packet, unsigned int length)
+{
+    char chunk[RDP_SERVER_CHUNK];
+    const char *data = packet->data;
+    unsigned long long seq = packet->number;
+    unsigned int fill_len;
+
+    length = packet->info < length ? packet->info : length;
+
+    // only the tail of a segment starting in written data is new.
+    if (seq < peer->number && seq + length > peer->number) {
+        data += peer->number - seq;
+        length -= peer->number - seq;
+        seq = peer->number;
+    }
+
+    if (seq == peer->number && length) {
+        if (rdp_server_write(server, peer, data, length) < 0) {
+            return -1;
+        }
+
+        server->stats.ubytes += length;
+        server->stats.upkts++;
+
+        // segments held may be contiguous now.
+        while (peer->reasm && (fill_len = rdp_reasm_deliver(peer->reasm,
+            peer->number, chunk, sizeof(chunk)))) {
+            if (rdp_server_write(server, peer, chunk, fill_len) < 0) {
+                return -1;
+            }
+        }
+
+        // an idle connection holds no ring.
+        if (peer->reasm && !peer->reasm->count) {
+            rdp_reasm_free(peer->reasm);
+            peer->reasm = NULL;
+        }
+    } else if (seq > peer->number &&
+        seq - peer->number + length <= RDP_SERVER_WINDOW) {
+        // hold segment until the gap before it fills.
+        if (!peer->reasm) {
+            peer->reasm = rdp_reasm_new(RDP_SERVER_WINDOW);
+        }
+
+        if (peer->reasm && rdp_reasm_insert(peer->reasm, seq, data,
+            length) > 0) {
+            server->stats.ubytes += length;
+            server->stats.upkts++;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * @param server rdp server
+ * @param peer connection whose transfer completed
+ */
+static void rdp_server_finish(struct rdp_server *server,
+    struct rdp_peer *peer)
+{
+    struct rdp_stripe *stripe = peer->stripe;
+    unsigned long long bytes = peer->offset;
+    int opened = rdp_server_open(server, peer) == 0;
+    int last = 1;
+
+    rdp_reasm_free(peer->reasm);
+    peer->reasm = NULL;
+    peer->done = 1;
+
+    // an empty transfer still gets its file, a striped one once its last
+    // flow completes.
+    if (stripe) {
+        pthread_mutex_lock(&rdp_stripe_lock);
+        last = ++stripe->done == stripe->flows;
+        bytes = stripe->bytes;
+
+        if (last && stripe->fd >= 0) {
+            close(stripe->fd);
+            stripe->fd = -1;
+        }
+
+        pthread_mutex_unlock(&rdp_stripe_lock);
+    } else if (opened) {
+        close(peer->fd);
+    }
+
+    peer->fd = -1;
+
+    if (!last) {
+        return;
+    }
+
+    if (opened && rdp_log_enabled(RDP_LOG_SUMMARY)) {
+        printf("%s:%d -> %s.%u: %llu bytes", inet_ntoa(peer->addr.sin_addr),
+            ntohs(peer->addr.sin_port), server->prefix, peer->serial, bytes);
+        printf(stripe ? ", %u flows\n" : "\n", stripe ? stripe->flows : 0);
+    }
+
+    server->done++;
+    __atomic_add_fetch(&rdp_server_done, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * @param server rdp server
+ * @param addr source of the datagram
+ * @param buffer datagram
+ * @param length datagram length
+ */
+static void rdp_server_input(struct rdp_server *server,
+    const struct sockaddr_in *addr, char *buffer, unsigned int length)
+{
+    struct rdp_packet packet;
+    struct rdp_peer **link = rdp_server_find(server, addr);
+    struct rdp_peer *peer = *link;
+    unsigned long long expected;
+    int held;
+
+    rdp_interp(buffer, length, &packet);
+
+    if (packet.type < 0) {
+        return;
+    }
+
+    rdp_log(peer && packet.number < peer->number ? RDP_DUPLICATE :
+        RDP_RECEIVE, addr, &server->self.addr, packet.type, packet.number,
+        packet.info);
+
+    if (peer) {
+        peer->seen = rdp_clock();
+
+        // the next ACK echoes the oldest timestamp it covers.
+        if (packet.tsval && !peer->unacked) {
+            peer->tsecr = packet.tsval;
+        }
+    }
+
+    // handle received packet.
+    switch (packet.type) {
+    case RDP_SYN:
+        server->stats.syn++;
+
+        // a new connection from the address replaces the old one.
+        if (peer && peer->id != packet.conn) {
+            rdp_server_drop(server, link);
+            peer = NULL;
+        }
+
+        if (!peer) {
+            peer = rdp_server_add(server, addr, &packet);
+        }
+
+        if (peer) {
+            rdp_server_accept(server, peer, &packet);
+        }
+        break;
+    case RDP_DAT:
+        server->stats.tbytes += packet.info;
+        server->stats.tpkts++;
+
+        if (!peer) {
+            rdp_server_reset(server, addr);
+        } else if (!peer->done) {
+            expected = peer->number;
+            held = peer->reasm && peer->reasm->count;
+
+            if (rdp_server_data(server, peer, &packet,
+                length - (packet.data - buffer)) < 0) {
+                rdp_server_reset(server, addr);
+                rdp_server_drop(server, link);
+                break;
+            }
+
+            if (rdp_server_due(server, peer, &packet, expected, held)) {
+                rdp_server_ack(server, peer, peer->number);
+            }
+        }
+        break;
+    case RDP_FIN:
+        server->stats.fin++;
+
+        if (!peer) {
+            rdp_server_reset(server, addr);
+            break;
+        }
+
+        // a FIN past a gap waits for the data before it.
+        if (!peer->done && packet.number == peer->number) {
+            rdp_server_finish(server, peer);
+        }
+
+        rdp_server_ack(server, peer, peer->number + peer->done);
+        break;
+    case RDP_RST:
+        server->stats.rtr++;
+
+        if (peer) {
+            rdp_server_drop(server, link);
+        }
+        break;
+    }
+}
+
+/*
+ * Packets only stamp seen, a connection's timer finds out when it fires
+ * whether it went quiet or is due again.
+ *
+ * @param server rdp server, connections quiet for too long dropped
+ */
+static void rdp_server_expire(struct rdp_server *server)
+{
+    struct rdp_timer *timer;
+    struct rdp_peer *peer;
+    unsigned long long now = rdp_clock();
+
+    while ((timer = rdp_wheel_expired(&server->wheel, now))) {
+        peer = timer->data;
+
+        // a statistics file is kept current while the server runs, one
+        // that cannot be written is given up on.
+        if (timer == &server->report) {
+            if (rdp_server_export(server, server->export) < 0) {
+                server->export = NULL;
+            } else {
+                rdp_timer_arm(&server->wheel, timer, now + RDP_EXPORT_EVERY);
+            }
+            continue;
+        }
+
+        // the run loop arms the poll again.
+        if (!peer) {
+            continue;
+        }
+
+        if (timer == &peer->delack) {
+            rdp_server_ack(server, peer, peer->number);
+            continue;
+        }
+
+        if (now - peer->seen < RDP_SERVER_IDLE) {
+            rdp_timer_arm(&server->wheel, timer, peer->seen + RDP_SERVER_IDLE);
+            continue;
+        }
+
+        if (!peer->done) {
+            fprintf(stderr, "%s:%d not responsive\n",
+                inet_ntoa(peer->addr.sin_addr), ntohs(peer->addr.sin_port));
+        }
+
+        rdp_server_drop(server, rdp_server_find(server, &peer->addr));
+    }
+
+    rdp_batch_flush(server->sock, &server->acks, &server->stats);
+}
+
+/*
+ * @param server rdp server, its timerfd set to the first timer to expire
+ */
+static void rdp_server_arm(struct rdp_server *server)
+{
+    struct itimerspec next;
+    unsigned long long expires = rdp_wheel_next(&server->wheel);
+
+    if (expires == server->armed) {
+        return;
+    }
+
+    // an absolute expiry of zero disarms the timerfd.
+    memset(&next, 0, sizeof(next));
+    next.it_value.tv_sec = expires / RDP_USEC;
+    next.it_value.tv_nsec = expires % RDP_USEC * 1000;
+
+    if (!timerfd_settime(server->timer, TFD_TIMER_ABSTIME, &next, NULL)) {
+        server->armed = expires;
+    }
+}
+
+/*
+ * @param server rdp server, every pending datagram handled
+ */
+static void rdp_server_drain(struct rdp_server *server)
+{
+    int i, result;
+
+    // a short batch leaves the socket empty, epoll tells of the next.
+    do {
+        result = rdp_batch_recv(server->sock, &server->inbox, MSG_DONTWAIT,
+            &server->stats);
+
+        for (i = 0; i < result; i++) {
+            rdp_server_input(server, &server->inbox.addrs[i],
+                server->inbox.datagrams[i], server->inbox.lengths[i]);
+        }
+
+        rdp_batch_flush(server->sock, &server->acks, &server->stats);
+    } while (result == RDP_BURST);
+
+    // bytes delivered go to the throughput series once per drain.
+    if (server->stats.ubytes != server->stats.series.total) {
+        rdp_series_add(&server->stats.series, rdp_clock() - server->begin,
+            server->stats.ubytes - server->stats.series.total);
+    }
+}
+
+/*
+ * @param sock bound socket handler
+ * @param conf connection settings, NULL for the defaults
+ * @param prefix output files are named prefix.1, prefix.2, ...
+ * @return struct rdp_server * server, NULL failed
+ */
+struct rdp_server *rdp_server_new(int sock, const struct rdp_conf *conf,
+    const char *prefix)
+{
+    struct rdp_server *server = calloc(1, sizeof(*server));
+    struct epoll_event event;
+    struct rlimit files;
+    int rcvbuf = RDP_SERVER_RCVBUF;
+
+    if (!server) {
+        perror("calloc");
+        return NULL;
+    }
+
+    server->sock = sock;
+    server->mss = rdp_conf_mss(conf);
+    server->ackfreq = conf ? conf->ackfreq : 0;
+    server->prefix = prefix;
+    server->size = RDP_SERVER_BUCKETS;
+    server->buckets = calloc(server->size, sizeof(*server->buckets));
+    server->self.length = sizeof(server->self.addr);
+    server->begin = rdp_clock();
+    server->stats.begin = server->begin;
+    server->export = conf ? conf->export : NULL;
+    rdp_wheel_init(&server->wheel, server->begin);
+    rdp_timer_init(&server->poll, NULL);
+    rdp_timer_init(&server->report, NULL);
+
+    if (server->export) {
+        rdp_timer_arm(&server->wheel, &server->report, server->begin);
+    }
+    getsockname(sock, (struct sockaddr *) &server->self.addr,
+        &server->self.length);
+
+    rdp_batch_init(&server->inbox, NULL);
+    rdp_batch_init(&server->acks, NULL);
+
+    // the ring takes over from epoll and recvmmsg when it is available.
+    server->ring = conf && conf->uring ? rdp_ring_new(sock, 0) : NULL;
+    server->inbox.ring = server->ring;
+    server->acks.ring = server->ring;
+
+    // one output file per transfer in progress.
+    if (!getrlimit(RLIMIT_NOFILE, &files)) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    server->epfd = epoll_create1(0);
+    server->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+
+    if (!server->buckets || server->epfd < 0 || server->timer < 0) {
+        perror("rdp server");
+        rdp_server_free(server);
+        return NULL;
+    }
+
+    event.events = EPOLLIN;
+    event.data.fd = sock;
+    epoll_ctl(server->epfd, EPOLL_CTL_ADD, sock, &event);
+    event.data.fd = server->timer;
+    epoll_ctl(server->epfd, EPOLL_CTL_ADD, server->timer, &event);
+
+    return server;
+}
+
+/*
+ * Like rdp_server_run(), the ring waits for datagrams and the first timer.
+ *
+ * @param server rdp server with a ring
+ * @param transfers return after this many transfers completed, 0: never
+ * @return int 0: done, -1: failed
+ */
+static int rdp_server_ring(struct rdp_server *server, unsigned int transfers)
+{
+    unsigned long long now, expires;
+    int result;
+
+    while (!transfers ||
+        __atomic_load_n(&rdp_server_done, __ATOMIC_RELAXED) < transfers) {
+        rdp_server_expire(server);
+        now = rdp_clock();
+
+        // the other servers of the port may finish the last transfer.
+        if (transfers && !rdp_timer_pending(&server->poll)) {
+            rdp_timer_arm(&server->wheel, &server->poll, now + RDP_SERVER_POLL);
+        }
+
+        expires = rdp_wheel_next(&server->wheel);
+
+        // without connections there is nothing to wake for but datagrams.
+        expires = expires ? expires : now + RDP_SERVER_IDLE;
+        result = rdp_ring_wait(server->ring, expires > now ?
+            expires - now : 0);
+        server->stats.enters = server->ring->enters;
+
+        if (result < 0) {
+            return -1;
+        }
+
+        if (result > 0) {
+            rdp_server_drain(server);
+        }
+    }
+
+    server->stats.end = rdp_clock();
+    return 0;
+}
+
+/*
+ * @param server rdp server
+ * @param transfers return after this many transfers completed, 0: never
+ * @return int 0: done, -1: failed
+ */
+int rdp_server_run(struct rdp_server *server, unsigned int transfers)
+{
+    struct epoll_event events[2];
+    unsigned long long expired;
+    int i, result;
+
+    if (server->ring) {
+        return rdp_server_ring(server, transfers);
+    }
+
+    // the servers of a port count transfers together.
+    while (!transfers ||
+        __atomic_load_n(&rdp_server_done, __ATOMIC_RELAXED) < transfers) {
+        if (transfers && !rdp_timer_pending(&server->poll)) {
+            rdp_timer_arm(&server->wheel, &server->poll,
+                rdp_clock() + RDP_SERVER_POLL);
+        }
+
+        rdp_server_arm(server);
+        result = epoll_wait(server->epfd, events, 2, -1);
+
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            perror("epoll_wait");
+            return -1;
+        }
+
+        for (i = 0; i < result; i++) {
+            if (events[i].data.fd == server->timer) {
+                if (read(server->timer, &expired, sizeof(expired)) > 0) {
+                    server->armed = 0;
+                    rdp_server_expire(server);
+                }
+            } else {
+                rdp_server_drain(server);
+            }
+        }
+    }
+
+    server->stats.end = rdp_clock();
+    return 0;
+}
+
+/*
+ * @param server rdp server
+ */
+void rdp_server_stats(const struct rdp_server *server)
+{
+    const struct rdp_stats *stats = &server->stats;
+
+    if (!rdp_log_enabled(RDP_LOG_SUMMARY)) {
+        return;
+    }
+
+    printf("connections: %u, transfers completed: %u\n", server->serial,
+        server->done);
+    printf("total data bytes received: %llu\n", stats->tbytes);
+    printf("unique data bytes received: %llu\n", stats->ubytes);
+    printf("total data packets received: %llu\n", stats->tpkts);
+    printf("unique data packets received: %llu\n", stats->upkts);
+
+    printf("SYN packets received: %llu\n", stats->syn);
+    printf("FIN packets received: %llu\n", stats->fin);
+    printf("RST packets received: %llu\n", stats->rtr);
+    printf("ACK packets sent: %llu\n", stats->ack);
+    printf("RST packets sent: %llu\n", stats->rts);
+
+    printf("received batches: %llu, %.1f packets per batch\n", stats->rbatch,
+        stats->rbatch ? (double) stats->rmsgs / stats->rbatch : 0.0);
+    printf("sent batches: %llu, %.1f packets per batch\n", stats->sbatch,
+        stats->sbatch ? (double) stats->smsgs / stats->sbatch : 0.0);
+
+    if (stats->enters) {
+        printf("io_uring system calls: %llu\n", stats->enters);
+    }
+
+    printf("ACKs suppressed: %llu\n", stats->acksup);
+    printf("total time duration: %.3fs\n",
+        (double) (rdp_clock() - server->begin) / RDP_USEC);
+}
+
+/*
+ * @param total rdp server holding the sums
+ * @param server rdp server sharing the port
+ */
+void rdp_server_merge(struct rdp_server *total,
+    const struct rdp_server *server)
+{
+    total->serial += server->serial;
+    total->done += server->done;
+    total->stats.tbytes += server->stats.tbytes;
+    total->stats.ubytes += server->stats.ubytes;
+    total->stats.tpkts += server->stats.tpkts;
+    total->stats.upkts += server->stats.upkts;
+    total->stats.ack += server->stats.ack;
+    total->stats.syn += server->stats.syn;
+    total->stats.fin += server->stats.fin;
+    total->stats.rtr += server->stats.rtr;
+    total->stats.rts += server->stats.rts;
+    total->stats.sbatch += server->stats.sbatch;
+    total->stats.smsgs += server->stats.smsgs;
+    total->stats.rbatch += server->stats.rbatch;
+    total->stats.rmsgs += server->stats.rmsgs;
+    total->stats.enters += server->stats.enters;
+    total->stats.acksup += server->stats.acksup;
+    rdp_hist_merge(&total->stats.ackdelay, &server->stats.ackdelay);
+    rdp_series_merge(&total->stats.series, &server->stats.series);
+
+    if (server->begin < total->begin) {
+        total->begin = server->begin;
+        total->stats.begin = server->begin;
+    }
+
+    if (server->stats.end > total->stats.end) {
+        total->stats.end = server->stats.end;
+    }
+}
+
+/*
+ * @param server rdp server
+ * @param path statistics file, JSON for a .json name, else Prometheus text
+ * @return int 0: written, -1: failed
+ */
+int rdp_server_export(const struct rdp_server *server, const char *path)
+{
+    return rdp_export(&server->stats, "server", path);
+}
+
+/*
+ * @param server rdp server, every connection dropped
+ */
+void rdp_server_free(struct rdp_server *server)
+{
+    unsigned int i;
+
+    for (i = 0; server->buckets && i < server->size; i++) {
+        while (server->buckets[i]) {
+            rdp_server_drop(server, &server->buckets[i]);
+        }
+    }
+
+    if (server->epfd >= 0) {
+        close(server->epfd);
+    }
+
+    if (server->timer >= 0) {
+        close(server->timer);
+    }
+
+    rdp_ring_free(server->ring, NULL);
+    free(server->buckets);
+    free(server);
+}
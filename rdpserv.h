@@ -0,0 +1,90 @@
+#ifndef RDP_SERV_H
+#define RDP_SERV_H
+
+#include "rdp.h"
+#include "rdpclock.h"
+#include "rdpio.h"
+#include "rdptimer.h"
+
+// initial hash buckets, a power of two, doubled as connections grow.
+#define RDP_SERVER_BUCKETS 1024
+
+// window every connection advertises, also its reassembly ring size.
+#define RDP_SERVER_WINDOW (1 << 18)
+
+// connections without a packet for this long are dropped.
+#define RDP_SERVER_IDLE (60 * RDP_USEC)
+
+// servers stopping after some transfers look at the shared count this often.
+#define RDP_SERVER_POLL RDP_USEC
+
+// RDP striped transfer, the flows sharing a connection id write one file.
+struct rdp_stripe {
+    struct rdp_stripe *next;
+    in_addr_t addr;
+    unsigned int id;
+    unsigned int serial;
+    unsigned int flows;
+    unsigned int done;
+    unsigned int refs;
+    int fd;
+    unsigned long long bytes;
+};
+
+// RDP server connection, kept small so idle ones cost little.
+struct rdp_peer {
+    struct rdp_peer *next;
+    struct sockaddr_in addr;
+    unsigned int id;
+    unsigned int serial;
+    unsigned long long number;
+    unsigned int caps;
+    unsigned int tsecr;
+    unsigned int ackfreq;       // segments in order per ACK
+    unsigned int unacked;       // segments in order since the last ACK
+    int fd;                     // output file, -1 until data arrives
+    int done;                   // FIN received, a resent FIN is answered
+    struct rdp_reasm *reasm;    // NULL while nothing is held out of order
+    struct rdp_stripe *stripe;  // NULL unless one flow of several
+    unsigned long long offset;  // file offset of number
+    unsigned long long seen;
+    struct rdp_timer idle;      // checks seen once it may have gone quiet
+    struct rdp_timer delack;    // armed while an ACK is held back
+};
+
+// RDP server, every peer on one socket.
+struct rdp_server {
+    int sock;
+    int epfd;
+    int timer;                  // timerfd set to the first timer to expire
+    unsigned int mss;
+    unsigned int ackfreq;       // segments per ACK, 0 for the default
+    unsigned int serial;
+    unsigned int count;
+    unsigned int size;
+    unsigned int done;
+    const char *prefix;
+    struct rdp_peer **buckets;
+    struct socket_info self;
+    struct rdp_stats stats;
+    unsigned long long begin;
+    unsigned long long armed;   // expiry the timerfd is set to, 0: none
+    struct rdp_wheel wheel;
+    struct rdp_timer poll;      // armed while a transfer count is awaited
+    struct rdp_timer report;    // armed while a statistics file is kept
+    const char *export;         // statistics file, NULL for none
+    struct rdp_ring *ring;      // NULL when epoll waits for the socket
+    struct rdp_batch inbox;
+    struct rdp_batch acks;
+};
+
+struct rdp_server *rdp_server_new(int sock, const struct rdp_conf *conf,
+    const char *prefix);
+int rdp_server_run(struct rdp_server *server, unsigned int transfers);
+void rdp_server_stats(const struct rdp_server *server);
+void rdp_server_merge(struct rdp_server *total,
+    const struct rdp_server *server);
+int rdp_server_export(const struct rdp_server *server, const char *path);
+void rdp_server_free(struct rdp_server *server);
+
+#endif // RDP_SERV_H
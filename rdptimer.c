@@ -0,0 +1,200 @@
+#include <string.h>
+#include "rdptimer.h"
+
+/*
+ * @param wheel timer wheel, empty
+ * @param now rdp_clock() time the wheel starts at
+ */
+void rdp_wheel_init(struct rdp_wheel *wheel, unsigned long long now)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->tick = now / RDP_WHEEL_TICK;
+}
+
+/*
+ * @param timer timer, not armed
+ * @param data owner of the timer
+ */
+void rdp_timer_init(struct rdp_timer *timer, void *data)
+{
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->data = data;
+}
+
+/*
+ * A timer goes to the finest level whose current turn holds its tick, so
+ * a slot of a coarser level is always ahead of the wheel.
+ *
+ * @param wheel timer wheel
+ * @param timer timer, not armed, linked into its slot
+ */
+static void rdp_wheel_insert(struct rdp_wheel *wheel, struct rdp_timer *timer)
+{
+    unsigned long long at = timer->expires / RDP_WHEEL_TICK;
+    unsigned long long last = wheel->tick |
+        ((1ULL << (RDP_WHEEL_BITS * RDP_WHEEL_LEVELS)) - 1);
+    struct rdp_timer **slot;
+    int level = 0;
+
+    // a tick already passed is the next to expire, one beyond the last
+    // level waits at its end and is placed again from there.
+    at = at > wheel->tick ? at : wheel->tick;
+    at = at < last ? at : last;
+
+    while (at >> (RDP_WHEEL_BITS * (level + 1)) !=
+        wheel->tick >> (RDP_WHEEL_BITS * (level + 1))) {
+        level++;
+    }
+
+    slot = &wheel->slots[level][at >> (RDP_WHEEL_BITS * level) &
+        RDP_WHEEL_MASK];
+    timer->next = *slot;
+    timer->prev = slot;
+
+    if (*slot) {
+        (*slot)->prev = &timer->next;
+    }
+
+    *slot = timer;
+}
+
+/*
+ * @param wheel timer wheel
+ * @param timer timer, armed again if it was
+ * @param expires rdp_clock() time it fires at
+ */
+void rdp_timer_arm(struct rdp_wheel *wheel, struct rdp_timer *timer,
+    unsigned long long expires)
+{
+    rdp_timer_cancel(wheel, timer);
+    timer->expires = expires;
+    rdp_wheel_insert(wheel, timer);
+    wheel->count++;
+}
+
+/*
+ * @param wheel timer wheel
+ * @param timer timer, nothing done unless armed
+ */
+void rdp_timer_cancel(struct rdp_wheel *wheel, struct rdp_timer *timer)
+{
+    if (!timer->prev) {
+        return;
+    }
+
+    *timer->prev = timer->next;
+
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+
+    timer->next = NULL;
+    timer->prev = NULL;
+    wheel->count--;
+}
+
+/*
+ * @param timer timer
+ * @return int 1: armed, 0: not armed
+ */
+int rdp_timer_pending(const struct rdp_timer *timer)
+{
+    return timer->prev != NULL;
+}
+
+/*
+ * @param wheel timer wheel, the slots of every level whose turn starts at
+ * the current tick moved down
+ */
+static void rdp_wheel_cascade(struct rdp_wheel *wheel)
+{
+    struct rdp_timer *timer, *next;
+    struct rdp_timer **slot;
+    int level;
+
+    for (level = RDP_WHEEL_LEVELS - 1; level > 0; level--) {
+        if (wheel->tick & ((1ULL << (RDP_WHEEL_BITS * level)) - 1)) {
+            continue;
+        }
+
+        slot = &wheel->slots[level][wheel->tick >> (RDP_WHEEL_BITS * level) &
+            RDP_WHEEL_MASK];
+
+        for (timer = *slot, *slot = NULL; timer; timer = next) {
+            next = timer->next;
+            rdp_wheel_insert(wheel, timer);
+        }
+    }
+}
+
+/*
+ * Turns the wheel up to now, one timer at a time so the caller may arm
+ * and cancel timers while it handles each.
+ *
+ * @param wheel timer wheel
+ * @param now rdp_clock() time
+ * @return struct rdp_timer * timer expired and disarmed, NULL: none left
+ */
+struct rdp_timer *rdp_wheel_expired(struct rdp_wheel *wheel,
+    unsigned long long now)
+{
+    unsigned long long end = now / RDP_WHEEL_TICK;
+    struct rdp_timer *timer;
+
+    // an empty wheel skips the ticks it has nothing to do for.
+    if (!wheel->count) {
+        wheel->tick = wheel->tick > end ? wheel->tick : end;
+        return NULL;
+    }
+
+    for (;;) {
+        for (timer = wheel->slots[0][wheel->tick & RDP_WHEEL_MASK]; timer;
+            timer = timer->next) {
+            if (timer->expires <= now) {
+                rdp_timer_cancel(wheel, timer);
+                return timer;
+            }
+        }
+
+        // the current tick may still hold a timer due later in it.
+        if (wheel->tick >= end) {
+            return NULL;
+        }
+
+        wheel->tick++;
+        rdp_wheel_cascade(wheel);
+    }
+}
+
+/*
+ * @param wheel timer wheel
+ * @return unsigned long long rdp_clock() time of the first timer to
+ * expire, 0: none armed
+ */
+unsigned long long rdp_wheel_next(const struct rdp_wheel *wheel)
+{
+    const struct rdp_timer *timer;
+    unsigned long long first = 0;
+    unsigned int i;
+    int level;
+
+    // the first slot in use of the finest level in use holds the first.
+    for (level = 0; level < RDP_WHEEL_LEVELS && wheel->count; level++) {
+        for (i = wheel->tick >> (RDP_WHEEL_BITS * level) & RDP_WHEEL_MASK;
+            i < RDP_WHEEL_SLOTS; i++) {
+            for (timer = wheel->slots[level][i]; timer; timer = timer->next) {
+                if (!first || timer->expires < first) {
+                    first = timer->expires;
+                }
+            }
+
+            if (first) {
+                return first;
+            }
+        }
+    }
+
+    return first;
+}
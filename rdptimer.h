@@ -0,0 +1,42 @@
+#ifndef RDP_TIMER_H
+#define RDP_TIMER_H
+
+// microseconds per tick of the finest level.
+#define RDP_WHEEL_TICK 100
+
+// slots per level, each level's tick is a full turn of the one below.
+#define RDP_WHEEL_BITS 6
+#define RDP_WHEEL_SLOTS (1 << RDP_WHEEL_BITS)
+#define RDP_WHEEL_MASK (RDP_WHEEL_SLOTS - 1)
+
+// levels, 2^30 ticks or about 30 hours ahead.
+#define RDP_WHEEL_LEVELS 5
+
+// RDP timer, an entry of a wheel while it is armed.
+struct rdp_timer {
+    struct rdp_timer *next;
+    struct rdp_timer **prev;    // NULL while not armed
+    unsigned long long expires; // rdp_clock() time
+    void *data;                 // owner, for the caller to dispatch on
+};
+
+// RDP hierarchical timer wheel. Arming and cancelling are O(1); a timer
+// further out than a turn of one level waits in a coarser one and moves
+// down as the wheel turns.
+struct rdp_wheel {
+    unsigned long long tick;    // next tick to expire
+    unsigned int count;         // armed timers
+    struct rdp_timer *slots[RDP_WHEEL_LEVELS][RDP_WHEEL_SLOTS];
+};
+
+void rdp_wheel_init(struct rdp_wheel *wheel, unsigned long long now);
+void rdp_timer_init(struct rdp_timer *timer, void *data);
+void rdp_timer_arm(struct rdp_wheel *wheel, struct rdp_timer *timer,
+    unsigned long long expires);
+void rdp_timer_cancel(struct rdp_wheel *wheel, struct rdp_timer *timer);
+int rdp_timer_pending(const struct rdp_timer *timer);
+struct rdp_timer *rdp_wheel_expired(struct rdp_wheel *wheel,
+    unsigned long long now);
+unsigned long long rdp_wheel_next(const struct rdp_wheel *wheel);
+
+#endif // RDP_TIMER_H
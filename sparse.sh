@@ -0,0 +1,84 @@
+#!/bin/bash
+# RDP large file check: sends a sparse file past 4 GiB over loopback to
+# rdpr receiving into the mapped file, rdpr -c copying and rdpr -S, and
+# compares each copy with cmp.
+#
+# usage: sparse.sh [-s size] [-- rdps options]
+#
+# The file holds random data at its start, across byte 2^32 and at its
+# end, zeros elsewhere. Each copy is written in full, so the directory
+# needs size bytes free. The environment may set PORT (9200), TIMEOUT
+# (seconds per transfer, 600) and TMPDIR.
+
+size=$((4 * 1024 * 1024 * 1024 + 64 * 1024 * 1024))
+port=${PORT:-9200}
+limit=${TIMEOUT:-600}
+chunk=$((1024 * 1024))
+failed=0
+
+while getopts "s:" opt; do
+    case $opt in
+    s) size=$OPTARG ;;
+    *) exit 1 ;;
+    esac
+done
+
+shift $((OPTIND - 1))
+
+if [ "$size" -le $((4 * 1024 * 1024 * 1024 + chunk)) ]; then
+    echo "size must be more than 4 GiB and 1 MiB" >&2
+    exit 1
+fi
+
+cd "$(dirname "$0")" || exit 1
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+# writes a chunk of random data at a byte offset.
+fill() {
+    head -c "$chunk" /dev/urandom | dd of="$dir/data" bs=1M \
+        seek="$1" oflag=seek_bytes conv=notrunc status=none
+}
+
+truncate -s "$size" "$dir/data" || exit 1
+fill 0
+fill $((4 * 1024 * 1024 * 1024 - chunk / 2))
+fill $((size - chunk))
+
+# name, output file, rdpr options
+while read -r name out opts; do
+    rm -f "$dir"/out*
+
+    # shellcheck disable=SC2086
+    timeout "$limit" ./rdpr -v error $opts 127.0.0.1 "$port" "$dir/out" \
+        < /dev/null > /dev/null 2> "$dir/r.err" &
+    receiver=$!
+    sleep 0.2
+
+    start=$(date +%s%N)
+    timeout "$limit" ./rdps -v error "$@" 127.0.0.1 $((port + 1)) \
+        127.0.0.1 "$port" "$dir/data" < /dev/null > /dev/null 2> "$dir/s.err"
+    result=$?
+    end=$(date +%s%N)
+    wait "$receiver"
+
+    if [ $result -ne 0 ]; then
+        status=failed
+    elif cmp "$dir/data" "$dir/$out"; then
+        status=ok
+    else
+        status=corrupt
+    fi
+
+    rm -f "$dir"/out*
+    [ $status = ok ] || failed=1
+    awk -v name="$name" -v ns=$((end - start)) -v status="$status" \
+        'BEGIN { printf "%s %.3fs %s\n", name, ns / 1e9, status }'
+    cat "$dir/s.err" "$dir/r.err" >&2
+done <<EOF
+mapped out
+copy out -c
+server out.1 -S -n 1
+EOF
+
+exit $failed